@@ -72,9 +72,13 @@ GBE_SRC_FILES := \
     $(GBE_SRC_BASE)/audio.cpp \
     $(GBE_SRC_BASE)/cartridge.cpp \
     $(GBE_SRC_BASE)/cpu.cpp \
+    $(GBE_SRC_BASE)/cpu_cache.cpp \
     $(GBE_SRC_BASE)/cpu_disasm.cpp \
+    $(GBE_SRC_BASE)/cpu_recompiler.cpp \
     $(GBE_SRC_BASE)/display.cpp \
     $(GBE_SRC_BASE)/link.cpp \
+    $(GBE_SRC_BASE)/movie.cpp \
+    $(GBE_SRC_BASE)/rewind.cpp \
     $(GBE_SRC_BASE)/serial.cpp \
     $(GBE_SRC_BASE)/structures.cpp \
     $(GBE_SRC_BASE)/system.cpp
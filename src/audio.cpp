@@ -6,20 +6,43 @@
 #include "YBaseLib/ByteStream.h"
 #include "YBaseLib/Error.h"
 #include "YBaseLib/Log.h"
+#include "YBaseLib/Math.h"
 #include "system.h"
 Log_SetChannel(Audio);
 
-static const uint32 OUTPUT_BUFFER_SIZE = 11025 * 2; // 0.25 seconds output buffering (stereo)
+static const uint32 OUTPUT_SAMPLE_RATE = 44100;
+static const uint32 OUTPUT_CHANNELS = 2;
+static const uint32 DEFAULT_OUTPUT_BUFFER_MS = 250;
 static const uint32 PUSH_FREQUENCY_IN_CYCLES = 8192;
+static const uint32 CLOCK_RATE = 4194304;
+static const uint32 CYCLES_PER_FRAME = 70224;
+
+// rate control tuning, the smoothing and integral rates are per push (512 a second). a 60hz display against the
+// 59.73hz game boy needs about 0.45%, and blip_buffer's ratio only moves in steps of 0.15%, so the limit has to leave
+// room above that. the integral takes around 30 seconds of a full error to wind all the way up, which keeps the loop
+// from ringing as the level itself is the integral of the rate.
+static const float RATE_CONTROL_MAX_DEVIATION = 0.01f;
+static const float RATE_CONTROL_SMOOTHING = 1.0f / 64.0f;
+static const float RATE_CONTROL_INTEGRAL_RATE = 1.0f / 16384.0f;
+static const uint32 RATE_CONTROL_HIGH_WATER_FRAMES = 1;
+
+// whole stereo frames, plus the slot the ring keeps empty
+static uint32 MillisecondsToOutputSamples(uint32 ms)
+{
+  return Max(OUTPUT_SAMPLE_RATE * ms / 1000, 1u) * OUTPUT_CHANNELS;
+}
 
 Audio::Audio(System* system)
   : m_system(system), m_buffer(new Stereo_Buffer()), m_apu(new Gb_Apu()), m_last_cycle(0), m_cycles_since_frame(0),
-    m_output_buffer(new int16[OUTPUT_BUFFER_SIZE]), m_output_buffer_rpos(0), m_output_buffer_wpos(0),
-    m_output_buffer_read_overrun(false), m_output_buffer_write_overrun(false), m_output_enabled(true)
+    m_output_buffer(nullptr), m_output_buffer_size(0), m_output_latency(0), m_output_buffer_rpos(0),
+    m_output_buffer_wpos(0), m_output_buffer_flush(false), m_output_overruns(0), m_output_underruns(0),
+    m_output_enabled(true), m_synthesis_enabled(true), m_rate_control_target(0), m_rate_control_high_water(0),
+    m_rate_control_level(0.0f), m_rate_control_integral(0.0f), m_rate_control_waiting(false), m_clock_rate(CLOCK_RATE)
 {
-  m_buffer->clock_rate(4194304);
-  m_buffer->set_sample_rate(44100);
+  m_buffer->clock_rate(CLOCK_RATE);
+  m_buffer->set_sample_rate(OUTPUT_SAMPLE_RATE);
   m_apu->set_output(m_buffer->center(), m_buffer->left(), m_buffer->right());
+  SetOutputBuffering(DEFAULT_OUTPUT_BUFFER_MS, DEFAULT_OUTPUT_BUFFER_MS);
 }
 
 Audio::~Audio()
@@ -34,24 +57,125 @@ void Audio::SetOutputEnabled(bool enabled)
   if (m_output_enabled == enabled)
     return;
 
-  m_lock.Lock();
   if (enabled)
   {
     m_buffer->clear();
-    m_apu->set_output(m_buffer->center(), m_buffer->left(), m_buffer->right());
-    m_output_buffer_rpos = 0;
-    m_output_buffer_wpos = 0;
-    m_output_buffer_read_overrun = false;
-    m_output_buffer_write_overrun = false;
-    m_output_enabled = true;
+    if (m_synthesis_enabled)
+      m_apu->set_output(m_buffer->center(), m_buffer->left(), m_buffer->right());
+    FlushOutputBuffer();
+    m_output_enabled.store(true, std::memory_order_release);
   }
   else
   {
     m_buffer->end_frame(PUSH_FREQUENCY_IN_CYCLES);
     m_apu->set_output(nullptr);
-    m_output_enabled = false;
+    m_output_enabled.store(false, std::memory_order_release);
+  }
+}
+
+uint32 Audio::GetOutputBufferMilliseconds() const
+{
+  return m_output_buffer_size / OUTPUT_CHANNELS * 1000 / OUTPUT_SAMPLE_RATE;
+}
+
+uint32 Audio::GetOutputLatencyMilliseconds() const
+{
+  return m_output_latency / OUTPUT_CHANNELS * 1000 / OUTPUT_SAMPLE_RATE;
+}
+
+void Audio::SetOutputBuffering(uint32 buffer_ms, uint32 latency_ms)
+{
+  uint32 buffer_size = MillisecondsToOutputSamples(buffer_ms) + OUTPUT_CHANNELS;
+  if (buffer_size != m_output_buffer_size)
+  {
+    delete[] m_output_buffer;
+    m_output_buffer = new int16[buffer_size];
+    m_output_buffer_size = buffer_size;
+  }
+
+  m_output_latency = Min(MillisecondsToOutputSamples(latency_ms), buffer_size - OUTPUT_CHANNELS);
+  m_rate_control_target = Min(m_rate_control_target, (buffer_size - OUTPUT_CHANNELS) / 2) & ~(OUTPUT_CHANNELS - 1);
+  m_rate_control_high_water = Min(m_rate_control_high_water, buffer_size - OUTPUT_CHANNELS);
+  m_output_buffer_rpos.store(0, std::memory_order_relaxed);
+  m_output_buffer_wpos.store(0, std::memory_order_relaxed);
+  m_output_buffer_flush.store(false, std::memory_order_release);
+}
+
+void Audio::SetRateControl(uint32 target_ms)
+{
+  if (target_ms == 0)
+  {
+    m_rate_control_target = 0;
+    m_rate_control_high_water = 0;
+    SetClockRate(CLOCK_RATE);
+    return;
+  }
+
+  // the waits leave room for a frame to be pushed on top of the target
+  uint32 frame_samples = uint32(uint64(CYCLES_PER_FRAME) * OUTPUT_SAMPLE_RATE / CLOCK_RATE) * OUTPUT_CHANNELS;
+  uint32 capacity = m_output_buffer_size - OUTPUT_CHANNELS;
+  uint32 target = Min(MillisecondsToOutputSamples(target_ms), capacity / 2) & ~(OUTPUT_CHANNELS - 1);
+  if (m_rate_control_target == target)
+    return;
+
+  m_rate_control_target = target;
+  m_rate_control_high_water = Min(m_rate_control_target + frame_samples * RATE_CONTROL_HIGH_WATER_FRAMES, capacity);
+  m_rate_control_level = float(m_rate_control_target);
+  m_rate_control_integral = 0.0f;
+  m_rate_control_waiting = false;
+}
+
+double Audio::GetOutputWaitTime()
+{
+  if (m_rate_control_target == 0)
+    return 0.0;
+
+  uint32 rpos = m_output_buffer_rpos.load(std::memory_order_relaxed);
+  uint32 wpos = m_output_buffer_wpos.load(std::memory_order_relaxed);
+  uint32 buffered_samples = (wpos + m_output_buffer_size - rpos) % m_output_buffer_size;
+  m_rate_control_waiting = (buffered_samples > m_rate_control_high_water);
+  if (!m_rate_control_waiting)
+    return 0.0;
+
+  return double(buffered_samples - m_rate_control_high_water) / double(OUTPUT_SAMPLE_RATE * OUTPUT_CHANNELS);
+}
+
+bool Audio::IsOutputAboveWaitLevel() const
+{
+  if (m_rate_control_target == 0)
+    return false;
+
+  uint32 rpos = m_output_buffer_rpos.load(std::memory_order_relaxed);
+  uint32 wpos = m_output_buffer_wpos.load(std::memory_order_relaxed);
+  return ((wpos + m_output_buffer_size - rpos) % m_output_buffer_size) > m_rate_control_high_water;
+}
+
+void Audio::GetOutputStats(OutputStats* stats) const
+{
+  uint32 rpos = m_output_buffer_rpos.load(std::memory_order_relaxed);
+  uint32 wpos = m_output_buffer_wpos.load(std::memory_order_relaxed);
+  stats->buffered_samples = (wpos + m_output_buffer_size - rpos) % m_output_buffer_size;
+  stats->buffer_size = m_output_buffer_size - OUTPUT_CHANNELS;
+  stats->overruns = m_output_overruns.load(std::memory_order_relaxed);
+  stats->underruns = m_output_underruns.load(std::memory_order_relaxed);
+  stats->rate_ratio = float(m_clock_rate) / float(CLOCK_RATE);
+}
+
+void Audio::SetSynthesisEnabled(bool enabled)
+{
+  if (m_synthesis_enabled == enabled)
+    return;
+
+  // switch on a frame boundary, otherwise part of the current frame would be synthesized into the wrong place
+  EndFrameEarly();
+  m_synthesis_enabled = enabled;
+  if (m_output_enabled)
+  {
+    if (enabled)
+      m_apu->set_output(m_buffer->center(), m_buffer->left(), m_buffer->right());
+    else
+      m_apu->set_output(nullptr);
   }
-  m_lock.Unlock();
 }
 
 void Audio::Reset()
@@ -63,14 +187,17 @@ void Audio::Reset()
 
 bool Audio::LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError)
 {
-  m_last_cycle = binaryReader.ReadUInt32();
+  // stored relative to the current cycle, the saving session's cycle number is meaningless here
+  m_last_cycle = m_system->GetCycleNumber() - binaryReader.ReadUInt32();
 
   gb_apu_state_t state_in;
   binaryReader.ReadBytes(&state_in, sizeof(state_in));
   if (pStream->InErrorState())
     return false;
 
+  // the apu starts a new frame, which is where it was saved since version 7
   m_apu->reset((m_system->InCGBMode()) ? Gb_Apu::mode_cgb : Gb_Apu::mode_dmg, false);
+  m_cycles_since_frame = 0;
   const char* err = m_apu->load_state(state_in);
   if (err != nullptr)
   {
@@ -80,26 +207,61 @@ bool Audio::LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pE
 
   if (m_output_enabled)
   {
-    m_output_buffer_rpos = 0;
-    m_output_buffer_wpos = 0;
-    m_output_buffer_read_overrun = false;
-    m_output_buffer_write_overrun = false;
+    FlushOutputBuffer();
     m_buffer->end_frame(PUSH_FREQUENCY_IN_CYCLES);
     m_buffer->clear();
   }
 
+  m_system->SetNextAudioSyncCycle(PUSH_FREQUENCY_IN_CYCLES);
   return true;
 }
 
 void Audio::SaveState(ByteStream* pStream, BinaryWriter& binaryWriter)
 {
+  // as with snapshots, the apu can only be saved at the start of a frame
+  EndFrameEarly();
+
   gb_apu_state_t state_out;
   m_apu->save_state(&state_out);
 
-  binaryWriter.WriteUInt32(m_last_cycle);
+  binaryWriter.WriteUInt32(uint32(m_system->GetCycleNumber() - m_last_cycle));
   binaryWriter.WriteBytes(&state_out, sizeof(state_out));
 }
 
+void Audio::SaveSnapshot(SnapshotState* state)
+{
+  static_assert(sizeof(gb_apu_state_t) == sizeof(state->apu_state), "apu state size mismatch");
+
+  // the apu does not store how far into the frame it has run, so don't leave it anywhere but the start
+  EndFrameEarly();
+  m_apu->save_state(reinterpret_cast<gb_apu_state_t*>(state->apu_state));
+  state->last_cycle = m_last_cycle;
+}
+
+void Audio::LoadSnapshot(const SnapshotState* state)
+{
+  // samples generated so far are still output, the restored state continues from a new frame
+  EndFrameEarly();
+  m_apu->reset((m_system->InCGBMode()) ? Gb_Apu::mode_cgb : Gb_Apu::mode_dmg, false);
+  m_apu->load_state(*reinterpret_cast<const gb_apu_state_t*>(state->apu_state));
+  m_last_cycle = state->last_cycle;
+}
+
+void Audio::EndFrameEarly()
+{
+  // full frames are pushed as usual, only the remainder is cut short
+  Synchronize();
+  if (m_cycles_since_frame == 0)
+    return;
+
+  m_apu->end_frame(m_cycles_since_frame);
+  if (IsSynthesizing())
+    m_buffer->end_frame(m_cycles_since_frame);
+
+  m_cycles_since_frame = 0;
+  m_system->SetNextAudioSyncCycle(PUSH_FREQUENCY_IN_CYCLES);
+}
+
 void Audio::Synchronize()
 {
   uint32 cycles_to_execute = m_system->CalculateCycleCount(m_last_cycle);
@@ -114,43 +276,11 @@ void Audio::Synchronize()
     m_apu->end_frame(PUSH_FREQUENCY_IN_CYCLES);
 
     // copy to output buffer
-    if (m_output_enabled)
+    if (IsSynthesizing())
     {
       m_buffer->end_frame(PUSH_FREQUENCY_IN_CYCLES);
 
-      m_lock.Lock();
-      {
-        // no more read buffer overrun
-        m_output_buffer_read_overrun = false;
-
-        // gather samples
-        size_t remaining = m_buffer->samples_avail();
-        while (remaining > 0)
-        {
-          // find available space
-          size_t copy_samples = Min(remaining, OUTPUT_BUFFER_SIZE - m_output_buffer_wpos);
-          if (!m_output_buffer_write_overrun && m_output_buffer_rpos > m_output_buffer_wpos &&
-              (m_output_buffer_wpos + copy_samples) > m_output_buffer_rpos)
-          {
-            // don't spam about overruns with frame limiter off (it's guaranteed to happen)
-            if (m_system->GetFrameLimiter() && m_system->GetTargetSpeed() == 1.0f)
-              Log_DevPrintf("WARN: Audio buffer overrun by write (too much data)");
-
-            m_output_buffer_write_overrun = true;
-          }
-
-          // copy samples
-          m_buffer->read_samples(m_output_buffer + m_output_buffer_wpos, copy_samples);
-          m_output_buffer_wpos += copy_samples;
-          m_output_buffer_wpos %= OUTPUT_BUFFER_SIZE;
-          remaining -= copy_samples;
-
-          // if there's a write overrun, start the next read at the end of the stuff we just wrote
-          if (m_output_buffer_write_overrun)
-            m_output_buffer_rpos = m_output_buffer_wpos;
-        }
-      }
-      m_lock.Unlock();
+      PushOutputSamples();
     }
   }
 
@@ -169,57 +299,121 @@ void Audio::CPUWriteRegister(uint8 index, uint8 value)
   return m_apu->write_register(op_time, 0xFF00 | index, value);
 }
 
-size_t Audio::ReadSamples(int16* buffer, size_t count)
+void Audio::PushOutputSamples()
 {
-  m_lock.Lock();
-  if (!m_output_enabled)
+  // the reader only ever frees space, so what is free now stays free
+  uint32 rpos = m_output_buffer_rpos.load(std::memory_order_acquire);
+  uint32 wpos = m_output_buffer_wpos.load(std::memory_order_relaxed);
+  uint32 free_samples = (rpos + m_output_buffer_size - wpos - OUTPUT_CHANNELS) % m_output_buffer_size;
+  uint32 remaining = uint32(m_buffer->samples_avail());
+  if (remaining > free_samples)
   {
-    m_lock.Unlock();
-    return 0;
+    // don't spam about overruns with frame limiter off (it's guaranteed to happen)
+    if (m_system->GetFrameLimiter() && m_system->GetTargetSpeed() == 1.0f)
+      Log_DevPrintf("WARN: Audio buffer overrun by write (too much data)");
+
+    m_output_overruns.fetch_add(1, std::memory_order_relaxed);
   }
 
-  if (m_output_buffer_write_overrun)
+  // up to the end of the ring, then from the start
+  uint32 write_samples = Min(remaining, free_samples);
+  while (write_samples > 0)
   {
-    // cancel the write overrun
-    m_output_buffer_write_overrun = false;
+    uint32 copy_samples = Min(write_samples, m_output_buffer_size - wpos);
+    m_buffer->read_samples(m_output_buffer + wpos, copy_samples);
+    wpos = (wpos + copy_samples) % m_output_buffer_size;
+    write_samples -= copy_samples;
+    remaining -= copy_samples;
   }
-  else
+  m_output_buffer_wpos.store(wpos, std::memory_order_release);
+  if (m_rate_control_target != 0)
+    UpdateRateControl((wpos + m_output_buffer_size - rpos) % m_output_buffer_size);
+
+  // the newest samples are dropped, the reader has to catch up first
+  int16 discard[512];
+  while (remaining > 0)
+    remaining -= uint32(m_buffer->read_samples(discard, Min(remaining, uint32(countof(discard)))));
+}
+
+void Audio::FlushOutputBuffer()
+{
+  m_output_buffer_flush.store(true, std::memory_order_release);
+
+  // the ring refills from empty, which shouldn't count against the rate
+  m_rate_control_level = float(m_rate_control_target);
+}
+
+void Audio::UpdateRateControl(uint32 buffered_samples)
+{
+  // the reader may have taken more since, which only makes the level look higher than it is for a push
+  m_rate_control_level += (float(buffered_samples) - m_rate_control_level) * RATE_CONTROL_SMOOTHING;
+  float error = Math::Clamp((m_rate_control_level - float(m_rate_control_target)) / float(m_rate_control_target),
+                            -1.0f, 1.0f);
+
+  // while the producer is being held back by the waits they are what paces it, and the level stays up whatever the
+  // rate is. winding up on it would only speed the emulation up, so hold the integral and leave the level out.
+  float adjustment = m_rate_control_integral;
+  if (!m_rate_control_waiting)
   {
-    // silence until we have at least a full buffer worth of samples to begin with
-    size_t available_samples = (m_output_buffer_wpos > m_output_buffer_rpos) ?
-                                 (m_output_buffer_wpos - m_output_buffer_rpos) :
-                                 ((OUTPUT_BUFFER_SIZE - m_output_buffer_rpos) + m_output_buffer_wpos);
-    if (available_samples < count)
-    {
-      m_lock.Unlock();
-      return 0;
-    }
+    m_rate_control_integral =
+      Math::Clamp(m_rate_control_integral + error * RATE_CONTROL_INTEGRAL_RATE, -1.0f, 1.0f);
+    adjustment = Math::Clamp(error + m_rate_control_integral, -1.0f, 1.0f);
+  }
+
+  // a higher clock rate makes fewer samples per emulated second, draining the ring
+  SetClockRate(uint32(float(CLOCK_RATE) * (1.0f + adjustment * RATE_CONTROL_MAX_DEVIATION) + 0.5f));
+}
+
+void Audio::SetClockRate(uint32 clock_rate)
+{
+  // blip_buffer keeps the position in output samples, so this can change between any two frames
+  if (m_clock_rate == clock_rate)
+    return;
+
+  m_clock_rate = clock_rate;
+  m_buffer->clock_rate(long(clock_rate));
+}
+
+size_t Audio::ReadSamples(int16* buffer, size_t count)
+{
+  // no locks or logging here, this runs on the output thread
+  if (!m_output_enabled.load(std::memory_order_acquire))
+    return 0;
+
+  uint32 wpos = m_output_buffer_wpos.load(std::memory_order_acquire);
+  uint32 rpos = m_output_buffer_rpos.load(std::memory_order_relaxed);
+  if (m_output_buffer_flush.exchange(false, std::memory_order_acquire))
+    rpos = wpos;
+
+  // skip the oldest samples when the output has fallen too far behind
+  uint32 available = (wpos + m_output_buffer_size - rpos) % m_output_buffer_size;
+  uint32 keep = m_output_latency + uint32(count);
+  if (available > keep)
+  {
+    uint32 skip = (available - keep) & ~(OUTPUT_CHANNELS - 1);
+    rpos = (rpos + skip) % m_output_buffer_size;
+    available -= skip;
+    m_output_overruns.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // silence until there is a full request worth of samples
+  if (available < count)
+  {
+    m_output_underruns.fetch_add(1, std::memory_order_relaxed);
+    m_output_buffer_rpos.store(rpos, std::memory_order_release);
+    return 0;
   }
 
   size_t remaining = count;
   while (remaining > 0)
   {
-    // check that we don't go past the write pointer
-    size_t copy_samples = Min(remaining, OUTPUT_BUFFER_SIZE - m_output_buffer_rpos);
-    if (!m_output_buffer_read_overrun && m_output_buffer_wpos > m_output_buffer_rpos &&
-        (m_output_buffer_rpos + copy_samples) > m_output_buffer_wpos)
-    {
-      Log_DevPrintf("WARN: Audio buffer overrun by read (not enough data)");
-      m_output_buffer_read_overrun = true;
-    }
-
-    // copy samples
-    Y_memcpy(buffer, m_output_buffer + m_output_buffer_rpos, copy_samples * sizeof(int16));
-    m_output_buffer_rpos += copy_samples;
-    m_output_buffer_rpos %= OUTPUT_BUFFER_SIZE;
+    uint32 copy_samples = Min(uint32(remaining), m_output_buffer_size - rpos);
+    Y_memcpy(buffer, m_output_buffer + rpos, copy_samples * sizeof(int16));
+    rpos = (rpos + copy_samples) % m_output_buffer_size;
     buffer += copy_samples;
     remaining -= copy_samples;
-
-    // if there's a read overrun, start the next write at the end of the stuff we just read
-    if (m_output_buffer_read_overrun)
-      m_output_buffer_wpos = m_output_buffer_rpos;
   }
 
-  m_lock.Unlock();
+  m_output_buffer_rpos.store(rpos, std::memory_order_release);
   return count;
 }
@@ -1,6 +1,6 @@
 #pragma once
-#include "YBaseLib/Mutex.h"
 #include "structures.h"
+#include <atomic>
 
 class ByteStream;
 class BinaryReader;
@@ -22,6 +22,10 @@ public:
   bool GetOutputEnabled() const { return m_output_enabled; }
   void SetOutputEnabled(bool enabled);
 
+  // with synthesis off the apu is still emulated but produces no samples, for frames that are thrown away
+  bool GetSynthesisEnabled() const { return m_synthesis_enabled; }
+  void SetSynthesisEnabled(bool enabled);
+
   void Reset();
   void Synchronize();
 
@@ -29,7 +33,36 @@ public:
   uint8 CPUReadRegister(uint8 index) const;
   void CPUWriteRegister(uint8 index, uint8 value);
 
-  // sample access
+  // output buffering, the ring holds up to buffer_ms of audio. once more than latency_ms is queued the oldest samples
+  // are skipped, so the output never falls further behind than that. the output callback must not be running.
+  uint32 GetOutputBufferMilliseconds() const;
+  uint32 GetOutputLatencyMilliseconds() const;
+  void SetOutputBuffering(uint32 buffer_ms, uint32 latency_ms);
+
+  // sample counts include both channels
+  struct OutputStats
+  {
+    uint32 buffered_samples;
+    uint32 buffer_size;
+    uint32 overruns;  // pushes that didn't fit, or reads that skipped samples to stay within the latency
+    uint32 underruns; // reads that found less than they asked for and returned silence
+    float rate_ratio; // emulated clocks per nominal clock the resampler is running at, 1 without rate control
+  };
+  void GetOutputStats(OutputStats* stats) const;
+
+  // dynamic rate control, nudges the resampling ratio by up to a percent so the output ring stays around
+  // target_ms of audio. this absorbs the difference between the emulated clock and the rate the output actually
+  // consumes samples at. the usual correction is under half a percent, a few cents of pitch. 0 turns it off.
+  void SetRateControl(uint32 target_ms);
+
+  // with rate control, the seconds until the queued audio drains back down to a frame past the target.
+  // the producer waiting on this is what bounds the latency when nothing else paces it.
+  double GetOutputWaitTime();
+
+  // whether the queued audio is still above the level GetOutputWaitTime() waits for, checked on each output read
+  bool IsOutputAboveWaitLevel() const;
+
+  // sample access, from the output thread. never blocks, returns 0 when fewer than count samples are queued.
   size_t ReadSamples(int16* buffer, size_t count);
 
 private:
@@ -37,20 +70,56 @@ private:
   bool LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError);
   void SaveState(ByteStream* pStream, BinaryWriter& binaryWriter);
 
+  // machine state for System::Snapshot, apu_state holds a gb_apu_state_t
+  struct SnapshotState
+  {
+    byte apu_state[256];
+    uint64 last_cycle;
+  };
+  void SaveSnapshot(SnapshotState* state);
+  void LoadSnapshot(const SnapshotState* state);
+
+  bool IsSynthesizing() const { return (m_output_enabled && m_synthesis_enabled); }
+
+  // ends the apu frame early at the current cycle, a snapshot always starts at the beginning of a frame
+  void EndFrameEarly();
+
+  // moves everything synthesized into the output ring, dropping what doesn't fit
+  void PushOutputSamples();
+
+  // drops everything queued, done by the reader as it owns the read position
+  void FlushOutputBuffer();
+
+  // adjusts the resampler clock rate from the ring level after a push
+  void UpdateRateControl(uint32 buffered_samples);
+  void SetClockRate(uint32 clock_rate);
+
   System* m_system;
 
   Gb_Apu* m_apu;
   Stereo_Buffer* m_buffer;
 
-  uint32 m_last_cycle;
+  uint64 m_last_cycle;
   uint32 m_cycles_since_frame;
 
-  Mutex m_lock;
-
+  // single producer (emulation thread) single consumer (output thread) ring. each side only stores its own position,
+  // and one slot is kept empty so a full ring can be told apart from an empty one.
   int16* m_output_buffer;
-  size_t m_output_buffer_rpos;
-  size_t m_output_buffer_wpos;
-  bool m_output_buffer_read_overrun;
-  bool m_output_buffer_write_overrun;
-  bool m_output_enabled;
+  uint32 m_output_buffer_size;
+  uint32 m_output_latency;
+  std::atomic<uint32> m_output_buffer_rpos;
+  std::atomic<uint32> m_output_buffer_wpos;
+  std::atomic<bool> m_output_buffer_flush;
+  std::atomic<uint32> m_output_overruns;
+  std::atomic<uint32> m_output_underruns;
+  std::atomic<bool> m_output_enabled;
+  bool m_synthesis_enabled;
+
+  // rate control state, all in samples of the output ring. the level is smoothed as the output reads in bursts.
+  uint32 m_rate_control_target;
+  uint32 m_rate_control_high_water;
+  float m_rate_control_level;
+  float m_rate_control_integral;
+  bool m_rate_control_waiting;
+  uint32 m_clock_rate;
 };
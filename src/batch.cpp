@@ -0,0 +1,512 @@
+// headless batch runner, runs many independent systems across all cores without a frontend
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cartridge.h"
+#include "cpu.h"
+#include "display.h"
+#include "system.h"
+
+#include "YBaseLib/AutoReleasePtr.h"
+#include "YBaseLib/ByteStream.h"
+#include "YBaseLib/CString.h"
+#include "YBaseLib/Error.h"
+#include "YBaseLib/FileSystem.h"
+#include "YBaseLib/Log.h"
+#include "YBaseLib/Memory.h"
+#include "YBaseLib/StringConverter.h"
+#include "YBaseLib/Timer.h"
+
+Log_SetChannel(Batch);
+
+// frames an instance runs before it goes back on the queue, short enough to balance the tail of the batch
+static const uint32 FRAMES_PER_SLICE = 60;
+
+struct BatchArgs
+{
+  std::vector<const char*> rom_filenames;
+  std::vector<const char*> input_filenames;
+  SYSTEM_MODE system_mode;
+  CPU_BACKEND cpu_backend;
+  bool idle_loop_skipping;
+  uint32 num_instances;
+  uint32 num_threads;
+  uint32 frames;
+};
+
+// rom image, read from disk once and parsed by every instance using it
+struct ROMImage
+{
+  const char* filename;
+  byte* data;
+  uint32 size;
+};
+
+// pad state to apply at the start of a frame
+struct InputEvent
+{
+  uint32 frame;
+  uint8 direction_state;
+  uint8 button_state;
+};
+
+struct InputScript
+{
+  const char* filename;
+  std::vector<InputEvent> events;
+};
+
+// batch instances have no outputs, cartridge ram starts empty and is never written back
+struct NullCallbacks : public System::CallbackInterface
+{
+  virtual void PresentDisplayBuffer(const void* pPixels, uint32 row_stride) override final {}
+  virtual bool LoadCartridgeRAM(void* pData, size_t expected_data_size) override final { return false; }
+  virtual void SaveCartridgeRAM(const void* pData, size_t data_size) override final {}
+  virtual bool LoadCartridgeRTC(void* pData, size_t expected_data_size) override final { return false; }
+  virtual void SaveCartridgeRTC(const void* pData, size_t data_size) override final {}
+};
+
+struct Instance
+{
+  NullCallbacks callbacks;
+  System* system;
+  Cartridge* cart;
+  const ROMImage* rom;
+  const InputScript* input;
+  uint32 next_input_event;
+  uint32 frames_executed;
+  uint64 clocks_executed;
+};
+
+static void ShowUsage(const char* progname)
+{
+  fprintf(stderr, "gbe-batch\n");
+  fprintf(stderr,
+          "usage: %s [-h] [-instances <count>] [-threads <count>] [-frames <count>] [-mode <dmg|sgb|cgb>] "
+          "[-cpu <interpreter|threaded|cached|recompiler>] [-noidleskip] [-input <script file>]... <cart file>...\n",
+          progname);
+  fprintf(stderr, "instances are assigned cart files and input scripts in turn.\n");
+  fprintf(stderr, "input scripts hold one \"<frame> <buttons>\" line per change, buttons are joined with '+' from\n");
+  fprintf(stderr, "up, down, left, right, a, b, select and start, or '-' to release everything.\n");
+}
+
+static bool ParseArguments(int argc, char* argv[], BatchArgs* out_args)
+{
+#define CHECK_ARG(str) !Y_strcmp(argv[i], str)
+#define CHECK_ARG_PARAM(str) !Y_strcmp(argv[i], str) && ((i + 1) < argc)
+
+  out_args->system_mode = NUM_SYSTEM_MODES;
+  out_args->cpu_backend = CPU_BACKEND_CACHED_INTERPRETER;
+  out_args->idle_loop_skipping = true;
+  out_args->num_instances = 0;
+  out_args->num_threads = Max(std::thread::hardware_concurrency(), 1u);
+  out_args->frames = 3600;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (CHECK_ARG("-h") || CHECK_ARG("-?"))
+    {
+      ShowUsage(argv[0]);
+      return false;
+    }
+    else if (CHECK_ARG_PARAM("-instances"))
+    {
+      out_args->num_instances = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-threads"))
+    {
+      out_args->num_threads = Max(StringConverter::StringToUInt32(argv[++i]), 1u);
+    }
+    else if (CHECK_ARG_PARAM("-frames"))
+    {
+      out_args->frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-mode"))
+    {
+      i++;
+      if (!Y_stricmp(argv[i], "dmg"))
+        out_args->system_mode = SYSTEM_MODE_DMG;
+      else if (!Y_stricmp(argv[i], "sgb"))
+        out_args->system_mode = SYSTEM_MODE_SGB;
+      else if (!Y_stricmp(argv[i], "cgb"))
+        out_args->system_mode = SYSTEM_MODE_CGB;
+      else
+      {
+        fprintf(stderr, "Unknown system mode: '%s'", argv[i]);
+        return false;
+      }
+    }
+    else if (CHECK_ARG_PARAM("-cpu"))
+    {
+      i++;
+      if (!Y_stricmp(argv[i], "interpreter"))
+        out_args->cpu_backend = CPU_BACKEND_INTERPRETER;
+      else if (!Y_stricmp(argv[i], "threaded"))
+        out_args->cpu_backend = CPU_BACKEND_THREADED_INTERPRETER;
+      else if (!Y_stricmp(argv[i], "cached"))
+        out_args->cpu_backend = CPU_BACKEND_CACHED_INTERPRETER;
+      else if (!Y_stricmp(argv[i], "recompiler"))
+        out_args->cpu_backend = CPU_BACKEND_RECOMPILER;
+      else
+      {
+        fprintf(stderr, "Unknown cpu backend: '%s'", argv[i]);
+        return false;
+      }
+    }
+    else if (CHECK_ARG("-idleskip"))
+    {
+      out_args->idle_loop_skipping = true;
+    }
+    else if (CHECK_ARG("-noidleskip"))
+    {
+      out_args->idle_loop_skipping = false;
+    }
+    else if (CHECK_ARG_PARAM("-input"))
+    {
+      out_args->input_filenames.push_back(argv[++i]);
+    }
+    else
+    {
+      out_args->rom_filenames.push_back(argv[i]);
+    }
+  }
+
+  if (out_args->rom_filenames.empty())
+  {
+    ShowUsage(argv[0]);
+    return false;
+  }
+
+  // one instance per cart unless told otherwise
+  if (out_args->num_instances == 0)
+    out_args->num_instances = uint32(out_args->rom_filenames.size());
+
+  return true;
+
+#undef CHECK_ARG
+#undef CHECK_ARG_PARAM
+}
+
+static bool LoadROMImage(const char* filename, ROMImage* image)
+{
+  AutoReleasePtr<ByteStream> pStream = FileSystem::OpenFile(filename, BYTESTREAM_OPEN_READ | BYTESTREAM_OPEN_STREAMED);
+  if (pStream == nullptr)
+  {
+    Log_ErrorPrintf("Failed to open cartridge file '%s'", filename);
+    return false;
+  }
+
+  image->filename = filename;
+  image->size = (uint32)pStream->GetSize();
+  image->data = (byte*)Y_malloc(image->size);
+  if (!pStream->Read2(image->data, image->size))
+  {
+    Log_ErrorPrintf("Failed to read cartridge file '%s'", filename);
+    return false;
+  }
+
+  return true;
+}
+
+static bool ParseButtons(const char* buttons, InputEvent* event)
+{
+  event->direction_state = 0;
+  event->button_state = 0;
+  if (!Y_strcmp(buttons, "-"))
+    return true;
+
+  static const struct
+  {
+    const char* name;
+    uint8 direction;
+    uint8 button;
+  } button_names[] = {{"up", PAD_DIRECTION_UP, 0},      {"down", PAD_DIRECTION_DOWN, 0},
+                      {"left", PAD_DIRECTION_LEFT, 0},  {"right", PAD_DIRECTION_RIGHT, 0},
+                      {"a", 0, PAD_BUTTON_A},           {"b", 0, PAD_BUTTON_B},
+                      {"select", 0, PAD_BUTTON_SELECT}, {"start", 0, PAD_BUTTON_START}};
+
+  const char* current = buttons;
+  for (;;)
+  {
+    char name[16];
+    uint32 length = 0;
+    while (current[length] != '\0' && current[length] != '+' && length < (sizeof(name) - 1))
+    {
+      name[length] = current[length];
+      length++;
+    }
+    name[length] = '\0';
+
+    uint32 i;
+    for (i = 0; i < countof(button_names); i++)
+    {
+      if (!Y_stricmp(name, button_names[i].name))
+      {
+        event->direction_state |= button_names[i].direction;
+        event->button_state |= button_names[i].button;
+        break;
+      }
+    }
+    if (i == countof(button_names) || (current[length] != '\0' && current[length] != '+'))
+      return false;
+
+    if (current[length] == '\0')
+      return true;
+
+    current += length + 1;
+  }
+}
+
+static bool LoadInputScript(const char* filename, InputScript* script)
+{
+  FILE* fp = fopen(filename, "r");
+  if (fp == nullptr)
+  {
+    Log_ErrorPrintf("Failed to open input script '%s'", filename);
+    return false;
+  }
+
+  script->filename = filename;
+
+  char line[256];
+  uint32 line_number = 0;
+  bool result = true;
+  while (fgets(line, sizeof(line), fp) != nullptr)
+  {
+    line_number++;
+    if (line[0] == '#' || line[0] == '\r' || line[0] == '\n')
+      continue;
+
+    uint32 frame;
+    char buttons[128];
+    InputEvent event;
+    if (sscanf(line, "%u %127s", &frame, buttons) != 2 || !ParseButtons(buttons, &event) ||
+        (!script->events.empty() && frame < script->events.back().frame))
+    {
+      Log_ErrorPrintf("Invalid input script line %s:%u", filename, line_number);
+      result = false;
+      break;
+    }
+
+    event.frame = frame;
+    script->events.push_back(event);
+  }
+
+  fclose(fp);
+  return result;
+}
+
+static bool InitializeInstance(const BatchArgs* args, const ROMImage* rom, const InputScript* input,
+                               Instance* instance)
+{
+  instance->system = new System(&instance->callbacks);
+  instance->cart = new Cartridge(instance->system);
+  instance->rom = rom;
+  instance->input = input;
+  instance->next_input_event = 0;
+  instance->frames_executed = 0;
+  instance->clocks_executed = 0;
+
+  ByteStream* pStream = ByteStream_CreateReadOnlyMemoryStream(rom->data, rom->size);
+  Error error;
+  bool result = instance->cart->Load(pStream, &error);
+  pStream->Release();
+  if (!result)
+  {
+    Log_ErrorPrintf("Failed to load cartridge file '%s': %s", rom->filename,
+                    error.GetErrorDescription().GetCharArray());
+    return false;
+  }
+
+  // batch instances always start from the post-bootstrap state
+  SYSTEM_MODE system_mode =
+    (args->system_mode != NUM_SYSTEM_MODES) ? args->system_mode : instance->cart->GetSystemMode();
+  if (!instance->system->Init(system_mode, nullptr, 0, instance->cart))
+  {
+    Log_ErrorPrintf("Failed to initialize system for '%s'", rom->filename);
+    return false;
+  }
+
+  instance->system->SetAudioEnabled(false);
+  instance->system->SetCPUBackend(args->cpu_backend);
+  instance->system->SetIdleLoopSkipping(args->idle_loop_skipping);
+
+  // nothing looks at the pixels, so frames are never converted to colour
+  instance->system->GetDisplay()->SetIndexedOutput(true);
+  return true;
+}
+
+static void RunInstanceSlice(Instance* instance, uint32 frames)
+{
+  System* system = instance->system;
+  for (uint32 i = 0; i < frames; i++)
+  {
+    // input changes land on frame boundaries, so a script replays identically regardless of scheduling
+    if (instance->input != nullptr)
+    {
+      const std::vector<InputEvent>& events = instance->input->events;
+      while (instance->next_input_event < events.size() &&
+             events[instance->next_input_event].frame <= instance->frames_executed)
+      {
+        const InputEvent& event = events[instance->next_input_event++];
+        system->SetPadDirectionState(event.direction_state);
+        system->SetPadButtonState(event.button_state);
+      }
+    }
+
+    uint64 start_clocks = system->GetClocksSinceReset();
+    system->RunFrames(1);
+    instance->clocks_executed += system->GetClocksSinceReset() - start_clocks;
+    instance->frames_executed++;
+  }
+}
+
+// every thread has its own queue of instances, run a slice at a time. a thread whose queue is empty takes instances
+// from the back of the others, so the tail of the batch is spread over every thread without a shared lock.
+struct WorkQueue
+{
+  std::mutex lock;
+  std::deque<uint32> instances;
+};
+
+static bool PopInstance(WorkQueue* queue, bool steal, uint32* index)
+{
+  std::lock_guard<std::mutex> guard(queue->lock);
+  if (queue->instances.empty())
+    return false;
+
+  if (steal)
+  {
+    *index = queue->instances.back();
+    queue->instances.pop_back();
+  }
+  else
+  {
+    *index = queue->instances.front();
+    queue->instances.pop_front();
+  }
+
+  return true;
+}
+
+static void RunBatch(std::vector<Instance>& instances, uint32 num_threads, uint32 frames)
+{
+  std::vector<WorkQueue> queues(num_threads);
+  for (uint32 i = 0; i < instances.size(); i++)
+    queues[i % num_threads].instances.push_back(i);
+
+  // an instance is always in a queue unless it is running, so once every queue is empty the work left is already
+  // running on the other threads
+  auto worker = [&](uint32 thread_index) {
+    WorkQueue* own_queue = &queues[thread_index];
+    for (;;)
+    {
+      uint32 index;
+      bool found = PopInstance(own_queue, false, &index);
+      for (uint32 i = 1; i < num_threads && !found; i++)
+        found = PopInstance(&queues[(thread_index + i) % num_threads], true, &index);
+      if (!found)
+        return;
+
+      Instance* instance = &instances[index];
+      RunInstanceSlice(instance, Min(frames - instance->frames_executed, FRAMES_PER_SLICE));
+      if (instance->frames_executed < frames)
+      {
+        std::lock_guard<std::mutex> guard(own_queue->lock);
+        own_queue->instances.push_back(index);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (uint32 i = 1; i < num_threads; i++)
+    threads.emplace_back(worker, i);
+
+  worker(0);
+  for (std::thread& thread : threads)
+    thread.join();
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef Y_BUILD_CONFIG_DEBUG
+  g_pLog->SetConsoleOutputParams(true, nullptr, LOGLEVEL_PROFILE);
+#else
+  g_pLog->SetConsoleOutputParams(true, nullptr, LOGLEVEL_INFO);
+#endif
+
+  BatchArgs args;
+  if (!ParseArguments(argc, argv, &args))
+    return 1;
+
+  int return_code = 0;
+  std::vector<ROMImage> roms(args.rom_filenames.size(), ROMImage{nullptr, nullptr, 0});
+  std::vector<InputScript> inputs(args.input_filenames.size());
+  std::vector<Instance> instances(args.num_instances);
+  for (Instance& instance : instances)
+  {
+    instance.system = nullptr;
+    instance.cart = nullptr;
+  }
+
+  for (size_t i = 0; i < roms.size() && return_code == 0; i++)
+  {
+    if (!LoadROMImage(args.rom_filenames[i], &roms[i]))
+      return_code = 2;
+  }
+  for (size_t i = 0; i < inputs.size() && return_code == 0; i++)
+  {
+    if (!LoadInputScript(args.input_filenames[i], &inputs[i]))
+      return_code = 2;
+  }
+  for (uint32 i = 0; i < args.num_instances && return_code == 0; i++)
+  {
+    const InputScript* input = inputs.empty() ? nullptr : &inputs[i % inputs.size()];
+    if (!InitializeInstance(&args, &roms[i % roms.size()], input, &instances[i]))
+      return_code = 2;
+  }
+
+  if (return_code == 0)
+  {
+    uint32 num_threads = Min(args.num_threads, args.num_instances);
+    Log_InfoPrintf("Running %u instances of %u carts for %u frames on %u threads (%s)", args.num_instances,
+                   uint32(roms.size()), args.frames, num_threads,
+                   NameTable_GetNameString(NameTables::CPUBackend, args.cpu_backend));
+
+    Timer timer;
+    RunBatch(instances, num_threads, args.frames);
+    double seconds = timer.GetTimeSeconds();
+
+    uint64 total_frames = 0;
+    uint64 total_clocks = 0;
+    uint64 total_instructions = 0;
+    for (uint32 i = 0; i < args.num_instances; i++)
+    {
+      const Instance& instance = instances[i];
+      total_frames += instance.frames_executed;
+      total_clocks += instance.clocks_executed;
+      total_instructions += instance.system->GetCPU()->GetInstructionCounter();
+      Log_DevPrintf("instance %u (%s): %u frames, %u pushed", i, instance.rom->filename, instance.frames_executed,
+                    instance.system->GetFrameCounter());
+    }
+
+    // from the clocks each instance actually ran, rather than assuming every frame is 70224 clocks long
+    double emulated_mhz = double(total_clocks) / seconds / 1000000.0;
+    Log_InfoPrintf("%llu frames in %.3f seconds: %.1f frames/sec, %.1f emulated MHz (%.0f%% of one system), %.2f MIPS",
+                   total_frames, seconds, double(total_frames) / seconds, emulated_mhz,
+                   emulated_mhz / 4.194304 * 100.0, double(total_instructions) / seconds / 1000000.0);
+  }
+
+  for (Instance& instance : instances)
+  {
+    delete instance.cart;
+    delete instance.system;
+  }
+  for (ROMImage& rom : roms)
+    Y_free(rom.data);
+
+  return return_code;
+}
@@ -55,9 +55,11 @@ static const uint32 CART_ROM_BANK_COUNT[][2] = {
 
 Cartridge::Cartridge(System* system)
   : m_system(system), m_mbc(NUM_MBC_TYPES), m_crc(0), m_typeinfo(nullptr), m_rom_banks(nullptr), m_num_rom_banks(0),
-    m_external_ram(nullptr), m_external_ram_size(0), m_external_ram_modified(false)
+    m_external_ram(nullptr), m_external_ram_size(0), m_external_ram_modified(false), m_external_ram_version(1),
+    m_external_ram_version_counter(1), m_rtc_emulated_time(false)
 {
   Y_memzero(&m_mbc_data, sizeof(m_mbc_data));
+  Y_memzero(&m_rtc_data, sizeof(m_rtc_data));
 }
 
 Cartridge::~Cartridge()
@@ -276,6 +278,8 @@ void Cartridge::LoadRAM()
     Log_WarningPrintf("Failed to load external SRAM, blanking.");
     Y_memzero(m_external_ram, m_external_ram_size);
   }
+
+  ExternalRAMChanged();
 }
 
 void Cartridge::SaveRAM()
@@ -295,6 +299,8 @@ void Cartridge::LoadRTC()
   // set defaults
   m_rtc_data.base_time = Timestamp::Now().AsUnixTimestamp();
   m_rtc_data.active = false;
+  m_rtc_data.emulated_time = m_rtc_data.base_time;
+  m_rtc_data.emulated_last_cycle = m_system->GetCycleNumber();
 
   // load data
   BinaryReadBuffer buffer(16);
@@ -333,10 +339,48 @@ void Cartridge::SaveRTC()
   m_system->m_callbacks->SaveCartridgeRTC(buffer.GetBufferPointer(), (size_t)buffer.GetStreamPosition());
 }
 
-Cartridge::RTCValue Cartridge::GetCurrentRTCTime() const
+void Cartridge::SetRTCEmulatedTime(bool enabled)
 {
-  Timestamp current_time = Timestamp::Now();
-  uint64 current_time_unix = current_time.AsUnixTimestamp();
+  if (m_rtc_emulated_time == enabled)
+    return;
+
+  if (enabled)
+  {
+    m_rtc_data.emulated_time = Timestamp::Now().AsUnixTimestamp();
+    m_rtc_data.emulated_clocks = 0;
+    m_rtc_data.emulated_last_cycle = m_system->GetCycleNumber();
+  }
+
+  m_rtc_emulated_time = enabled;
+}
+
+void Cartridge::SynchronizeRTC()
+{
+  if (!m_rtc_emulated_time)
+    return;
+
+  // the rtc is read rarely, so this can cover much more than the 32 bits CalculateCycleCount allows
+  uint64 clocks = (m_system->GetCycleNumber() - m_rtc_data.emulated_last_cycle) >> m_system->GetDoubleSpeedDivider();
+  m_rtc_data.emulated_last_cycle = m_system->GetCycleNumber();
+
+  // cpu runs at 4,194,304hz
+  clocks += m_rtc_data.emulated_clocks;
+  m_rtc_data.emulated_time += clocks / 4194304;
+  m_rtc_data.emulated_clocks = uint32(clocks % 4194304);
+}
+
+Cartridge::RTCValue Cartridge::GetCurrentRTCTime()
+{
+  uint64 current_time_unix;
+  if (m_rtc_emulated_time)
+  {
+    SynchronizeRTC();
+    current_time_unix = m_rtc_data.emulated_time;
+  }
+  else
+  {
+    current_time_unix = Timestamp::Now().AsUnixTimestamp();
+  }
 
 #if 0
     // apply offset
@@ -393,6 +437,9 @@ Cartridge::RTCValue Cartridge::GetCurrentRTCTime() const
 
 void Cartridge::Reset()
 {
+  // the system cycle number starts again from zero
+  m_rtc_data.emulated_last_cycle = 0;
+
   switch (m_mbc)
   {
   case MBC_NONE:
@@ -442,7 +489,78 @@ void Cartridge::CPUWrite(uint16 address, uint8 value)
   }
 }
 
-bool Cartridge::LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError)
+int32 Cartridge::GetActiveROMBank() const
+{
+  switch (m_mbc)
+  {
+  case MBC_NONE:
+    return 1;
+  case MBC_MBC1:
+    return m_mbc_data.mbc1.active_rom_bank;
+  case MBC_MBC3:
+    return m_mbc_data.mbc3.rom_bank_number;
+  case MBC_MBC5:
+    return m_mbc_data.mbc5.active_rom_bank;
+  default:
+    return -1;
+  }
+}
+
+const byte* Cartridge::GetReadPagePointer(uint16 address) const
+{
+  uint16 page_address = address & 0xFF00;
+  if (page_address < 0x4000)
+    return m_rom_banks[0] + page_address;
+
+  if (page_address < 0x8000)
+  {
+    int32 rom_bank = GetActiveROMBank();
+    if (rom_bank < 0)
+      return nullptr;
+
+    return m_rom_banks[rom_bank] + (page_address & 0x3FFF);
+  }
+
+  if (page_address >= 0xA000 && page_address < 0xC000)
+  {
+    // only map the whole page when it is backed by ram, disabled ram/rtc registers go through CPURead
+    uint16 eram_offset;
+    switch (m_mbc)
+    {
+    case MBC_NONE:
+      if (m_external_ram == nullptr)
+        return nullptr;
+      eram_offset = page_address - 0xA000;
+      break;
+    case MBC_MBC1:
+      if (m_external_ram == nullptr || !m_mbc_data.mbc1.ram_enable)
+        return nullptr;
+      eram_offset = (uint16)m_mbc_data.mbc1.active_ram_bank * (uint16)8192 + (page_address - 0xA000);
+      break;
+    case MBC_MBC3:
+      if (!m_mbc_data.mbc3.ram_rtc_enable || m_mbc_data.mbc3.ram_bank_number > 0x07)
+        return nullptr;
+      eram_offset = (uint16)m_mbc_data.mbc3.ram_bank_number * (uint16)8192 + (page_address - 0xA000);
+      break;
+    case MBC_MBC5:
+      if (!m_mbc_data.mbc5.ram_enable)
+        return nullptr;
+      eram_offset = (uint16)m_mbc_data.mbc5.ram_bank_number * (uint16)8192 + (page_address - 0xA000);
+      break;
+    default:
+      return nullptr;
+    }
+
+    if (((uint32)eram_offset + 0x100) > m_external_ram_size)
+      return nullptr;
+
+    return m_external_ram + eram_offset;
+  }
+
+  return nullptr;
+}
+
+bool Cartridge::LoadState(ByteStream* pStream, BinaryReader& binaryReader, uint32 version, Error* pError)
 {
   uint32 crc = binaryReader.ReadUInt32();
   if (crc != m_crc)
@@ -459,7 +577,10 @@ bool Cartridge::LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error
   }
 
   if (external_ram_size > 0)
+  {
     binaryReader.ReadBytes(m_external_ram, m_external_ram_size);
+    ExternalRAMChanged();
+  }
 
   bool has_timer = binaryReader.ReadBool();
   if (has_timer)
@@ -470,6 +591,14 @@ bool Cartridge::LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error
     m_rtc_data.offset_minutes = binaryReader.ReadUInt8();
     m_rtc_data.offset_seconds = binaryReader.ReadUInt8();
     m_rtc_data.active = binaryReader.ReadBool();
+    if (version >= 7)
+    {
+      m_rtc_data.emulated_time = binaryReader.ReadUInt64();
+      m_rtc_data.emulated_clocks = binaryReader.ReadUInt32();
+    }
+
+    // saved synchronized, the emulated time continues from the current cycle
+    m_rtc_data.emulated_last_cycle = m_system->GetCycleNumber();
   }
 
   // MBC specific stuff follows
@@ -531,6 +660,8 @@ void Cartridge::SaveState(ByteStream* pStream, BinaryWriter& binaryWriter)
     binaryWriter.WriteUInt8(m_rtc_data.offset_minutes);
     binaryWriter.WriteUInt8(m_rtc_data.offset_seconds);
     binaryWriter.WriteBool(m_rtc_data.active);
+    binaryWriter.WriteUInt64(m_rtc_data.emulated_time);
+    binaryWriter.WriteUInt32(m_rtc_data.emulated_clocks);
   }
 
   // MBC specific stuff follows
@@ -553,6 +684,32 @@ void Cartridge::SaveState(ByteStream* pStream, BinaryWriter& binaryWriter)
   binaryWriter.WriteUInt32(~(uint32)m_mbc);
 }
 
+void Cartridge::SaveSnapshot(SnapshotState* state, byte* external_ram) const
+{
+  state->mbc_data = m_mbc_data;
+  state->rtc_data = m_rtc_data;
+
+  // versions are never reused, so a matching version means the snapshot already holds these contents
+  if (state->external_ram_version != m_external_ram_version)
+  {
+    Y_memcpy(external_ram, m_external_ram, m_external_ram_size);
+    state->external_ram_version = m_external_ram_version;
+  }
+}
+
+void Cartridge::LoadSnapshot(const SnapshotState* state, const byte* external_ram)
+{
+  m_mbc_data = state->mbc_data;
+  m_rtc_data = state->rtc_data;
+
+  if (m_external_ram_version != state->external_ram_version)
+  {
+    Y_memcpy(m_external_ram, external_ram, m_external_ram_size);
+    m_external_ram_version = state->external_ram_version;
+    m_external_ram_modified = true;
+  }
+}
+
 bool Cartridge::MBC_NONE_Init()
 {
   if (m_num_rom_banks != 2)
@@ -621,6 +778,9 @@ void Cartridge::MBC_NONE_Write(uint16 address, uint8 value)
       uint16 eram_offset = address - 0xA000;
       if (eram_offset < m_external_ram_size)
       {
+        if (m_external_ram[eram_offset] != value)
+          ExternalRAMChanged();
+
         m_external_ram[eram_offset] = value;
         return;
       }
@@ -713,6 +873,8 @@ void Cartridge::MBC_MBC1_Write(uint16 address, uint8 value)
     if (!m_mbc_data.mbc1.ram_enable && m_external_ram_modified)
       SaveRAM();
 
+    m_system->UpdateMemoryMap(0xA000, 0xBFFF);
+
     return;
 
   case 0x2000:
@@ -742,7 +904,10 @@ void Cartridge::MBC_MBC1_Write(uint16 address, uint8 value)
       if (eram_offset < m_external_ram_size)
       {
         if (m_external_ram[eram_offset] != value)
+        {
           m_external_ram_modified = true;
+          ExternalRAMChanged();
+        }
 
         m_external_ram[eram_offset] = value;
       }
@@ -808,6 +973,10 @@ void Cartridge::MBC_MBC1_UpdateActiveBanks()
 
   TRACE("MBC1 ROM bank: %u", m_mbc_data.mbc1.active_rom_bank);
   TRACE("MBC1 RAM bank: %u", m_mbc_data.mbc1.active_ram_bank);
+
+  // remap the switchable rom bank and external ram
+  m_system->UpdateMemoryMap(0x4000, 0x7FFF);
+  m_system->UpdateMemoryMap(0xA000, 0xBFFF);
 }
 
 bool Cartridge::MBC_MBC3_Init()
@@ -889,6 +1058,8 @@ void Cartridge::MBC_MBC3_Write(uint16 address, uint8 value)
     if (!m_mbc_data.mbc3.ram_rtc_enable && m_external_ram_modified)
       SaveRAM();
 
+    m_system->UpdateMemoryMap(0xA000, 0xBFFF);
+
     return;
 
   case 0x2000:
@@ -935,7 +1106,10 @@ void Cartridge::MBC_MBC3_Write(uint16 address, uint8 value)
         if (eram_offset < m_external_ram_size)
         {
           if (m_external_ram[eram_offset] != value)
+          {
             m_external_ram_modified = true;
+            ExternalRAMChanged();
+          }
 
           m_external_ram[eram_offset] = value;
         }
@@ -1054,6 +1228,10 @@ void Cartridge::MBC_MBC3_UpdateActiveBanks()
 
   TRACE("MBC3 ROM bank: %u", m_mbc_data.mbc3.rom_bank_number);
   TRACE("MBC3 RAM bank: %u", m_mbc_data.mbc3.ram_bank_number);
+
+  // remap the switchable rom bank and external ram
+  m_system->UpdateMemoryMap(0x4000, 0x7FFF);
+  m_system->UpdateMemoryMap(0xA000, 0xBFFF);
 }
 
 bool Cartridge::MBC_MBC5_Init()
@@ -1127,6 +1305,8 @@ void Cartridge::MBC_MBC5_Write(uint16 address, uint8 value)
     if (!m_mbc_data.mbc5.ram_enable && m_external_ram_modified)
       SaveRAM();
 
+    m_system->UpdateMemoryMap(0xA000, 0xBFFF);
+
     return;
 
   case 0x2000:
@@ -1154,7 +1334,10 @@ void Cartridge::MBC_MBC5_Write(uint16 address, uint8 value)
       if (eram_offset < m_external_ram_size)
       {
         if (m_external_ram[eram_offset] != value)
+        {
           m_external_ram_modified = true;
+          ExternalRAMChanged();
+        }
 
         m_external_ram[eram_offset] = value;
       }
@@ -1202,4 +1385,8 @@ void Cartridge::MBC_MBC5_UpdateActiveBanks()
 
   TRACE("MBC5 ROM bank: %u", m_mbc_data.mbc5.rom_bank_number);
   TRACE("MBC5 RAM bank: %u", m_mbc_data.mbc5.ram_bank_number);
+
+  // remap the switchable rom bank and external ram
+  m_system->UpdateMemoryMap(0x4000, 0x7FFF);
+  m_system->UpdateMemoryMap(0xA000, 0xBFFF);
 }
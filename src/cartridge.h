@@ -47,6 +47,7 @@ public:
   ~Cartridge();
 
   const String& GetName() const { return m_name; }
+  const uint32 GetCRC() const { return m_crc; }
   const MBC GetMBC() const { return m_mbc; }
   const SYSTEM_MODE GetSystemMode() const { return m_system_mode; }
   const uint32 GetExternalRAMSize() const { return m_external_ram_size; }
@@ -66,11 +67,23 @@ public:
   uint8 CPURead(uint16 address);
   void CPUWrite(uint16 address, uint8 value);
 
+  // The rtc follows the host clock, unless emulated time is enabled. Emulated time starts at the host clock and then
+  // only advances with emulated clocks, which anything that has to replay exactly (e.g. movies) needs.
+  bool GetRTCEmulatedTime() const { return m_rtc_emulated_time; }
+  void SetRTCEmulatedTime(bool enabled);
+
+  // Returns the rom bank mapped at 4000-7FFF, or -1 if the MBC's banking cannot be mapped directly.
+  int32 GetActiveROMBank() const;
+
+  // Returns a pointer to the start of the 256-byte page containing address if reads from it have no side effects,
+  // otherwise nullptr. Used to build the system memory map.
+  const byte* GetReadPagePointer(uint16 address) const;
+
 private:
   bool ParseHeader(ByteStream* pStream, Error* pError);
 
   // state saving
-  bool LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError);
+  bool LoadState(ByteStream* pStream, BinaryReader& binaryReader, uint32 version, Error* pError);
   void SaveState(ByteStream* pStream, BinaryWriter& binaryWriter);
   void LoadRAM();
   void SaveRAM();
@@ -93,8 +106,13 @@ private:
   uint32 m_external_ram_size;
   bool m_external_ram_modified;
 
+  // identifies the external ram contents, a new version is taken from the counter whenever they change
+  void ExternalRAMChanged() { m_external_ram_version = ++m_external_ram_version_counter; }
+  uint32 m_external_ram_version;
+  uint32 m_external_ram_version_counter;
+
   // MBC data
-  union
+  union MBCData
   {
     struct
     {
@@ -134,10 +152,11 @@ private:
     uint32 hours;
     uint32 days;
   };
-  RTCValue GetCurrentRTCTime() const;
+  RTCValue GetCurrentRTCTime();
+  void SynchronizeRTC();
 
   // RTC data
-  struct
+  struct RTCData
   {
     Timestamp::UnixTimestampValue base_time;
     uint8 offset_seconds;
@@ -145,7 +164,23 @@ private:
     uint8 offset_hours;
     uint16 offset_days;
     bool active;
+
+    // emulated time, whole seconds plus the clocks towards the next one
+    Timestamp::UnixTimestampValue emulated_time;
+    uint32 emulated_clocks;
+    uint64 emulated_last_cycle;
   } m_rtc_data;
+  bool m_rtc_emulated_time;
+
+  // machine state for System::Snapshot, the external ram is copied only when its version differs
+  struct SnapshotState
+  {
+    MBCData mbc_data;
+    RTCData rtc_data;
+    uint32 external_ram_version;
+  };
+  void SaveSnapshot(SnapshotState* state, byte* external_ram) const;
+  void LoadSnapshot(const SnapshotState* state, const byte* external_ram);
 
   // MBC_NONE
   bool MBC_NONE_Init();
@@ -197,17 +197,40 @@ public:
   CPU(System* memory);
   ~CPU();
 
-  // register access
-  const Registers* GetRegisters() const { return &m_registers; }
-  Registers* GetRegisters() { return &m_registers; }
+  // register access, F is packed from the lazy flags into the copy returned and unpacked again when set
+  Registers GetRegisters() const
+  {
+    Registers registers = m_registers;
+    registers.F = PackFlags();
+    return registers;
+  }
+  void SetRegisters(const Registers& registers)
+  {
+    m_registers = registers;
+    UnpackFlags(registers.F);
+  }
   const uint32 GetCycles() const { return m_clock; }
+  const uint64 GetInstructionCounter() const { return m_instruction_counter; }
+  const uint64 GetIdleLoopSkippedCycles() const { return m_idle_loop_skipped_cycles; }
 
   // reset
   void Reset();
 
-  // step
+  // step, reference switch core
   void ExecuteInstruction();
 
+  // threaded core, runs until the system's execution target is reached
+  void ExecuteThreaded();
+
+  // cached interpreter, runs pre-decoded blocks until the system's execution target is reached
+  void ExecuteCached();
+
+  // recompiler, runs native code translated from cached blocks until the system's execution target is reached
+  void ExecuteRecompiled();
+
+  // drop all cached blocks
+  void FlushBlockCache();
+
   // disassemble an instruction
   static bool Disassemble(String* pDestination, System* memory, uint16 address);
   static void DisassembleFrom(System* system, uint16 address, uint16 count, ByteStream* pStream);
@@ -248,6 +271,33 @@ private:
   // halt cycles
   void Disable(bool disabled);
 
+  // interrupt register writes from the system
+  void SetIE(uint8 value)
+  {
+    m_registers.IE = value;
+    m_check_interrupts = true;
+  }
+  void SetIF(uint8 value)
+  {
+    m_registers.IF = value;
+    m_check_interrupts = true;
+  }
+
+  // lazy flag access, F is only materialized when the whole register is needed
+  bool GetFlagZ() const { return (m_flags.result == 0); }
+  bool GetFlagN() const { return (m_flags.subtract != 0); }
+  bool GetFlagH() const { return (((m_flags.half_lhs ^ m_flags.half_rhs ^ m_flags.result) & 0x10) != 0); }
+  bool GetFlagC() const { return (m_flags.carry != 0); }
+
+  // explicit H, must come after the result is stored
+  void SetFlagH(bool on)
+  {
+    m_flags.half_lhs = on ? 0x10 : 0x00;
+    m_flags.half_rhs = m_flags.result;
+  }
+  uint8 PackFlags() const;
+  void UnpackFlags(uint8 value);
+
   // state saving
   bool LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError);
   void SaveState(ByteStream* pStream, BinaryWriter& binaryWriter);
@@ -255,6 +305,22 @@ private:
   // registers
   Registers m_registers;
 
+  // flags from the last operation, evaluated when tested instead of being packed into F by every instruction
+  struct LazyFlags
+  {
+    // Z is set when the result is zero
+    uint8 result;
+
+    // H is the carry into bit 4, recovered from the operands and the result
+    uint8 half_lhs;
+    uint8 half_rhs;
+
+    // N and C are either 0 or 1
+    uint8 subtract;
+    uint8 carry;
+  };
+  LazyFlags m_flags;
+
   // memory
   System* m_system;
 
@@ -267,7 +333,84 @@ private:
   // halted during memory transfer, cannot break out of this
   bool m_disabled;
 
+  // set when IME/IE/IF or the halted/disabled state changes, the threaded core only checks interrupts when set
+  bool m_check_interrupts;
+
+  // machine state for System::Snapshot, copied as-is
+  struct SnapshotState
+  {
+    Registers registers;
+    LazyFlags flags;
+    uint32 clock;
+    bool halted;
+    bool disabled;
+  };
+  void SaveSnapshot(SnapshotState* state) const;
+  void LoadSnapshot(const SnapshotState* state);
+
+  // number of instructions fetched, not saved in states
+  uint64 m_instruction_counter;
+
+  // cycles fast-forwarded by skipping polling loops, not saved in states
+  uint64 m_idle_loop_skipped_cycles;
+
+  // cached interpreter blocks, decoded once from straight-line code within a single 256-byte page
+  struct CachedInstruction
+  {
+    uint8 opcode;
+    uint8 operands[2];
+    uint8 length;
+  };
+  struct CachedBlock
+  {
+    const void* recompiled_code;
+    uint32 num_instructions;
+    CachedInstruction instructions[1];
+  };
+  struct CachedPage
+  {
+    CachedBlock* blocks[256];
+  };
+
+  // pages are keyed by rom bank and address (64 per bank), or wram bank and address (16 per bank)
+  CachedPage** m_rom_cache_pages;
+  uint32 m_rom_cache_page_count;
+  CachedPage* m_wram_cache_pages[8 * 16];
+  uint8 m_wram_cache_page_invalidations[8 * 16];
+
+  // operands of the instruction being executed from a cached block, otherwise nullptr
+  const uint8* m_cached_operands;
+
+  // recompiler code buffer, blocks are allocated linearly and only released when the whole cache is flushed
+  byte* m_recompiler_code_buffer;
+  uint32 m_recompiler_code_buffer_used;
+  uint32 m_recompiler_speed_divider;
+  bool m_recompiler_unavailable;
+
+  // instruction handed from recompiled code back to the opcode handlers
+  uint8 m_recompiler_opcode;
+  uint8 m_recompiler_operands[2];
+
 private:
+  template<CPU_BACKEND backend>
+  void Execute();
+
+  // cached interpreter helpers, see cpu_cache.cpp
+  CachedBlock* LookupCachedBlock(uint16 address);
+  CachedBlock* CompileCachedBlock(const byte* page_pointer, uint16 address);
+  void FlushCachedPage(CachedPage** page);
+  void InvalidateCachedWRAMPage(uint32 index);
+
+  // recompiler helpers, see cpu_recompiler.cpp, the static functions are called from recompiled code
+  bool InitializeRecompiler();
+  void ShutdownRecompiler();
+  const void* RecompileBlock(const CachedBlock* block, uint16 address);
+  static void RecompilerInterpretInstruction(CPU* cpu, uint32 instruction);
+  static void RecompilerSynchronize(System* system);
+  static uint32 RecompilerReadMemory(System* system, uint32 address);
+  static void RecompilerWriteMemory(System* system, uint32 address, uint32 value);
+  static void RecompilerTriggerOAMBug(System* system);
+
   uint8 ReadOperandByte();
   uint16 ReadOperandWord();
   int8 ReadOperandSignedByte();
@@ -305,4 +448,7 @@ private:
   void INSTR_daa();
 
   void CheckOAMBug(uint16 current_value);
+
+  // fast-forwards a polling loop starting at PC until the next event, called when a branch closes a short loop
+  void SkipIdleLoop();
 };
@@ -0,0 +1,200 @@
+#include "YBaseLib/Log.h"
+#include "YBaseLib/Memory.h"
+#include "cartridge.h"
+#include "cpu.h"
+Log_SetChannel(CPU);
+
+// Blocks are decoded once from straight-line code and executed by CPU::ExecuteCached, which passes the decoded
+// operands to the regular opcode handlers. The handlers still spend a memory cycle on every opcode/operand fetch, so
+// the sequence of System::AddCPUCycles calls is identical to the interpreter, only the reads are skipped.
+
+// maximum number of instructions in a block
+static const uint32 MAX_CACHED_BLOCK_INSTRUCTIONS = 32;
+
+// working ram pages that are invalidated this many times are left to the interpreter (mixed code and data)
+static const uint8 MAX_WRAM_PAGE_INVALIDATIONS = 16;
+
+// instruction length in bytes, 0 for opcodes that are never cached (STOP, invalid opcodes)
+static const uint8 s_instruction_lengths[256] = {
+  1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1, // 00
+  0, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 10
+  2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 20
+  2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1, // 30
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 40
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 50
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 60
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 70
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 80
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 90
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // A0
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // B0
+  1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // C0
+  1, 1, 3, 0, 3, 1, 2, 1, 1, 1, 3, 0, 3, 0, 2, 1, // D0
+  2, 1, 1, 0, 0, 1, 2, 1, 2, 1, 3, 0, 0, 0, 2, 1, // E0
+  2, 1, 1, 1, 0, 1, 2, 1, 2, 1, 3, 1, 0, 0, 2, 1, // F0
+};
+
+// instructions that can change PC or halt the cpu end a block
+static const uint8 s_instruction_ends_block[256] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 00
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, // 10
+  1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, // 20
+  1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, // 30
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 40
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 50
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 60
+  0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 70
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 80
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 90
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // A0
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // B0
+  1, 0, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 1, 1, 0, 1, // C0
+  1, 0, 1, 0, 1, 0, 0, 1, 1, 1, 1, 0, 1, 0, 0, 1, // D0
+  0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0, 1, // E0
+  0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, // F0
+};
+
+CPU::CachedBlock* CPU::LookupCachedBlock(uint16 address)
+{
+  // unmapped pages (io, vram, dma-locked memory) are always interpreted
+  const byte* page_pointer = m_system->m_memory_read_pages[address >> 8];
+  if (page_pointer == nullptr)
+    return nullptr;
+
+  CachedPage** page;
+  if (address < 0x8000)
+  {
+    // rom, keyed by bank so bank switches don't need to flush anything
+    // the memory map has to point at the cartridge rather than the bios overlay
+    const Cartridge* cartridge = m_system->GetCartridge();
+    if (cartridge == nullptr)
+      return nullptr;
+
+    int32 bank = (address < 0x4000) ? 0 : cartridge->GetActiveROMBank();
+    if (bank < 0 || page_pointer != cartridge->GetROMBank(bank) + (address & 0x3F00))
+      return nullptr;
+
+    if (m_rom_cache_pages == nullptr)
+    {
+      m_rom_cache_page_count = cartridge->GetROMBankCount() * 64;
+      m_rom_cache_pages = new CachedPage*[m_rom_cache_page_count];
+      Y_memzero(m_rom_cache_pages, sizeof(CachedPage*) * m_rom_cache_page_count);
+    }
+
+    page = &m_rom_cache_pages[bank * 64 + ((address & 0x3FFF) >> 8)];
+  }
+  else if (address >= 0xC000 && address < 0xFE00)
+  {
+    // working ram and its shadow, keyed by bank
+    uint32 wram_bank = (address & 0x1000) ? m_system->m_high_wram_bank : 0;
+    uint32 page_index = wram_bank * 16 + ((address >> 8) & 0xF);
+    if (page_pointer != &m_system->m_memory_wram[wram_bank][address & 0xF00] ||
+        m_wram_cache_page_invalidations[page_index] >= MAX_WRAM_PAGE_INVALIDATIONS)
+    {
+      return nullptr;
+    }
+
+    // writes to this page now have to go through the slow path so they can invalidate it
+    if (!m_system->m_memory_wram_code_pages[page_index])
+    {
+      m_system->m_memory_wram_code_pages[page_index] = true;
+      m_system->UpdateMemoryMap(0xC000, 0xFDFF);
+    }
+
+    page = &m_wram_cache_pages[page_index];
+  }
+  else
+  {
+    // cartridge ram, oam, io and zero page
+    return nullptr;
+  }
+
+  if (*page == nullptr)
+  {
+    *page = new CachedPage;
+    Y_memzero(*page, sizeof(CachedPage));
+  }
+
+  CachedBlock*& block = (*page)->blocks[address & 0xFF];
+  if (block == nullptr)
+    block = CompileCachedBlock(page_pointer, address);
+
+  return block;
+}
+
+CPU::CachedBlock* CPU::CompileCachedBlock(const byte* page_pointer, uint16 address)
+{
+  CachedInstruction instructions[MAX_CACHED_BLOCK_INSTRUCTIONS];
+  uint32 num_instructions = 0;
+  uint32 offset = address & 0xFF;
+  while (num_instructions < MAX_CACHED_BLOCK_INSTRUCTIONS)
+  {
+    // blocks can't cross a page, the next page may be mapped differently
+    uint8 opcode = page_pointer[offset];
+    uint32 length = s_instruction_lengths[opcode];
+    if (length == 0 || (offset + length) > 256)
+      break;
+
+    CachedInstruction* instruction = &instructions[num_instructions++];
+    instruction->opcode = opcode;
+    instruction->operands[0] = (length > 1) ? page_pointer[offset + 1] : 0;
+    instruction->operands[1] = (length > 2) ? page_pointer[offset + 2] : 0;
+    instruction->length = uint8(length);
+    offset += length;
+
+    if (s_instruction_ends_block[opcode])
+      break;
+  }
+
+  if (num_instructions == 0)
+    return nullptr;
+
+  CachedBlock* block = (CachedBlock*)Y_malloc(sizeof(CachedBlock) + sizeof(CachedInstruction) * (num_instructions - 1));
+  block->recompiled_code = nullptr;
+  block->num_instructions = num_instructions;
+  Y_memcpy(block->instructions, instructions, sizeof(CachedInstruction) * num_instructions);
+  return block;
+}
+
+void CPU::FlushCachedPage(CachedPage** page)
+{
+  if (*page == nullptr)
+    return;
+
+  for (uint32 i = 0; i < countof((*page)->blocks); i++)
+  {
+    if ((*page)->blocks[i] != nullptr)
+      Y_free((*page)->blocks[i]);
+  }
+
+  delete *page;
+  *page = nullptr;
+}
+
+void CPU::InvalidateCachedWRAMPage(uint32 index)
+{
+  TRACE("Invalidating cached code in wram page %u", index);
+  FlushCachedPage(&m_wram_cache_pages[index]);
+  if (m_wram_cache_page_invalidations[index] < MAX_WRAM_PAGE_INVALIDATIONS)
+    m_wram_cache_page_invalidations[index]++;
+
+  // restore direct writes, this also stops any block currently executing from this page
+  m_system->m_memory_wram_code_pages[index] = false;
+  m_system->UpdateMemoryMap(0xC000, 0xFDFF);
+}
+
+void CPU::FlushBlockCache()
+{
+  for (uint32 i = 0; i < m_rom_cache_page_count; i++)
+    FlushCachedPage(&m_rom_cache_pages[i]);
+
+  for (uint32 i = 0; i < countof(m_wram_cache_pages); i++)
+  {
+    FlushCachedPage(&m_wram_cache_pages[i]);
+    m_wram_cache_page_invalidations[i] = 0;
+    m_system->m_memory_wram_code_pages[i] = false;
+  }
+
+  // no block references recompiled code any more
+  m_recompiler_code_buffer_used = 0;
+}
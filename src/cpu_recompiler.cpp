@@ -0,0 +1,1026 @@
+#include "YBaseLib/Assert.h"
+#include "YBaseLib/Log.h"
+#include "YBaseLib/Memory.h"
+#include "cpu.h"
+Log_SetChannel(CPU);
+
+// The recompiler translates the blocks found by the cached interpreter into x86-64 code. Register moves, 8-bit
+// arithmetic and loads/stores through the memory map are emitted inline, everything else calls back into the opcode
+// handlers for that single instruction. Guest registers stay in the CPU object, addressed from a pinned host register,
+// since almost every instruction has to call out to System::AddCPUCycles or the slow memory paths anyway.
+//
+// Timing is identical to the interpreter: every memory cycle updates the same counters, and only falls through to
+// System::AddCPUCycles when the event downcount expires. Interrupts, the execution target and memory map changes
+// (bank switches, writes to cached wram code) are checked after every instruction, exiting the block if needed.
+
+#if defined(Y_CPU_X64)
+
+#if defined(Y_PLATFORM_WINDOWS)
+#include "YBaseLib/Windows/WindowsHeaders.h"
+#else
+#include <sys/mman.h>
+#endif
+
+// size of the code buffer, the cache is flushed when it fills up
+static const uint32 RECOMPILER_CODE_BUFFER_SIZE = 16 * 1024 * 1024;
+
+// space reserved for each block, enough for the largest possible translation of a block
+static const uint32 RECOMPILER_MAX_BLOCK_SIZE = 64 * 1024;
+
+// the conversion table from host flags is stored at the start of the code buffer
+static const uint32 RECOMPILER_FLAG_TABLE_SIZE = 256;
+
+namespace {
+
+enum HostReg
+{
+  RAX,
+  RCX,
+  RDX,
+  RBX,
+  RSP,
+  RBP,
+  RSI,
+  RDI,
+  R8,
+  R9,
+  R10,
+  R11,
+  R12,
+  R13,
+  R14,
+  R15,
+  NO_INDEX
+};
+
+enum HostALUOp
+{
+  ALU_ADD,
+  ALU_OR,
+  ALU_ADC,
+  ALU_SBB,
+  ALU_AND,
+  ALU_SUB,
+  ALU_XOR,
+  ALU_CMP
+};
+
+enum HostCondition
+{
+  CC_B = 0x2,
+  CC_AE = 0x3,
+  CC_E = 0x4,
+  CC_NE = 0x5,
+  CC_G = 0xF
+};
+
+// calling convention
+#if defined(Y_PLATFORM_WINDOWS)
+static const HostReg ARG0 = RCX;
+static const HostReg ARG1 = RDX;
+static const HostReg ARG2 = R8;
+static const uint8 STACK_ADJUSTMENT = 32 + 8;
+#else
+static const HostReg ARG0 = RDI;
+static const HostReg ARG1 = RSI;
+static const HostReg ARG2 = RDX;
+static const uint8 STACK_ADJUSTMENT = 8;
+#endif
+
+// registers pinned for the duration of a block
+static const HostReg REG_CPU = RBX;
+static const HostReg REG_SYSTEM = RBP;
+static const HostReg REG_SERIAL = R12;
+static const HostReg REG_FLAG_TABLE = R13;
+
+// memory operand, [base + index * (1 << scale) + displacement]
+struct HostMem
+{
+  HostReg base;
+  HostReg index;
+  uint8 scale;
+  int32 displacement;
+
+  HostMem(HostReg base_, int32 displacement_) : base(base_), index(NO_INDEX), scale(0), displacement(displacement_) {}
+  HostMem(HostReg base_, HostReg index_, uint8 scale_, int32 displacement_)
+    : base(base_), index(index_), scale(scale_), displacement(displacement_)
+  {
+  }
+};
+
+class CodeEmitter
+{
+public:
+  CodeEmitter(byte* start, uint32 size) : m_start(start), m_current(start), m_end(start + size) {}
+
+  byte* GetCurrentPointer() const { return m_current; }
+  uint32 GetSize() const { return uint32(m_current - m_start); }
+
+  void EmitByte(uint8 value)
+  {
+    DebugAssert(m_current < m_end);
+    *(m_current++) = value;
+  }
+  void EmitWord(uint16 value)
+  {
+    EmitByte(uint8(value));
+    EmitByte(uint8(value >> 8));
+  }
+  void EmitDWord(uint32 value)
+  {
+    EmitWord(uint16(value));
+    EmitWord(uint16(value >> 16));
+  }
+  void EmitQWord(uint64 value)
+  {
+    EmitDWord(uint32(value));
+    EmitDWord(uint32(value >> 32));
+  }
+
+  // prefixes and operand encoding
+  void EmitREX(bool w, uint32 reg, uint32 index, uint32 base)
+  {
+    uint8 rex = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((index != NO_INDEX && (index & 8)) ? 0x02 : 0) |
+                ((base & 8) ? 0x01 : 0);
+    if (rex != 0x40)
+      EmitByte(rex);
+  }
+  void EmitMemOperand(uint32 reg, const HostMem& mem)
+  {
+    // rbp/r13 can't be encoded without a displacement
+    uint8 mod = 2;
+    if (mem.displacement == 0 && (mem.base & 7) != RBP)
+      mod = 0;
+    else if (int8(mem.displacement) == mem.displacement)
+      mod = 1;
+    if (mem.index != NO_INDEX || (mem.base & 7) == RSP)
+    {
+      uint8 index = (mem.index != NO_INDEX) ? uint8(mem.index & 7) : uint8(RSP);
+      EmitByte(uint8((mod << 6) | ((reg & 7) << 3) | RSP));
+      EmitByte(uint8((mem.scale << 6) | (index << 3) | (mem.base & 7)));
+    }
+    else
+    {
+      EmitByte(uint8((mod << 6) | ((reg & 7) << 3) | (mem.base & 7)));
+    }
+
+    if (mod == 1)
+      EmitByte(uint8(mem.displacement));
+    else if (mod == 2)
+      EmitDWord(uint32(mem.displacement));
+  }
+  void EmitMemOp(bool w, uint8 opcode, uint32 reg, const HostMem& mem)
+  {
+    EmitREX(w, reg, mem.index, mem.base);
+    EmitByte(opcode);
+    EmitMemOperand(reg, mem);
+  }
+  void EmitMemOp2(bool w, uint8 opcode, uint32 reg, const HostMem& mem)
+  {
+    EmitREX(w, reg, mem.index, mem.base);
+    EmitByte(0x0F);
+    EmitByte(opcode);
+    EmitMemOperand(reg, mem);
+  }
+  void EmitRegOp(bool w, uint8 opcode, uint32 reg, uint32 rm)
+  {
+    EmitREX(w, reg, NO_INDEX, rm);
+    EmitByte(opcode);
+    EmitByte(uint8(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+  }
+
+  // moves
+  void MOV_R8_M(HostReg dst, const HostMem& src) { EmitMemOp(false, 0x8A, dst, src); }
+  void MOV_M_R8(const HostMem& dst, HostReg src) { EmitMemOp(false, 0x88, src, dst); }
+  void MOV_M_IMM8(const HostMem& dst, uint8 value)
+  {
+    EmitMemOp(false, 0xC6, 0, dst);
+    EmitByte(value);
+  }
+  void MOV_M_IMM16(const HostMem& dst, uint16 value)
+  {
+    EmitByte(0x66);
+    EmitMemOp(false, 0xC7, 0, dst);
+    EmitWord(value);
+  }
+  void MOV_R32_M(HostReg dst, const HostMem& src) { EmitMemOp(false, 0x8B, dst, src); }
+  void MOV_R64_M(HostReg dst, const HostMem& src) { EmitMemOp(true, 0x8B, dst, src); }
+  void MOV_R32_IMM32(HostReg dst, uint32 value)
+  {
+    EmitREX(false, 0, NO_INDEX, dst);
+    EmitByte(uint8(0xB8 + (dst & 7)));
+    EmitDWord(value);
+  }
+  void MOV_R64_IMM64(HostReg dst, uint64 value)
+  {
+    EmitREX(true, 0, NO_INDEX, dst);
+    EmitByte(uint8(0xB8 + (dst & 7)));
+    EmitQWord(value);
+  }
+  void MOV_R64_R64(HostReg dst, HostReg src) { EmitRegOp(true, 0x89, src, dst); }
+  void MOVZX_R32_M8(HostReg dst, const HostMem& src) { EmitMemOp2(false, 0xB6, dst, src); }
+  void MOVZX_R32_M16(HostReg dst, const HostMem& src) { EmitMemOp2(false, 0xB7, dst, src); }
+  void MOVZX_R32_R8(HostReg dst, HostReg src)
+  {
+    EmitREX(false, dst, NO_INDEX, src);
+    EmitByte(0x0F);
+    EmitByte(0xB6);
+    EmitByte(uint8(0xC0 | ((dst & 7) << 3) | (src & 7)));
+  }
+  void MOVZX_ECX_AH()
+  {
+    // no rex prefix allowed with ah
+    EmitByte(0x0F);
+    EmitByte(0xB6);
+    EmitByte(0xCC);
+  }
+
+  // arithmetic
+  void ALU_R8_M(HostALUOp op, HostReg dst, const HostMem& src) { EmitMemOp(false, uint8((op << 3) | 2), dst, src); }
+  void ALU_R8_R8(HostALUOp op, HostReg dst, HostReg src) { EmitRegOp(false, uint8((op << 3) | 2), dst, src); }
+  void ALU_AL_IMM8(HostALUOp op, uint8 value)
+  {
+    EmitByte(uint8((op << 3) | 4));
+    EmitByte(value);
+  }
+  void ALU_R8_IMM8(HostALUOp op, HostReg dst, uint8 value)
+  {
+    EmitREX(false, 0, NO_INDEX, dst);
+    EmitByte(0x80);
+    EmitByte(uint8(0xC0 | (op << 3) | (dst & 7)));
+    EmitByte(value);
+  }
+  void ALU_R32_IMM32(HostALUOp op, HostReg dst, uint32 value)
+  {
+    EmitREX(false, 0, NO_INDEX, dst);
+    EmitByte(0x81);
+    EmitByte(uint8(0xC0 | (op << 3) | (dst & 7)));
+    EmitDWord(value);
+  }
+  void ALU_M8_IMM8(HostALUOp op, const HostMem& dst, uint8 value)
+  {
+    EmitMemOp(false, 0x80, op, dst);
+    EmitByte(value);
+  }
+  void ALU_M32_IMM8(HostALUOp op, const HostMem& dst, int8 value)
+  {
+    EmitMemOp(false, 0x83, op, dst);
+    EmitByte(uint8(value));
+  }
+  void ALU_M64_IMM8(HostALUOp op, const HostMem& dst, int8 value)
+  {
+    EmitMemOp(true, 0x83, op, dst);
+    EmitByte(uint8(value));
+  }
+  void ALU_M32_R32(HostALUOp op, const HostMem& dst, HostReg src) { EmitMemOp(false, uint8((op << 3) | 1), src, dst); }
+  void ALU_R64_M(HostALUOp op, HostReg dst, const HostMem& src) { EmitMemOp(true, uint8((op << 3) | 3), dst, src); }
+  void INC_M8(const HostMem& dst) { EmitMemOp(false, 0xFE, 0, dst); }
+  void DEC_M8(const HostMem& dst) { EmitMemOp(false, 0xFE, 1, dst); }
+  void INC_M16(const HostMem& dst)
+  {
+    EmitByte(0x66);
+    EmitMemOp(false, 0xFF, 0, dst);
+  }
+  void DEC_M16(const HostMem& dst)
+  {
+    EmitByte(0x66);
+    EmitMemOp(false, 0xFF, 1, dst);
+  }
+  void NOT_M8(const HostMem& dst) { EmitMemOp(false, 0xF6, 2, dst); }
+  void TEST_R64_R64(HostReg a, HostReg b) { EmitRegOp(true, 0x85, b, a); }
+  void BT_R32_IMM8(HostReg reg, uint8 bit)
+  {
+    EmitREX(false, 0, NO_INDEX, reg);
+    EmitByte(0x0F);
+    EmitByte(0xBA);
+    EmitByte(uint8(0xC0 | (4 << 3) | (reg & 7)));
+    EmitByte(bit);
+  }
+  void LAHF() { EmitByte(0x9F); }
+
+  // control flow
+  void PUSH(HostReg reg)
+  {
+    EmitREX(false, 0, NO_INDEX, reg);
+    EmitByte(uint8(0x50 + (reg & 7)));
+  }
+  void POP(HostReg reg)
+  {
+    EmitREX(false, 0, NO_INDEX, reg);
+    EmitByte(uint8(0x58 + (reg & 7)));
+  }
+  void SUB_RSP_IMM8(uint8 value)
+  {
+    EmitByte(0x48);
+    EmitByte(0x83);
+    EmitByte(0xEC);
+    EmitByte(value);
+  }
+  void ADD_RSP_IMM8(uint8 value)
+  {
+    EmitByte(0x48);
+    EmitByte(0x83);
+    EmitByte(0xC4);
+    EmitByte(value);
+  }
+  void CALL(const void* function)
+  {
+    MOV_R64_IMM64(RAX, reinterpret_cast<uint64>(function));
+    EmitByte(0xFF);
+    EmitByte(0xD0);
+  }
+  void RET() { EmitByte(0xC3); }
+
+  // short forward branch, returns the location to patch with SetBranchTarget
+  byte* JCC_SHORT(HostCondition cc)
+  {
+    EmitByte(uint8(0x70 | cc));
+    EmitByte(0);
+    return m_current;
+  }
+  byte* JMP_SHORT()
+  {
+    EmitByte(0xEB);
+    EmitByte(0);
+    return m_current;
+  }
+  void SetShortBranchTarget(byte* branch)
+  {
+    int32 displacement = int32(m_current - branch);
+    DebugAssert(displacement >= 0 && displacement < 128);
+    branch[-1] = uint8(displacement);
+  }
+
+  // long forward branch
+  byte* JCC_LONG(HostCondition cc)
+  {
+    EmitByte(0x0F);
+    EmitByte(uint8(0x80 | cc));
+    EmitDWord(0);
+    return m_current;
+  }
+  void SetLongBranchTarget(byte* branch)
+  {
+    int32 displacement = int32(m_current - branch);
+    Y_memcpy(branch - 4, &displacement, 4);
+  }
+
+private:
+  byte* m_start;
+  byte* m_current;
+  byte* m_end;
+};
+
+// ZF/AF/CF of lahf, in the positions of the Z/H/C flags
+static void BuildFlagTable(byte* table)
+{
+  for (uint32 i = 0; i < RECOMPILER_FLAG_TABLE_SIZE; i++)
+  {
+    table[i] = ((i & 0x40) ? CPU::FLAG_Z : 0) | ((i & 0x10) ? CPU::FLAG_H : 0) | ((i & 0x01) ? CPU::FLAG_C : 0);
+  }
+}
+
+} // namespace
+
+bool CPU::InitializeRecompiler()
+{
+#if defined(Y_PLATFORM_WINDOWS)
+  m_recompiler_code_buffer =
+    (byte*)VirtualAlloc(nullptr, RECOMPILER_CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+  void* buffer = mmap(nullptr, RECOMPILER_CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  m_recompiler_code_buffer = (buffer != MAP_FAILED) ? (byte*)buffer : nullptr;
+#endif
+  if (m_recompiler_code_buffer == nullptr)
+  {
+    Log_ErrorPrintf("Failed to allocate recompiler code buffer, falling back to cached interpreter.");
+    return false;
+  }
+
+  BuildFlagTable(m_recompiler_code_buffer);
+  m_recompiler_code_buffer_used = 0;
+  return true;
+}
+
+void CPU::ShutdownRecompiler()
+{
+  if (m_recompiler_code_buffer == nullptr)
+    return;
+
+#if defined(Y_PLATFORM_WINDOWS)
+  VirtualFree(m_recompiler_code_buffer, 0, MEM_RELEASE);
+#else
+  munmap(m_recompiler_code_buffer, RECOMPILER_CODE_BUFFER_SIZE);
+#endif
+  m_recompiler_code_buffer = nullptr;
+}
+
+void CPU::ExecuteRecompiled()
+{
+  if (m_recompiler_code_buffer == nullptr && (m_recompiler_unavailable || !InitializeRecompiler()))
+  {
+    m_recompiler_unavailable = true;
+    ExecuteCached();
+    return;
+  }
+
+  // recompiled code operates on the packed flags rather than the lazy representation. they stay packed from one
+  // block to the next, and are only unpacked when the interpreter or the idle loop check needs them.
+  bool flags_packed = false;
+  while (m_system->m_clocks_since_reset < m_system->m_execute_target_clocks)
+  {
+    // interrupts and halting are left to the interpreter, which clears the flag when nothing is pending
+    if (m_check_interrupts)
+    {
+      if (flags_packed)
+      {
+        UnpackFlags(m_registers.F);
+        flags_packed = false;
+      }
+      ExecuteInstruction();
+      continue;
+    }
+
+    // cycle counts are baked into the code, so a speed switch invalidates it, as does running out of space
+    if (m_recompiler_speed_divider != m_system->GetDoubleSpeedDivider() ||
+        (RECOMPILER_CODE_BUFFER_SIZE - RECOMPILER_FLAG_TABLE_SIZE - m_recompiler_code_buffer_used) <
+          RECOMPILER_MAX_BLOCK_SIZE)
+    {
+      Log_DevPrintf("Flushing recompiler cache (%u bytes used)", m_recompiler_code_buffer_used);
+      FlushBlockCache();
+      m_system->UpdateMemoryMap(0xC000, 0xFDFF);
+      m_recompiler_speed_divider = m_system->GetDoubleSpeedDivider();
+    }
+
+    uint16 block_address = m_registers.PC;
+    CachedBlock* block = LookupCachedBlock(block_address);
+    if (block == nullptr)
+    {
+      if (flags_packed)
+      {
+        UnpackFlags(m_registers.F);
+        flags_packed = false;
+      }
+      ExecuteInstruction();
+      continue;
+    }
+
+    if (block->recompiled_code == nullptr)
+      block->recompiled_code = RecompileBlock(block, block_address);
+
+    if (!flags_packed)
+    {
+      m_registers.F = PackFlags();
+      flags_packed = true;
+    }
+    reinterpret_cast<void (*)(CPU*)>(const_cast<void*>(block->recompiled_code))(this);
+
+    // branches are compiled natively, so polling loops are picked up when a block loops back to itself. the loops
+    // recognized are at most three instructions, so longer ones stay on the packed flags.
+    if (m_registers.PC == block_address && block->num_instructions <= 3 && m_system->m_idle_loop_skipping)
+    {
+      UnpackFlags(m_registers.F);
+      flags_packed = false;
+      SkipIdleLoop();
+    }
+  }
+
+  if (flags_packed)
+    UnpackFlags(m_registers.F);
+}
+
+void CPU::RecompilerSynchronize(System* system)
+{
+  // the counters were already updated by the recompiled code
+  system->AddCPUCycles(0);
+}
+
+uint32 CPU::RecompilerReadMemory(System* system, uint32 address)
+{
+  return system->CPUReadSlow(uint16(address));
+}
+
+void CPU::RecompilerWriteMemory(System* system, uint32 address, uint32 value)
+{
+  system->CPUWriteSlow(uint16(address), uint8(value));
+}
+
+void CPU::RecompilerTriggerOAMBug(System* system)
+{
+  system->TriggerOAMBug();
+}
+
+namespace {
+
+// locations of the cpu (instruction_counter, check_interrupts) and system fields accessed by recompiled code, relative
+// to the pinned cpu/system registers, and the helpers it calls
+struct BlockEnvironment
+{
+  int32 instruction_counter;
+  int32 check_interrupts;
+  int32 cycle_number;
+  int32 clocks_since_reset;
+  int32 cycles_since_speed_update;
+  int32 next_event_cycle;
+  int32 execute_target_clocks;
+  int32 memory_map_serial;
+  int32 read_pages;
+  int32 write_pages;
+
+  const void* interpret_instruction;
+  const void* synchronize;
+  const void* read_memory;
+  const void* write_memory;
+  const void* trigger_oam_bug;
+};
+
+// translates one block
+class BlockCompiler
+{
+public:
+  BlockCompiler(const CPU* cpu, const System* system, const BlockEnvironment& env, uint32 speed_divider, byte* code,
+                uint32 code_size)
+    : m_emitter(code, code_size), m_cpu(cpu), m_system(system), m_env(env), m_speed_divider(speed_divider),
+      m_num_exit_branches(0)
+  {
+  }
+
+  CodeEmitter& GetEmitter() { return m_emitter; }
+
+  // guest register location
+  HostMem Reg(const void* reg) const { return HostMem(REG_CPU, int32((const uint8*)reg - (const uint8*)m_cpu)); }
+
+  void EmitPrologue(const byte* flag_table)
+  {
+    m_emitter.PUSH(RBX);
+    m_emitter.PUSH(RBP);
+    m_emitter.PUSH(R12);
+    m_emitter.PUSH(R13);
+    m_emitter.SUB_RSP_IMM8(STACK_ADJUSTMENT);
+    m_emitter.MOV_R64_R64(REG_CPU, ARG0);
+    m_emitter.MOV_R64_IMM64(REG_SYSTEM, reinterpret_cast<uint64>(m_system));
+    m_emitter.MOV_R64_IMM64(REG_FLAG_TABLE, reinterpret_cast<uint64>(flag_table));
+    m_emitter.MOV_R32_M(REG_SERIAL, HostMem(REG_SYSTEM, m_env.memory_map_serial));
+  }
+
+  void EmitEpilogue()
+  {
+    for (uint32 i = 0; i < m_num_exit_branches; i++)
+      m_emitter.SetLongBranchTarget(m_exit_branches[i]);
+
+    m_emitter.ADD_RSP_IMM8(STACK_ADJUSTMENT);
+    m_emitter.POP(R13);
+    m_emitter.POP(R12);
+    m_emitter.POP(RBP);
+    m_emitter.POP(RBX);
+    m_emitter.RET();
+  }
+
+  // System::AddCPUCycles for each memory cycle, only calling it when the downcount expires
+  void EmitDelayCycles(uint32 cycles)
+  {
+    for (uint32 i = 0; i < cycles; i += 4)
+    {
+      m_emitter.ALU_M64_IMM8(ALU_ADD, HostMem(REG_SYSTEM, m_env.cycle_number), 4);
+      m_emitter.ALU_M64_IMM8(ALU_ADD, HostMem(REG_SYSTEM, m_env.clocks_since_reset), int8(4 >> m_speed_divider));
+      m_emitter.ALU_M64_IMM8(ALU_ADD, HostMem(REG_SYSTEM, m_env.cycles_since_speed_update),
+                             int8(4 >> m_speed_divider));
+      m_emitter.ALU_M32_IMM8(ALU_SUB, HostMem(REG_SYSTEM, m_env.next_event_cycle), 4);
+      byte* skip = m_emitter.JCC_SHORT(CC_G);
+      m_emitter.MOV_R64_R64(ARG0, REG_SYSTEM);
+      m_emitter.CALL(m_env.synchronize);
+      m_emitter.SetShortBranchTarget(skip);
+    }
+  }
+
+  // start of an instruction, the opcode fetch
+  void EmitInstructionStart(uint16 next_pc, const void* pc)
+  {
+    m_emitter.ALU_M64_IMM8(ALU_ADD, HostMem(REG_CPU, m_env.instruction_counter), 1);
+    m_emitter.MOV_M_IMM16(Reg(pc), next_pc);
+    EmitDelayCycles(4);
+  }
+
+  // leaves the block when the threaded core would stop, or the code under it may have changed
+  void EmitExitChecks()
+  {
+    DebugAssert(m_num_exit_branches + 3 <= countof(m_exit_branches));
+    m_emitter.ALU_M8_IMM8(ALU_CMP, HostMem(REG_CPU, m_env.check_interrupts), 0);
+    m_exit_branches[m_num_exit_branches++] = m_emitter.JCC_LONG(CC_NE);
+    m_emitter.MOV_R64_M(RAX, HostMem(REG_SYSTEM, m_env.clocks_since_reset));
+    m_emitter.ALU_R64_M(ALU_CMP, RAX, HostMem(REG_SYSTEM, m_env.execute_target_clocks));
+    m_exit_branches[m_num_exit_branches++] = m_emitter.JCC_LONG(CC_AE);
+    m_emitter.ALU_M32_R32(ALU_CMP, HostMem(REG_SYSTEM, m_env.memory_map_serial), REG_SERIAL);
+    m_exit_branches[m_num_exit_branches++] = m_emitter.JCC_LONG(CC_NE);
+  }
+
+  // CPU::CheckOAMBug, value is a 16-bit guest register
+  void EmitCheckOAMBug(const void* reg)
+  {
+    m_emitter.MOVZX_R32_M16(RAX, Reg(reg));
+    m_emitter.ALU_R32_IMM32(ALU_AND, RAX, 0xFF00);
+    m_emitter.ALU_R32_IMM32(ALU_CMP, RAX, 0xFE00);
+    byte* skip = m_emitter.JCC_SHORT(CC_NE);
+    m_emitter.MOV_R64_R64(ARG0, REG_SYSTEM);
+    m_emitter.CALL(m_env.trigger_oam_bug);
+    m_emitter.SetShortBranchTarget(skip);
+  }
+
+  // loads the address from a 16-bit guest register, or a constant if reg is null, into eax
+  void EmitLoadAddress(HostReg dst, const void* reg, uint16 address)
+  {
+    if (reg != nullptr)
+      m_emitter.MOVZX_R32_M16(dst, Reg(reg));
+    else
+      m_emitter.MOV_R32_IMM32(dst, address);
+  }
+
+  // CPU::MemReadByte, result in al (zero-extended to eax)
+  void EmitMemoryRead(const void* address_reg, uint16 address)
+  {
+    EmitDelayCycles(4);
+
+    // ecx = page, eax = offset in page
+    EmitLoadAddress(RAX, address_reg, address);
+    m_emitter.MOVZX_ECX_AH();
+    m_emitter.MOVZX_R32_R8(RAX, RAX);
+    m_emitter.MOV_R64_M(RDX, HostMem(REG_SYSTEM, RCX, 3, m_env.read_pages));
+    m_emitter.TEST_R64_R64(RDX, RDX);
+    byte* slow_path = m_emitter.JCC_SHORT(CC_E);
+    m_emitter.MOVZX_R32_M8(RAX, HostMem(RDX, RAX, 0, 0));
+    byte* done = m_emitter.JMP_SHORT();
+
+    m_emitter.SetShortBranchTarget(slow_path);
+    m_emitter.MOV_R64_R64(ARG0, REG_SYSTEM);
+    EmitLoadAddress(ARG1, address_reg, address);
+    m_emitter.CALL(m_env.read_memory);
+    m_emitter.SetShortBranchTarget(done);
+  }
+
+  // CPU::MemWriteByte, value is a guest register, or a constant if value_reg is null
+  void EmitMemoryWrite(const void* address_reg, uint16 address, const void* value_reg, uint8 value)
+  {
+    EmitDelayCycles(4);
+
+    EmitLoadAddress(RAX, address_reg, address);
+    m_emitter.MOVZX_ECX_AH();
+    m_emitter.MOVZX_R32_R8(RAX, RAX);
+    m_emitter.MOV_R64_M(RDX, HostMem(REG_SYSTEM, RCX, 3, m_env.write_pages));
+    m_emitter.TEST_R64_R64(RDX, RDX);
+    byte* slow_path = m_emitter.JCC_SHORT(CC_E);
+    if (value_reg != nullptr)
+      m_emitter.MOV_R8_M(RCX, Reg(value_reg));
+    else
+      m_emitter.MOV_R32_IMM32(RCX, value);
+    m_emitter.MOV_M_R8(HostMem(RDX, RAX, 0, 0), RCX);
+    byte* done = m_emitter.JMP_SHORT();
+
+    m_emitter.SetShortBranchTarget(slow_path);
+    m_emitter.MOV_R64_R64(ARG0, REG_SYSTEM);
+    EmitLoadAddress(ARG1, address_reg, address);
+    if (value_reg != nullptr)
+      m_emitter.MOVZX_R32_M8(ARG2, Reg(value_reg));
+    else
+      m_emitter.MOV_R32_IMM32(ARG2, value);
+    m_emitter.CALL(m_env.write_memory);
+    m_emitter.SetShortBranchTarget(done);
+  }
+
+  // 8-bit arithmetic on A, the operand is a guest register, cl if operand_reg is null and use_cl is set, otherwise
+  // a constant. index is the alu operation from bits 3-5 of the opcode.
+  void EmitALU(uint32 index, const void* a, const void* f, const void* operand_reg, bool use_cl, uint8 value)
+  {
+    static const HostALUOp ops[8] = {ALU_ADD, ALU_ADC, ALU_SUB, ALU_SBB, ALU_AND, ALU_XOR, ALU_OR, ALU_CMP};
+    HostALUOp op = ops[index];
+
+    // carry in
+    if (op == ALU_ADC || op == ALU_SBB)
+      m_emitter.MOVZX_R32_M8(RDX, Reg(f));
+    m_emitter.MOV_R8_M(RAX, Reg(a));
+    if (op == ALU_ADC || op == ALU_SBB)
+      m_emitter.BT_R32_IMM8(RDX, 4);
+
+    if (operand_reg != nullptr)
+      m_emitter.ALU_R8_M(op, RAX, Reg(operand_reg));
+    else if (use_cl)
+      m_emitter.ALU_R8_R8(op, RAX, RCX);
+    else
+      m_emitter.ALU_AL_IMM8(op, value);
+
+    // z/h/c from the host flags, h is undefined after logical operations
+    m_emitter.LAHF();
+    m_emitter.MOVZX_ECX_AH();
+    m_emitter.MOVZX_R32_M8(RDX, HostMem(REG_FLAG_TABLE, RCX, 0, 0));
+    if (op == ALU_SUB || op == ALU_SBB || op == ALU_CMP)
+      m_emitter.ALU_R8_IMM8(ALU_OR, RDX, CPU::FLAG_N);
+    else if (op == ALU_AND || op == ALU_OR || op == ALU_XOR)
+      m_emitter.ALU_R8_IMM8(ALU_AND, RDX, CPU::FLAG_Z);
+    if (op == ALU_AND)
+      m_emitter.ALU_R8_IMM8(ALU_OR, RDX, CPU::FLAG_H);
+
+    m_emitter.MOV_M_R8(Reg(f), RDX);
+    if (op != ALU_CMP)
+      m_emitter.MOV_M_R8(Reg(a), RAX);
+  }
+
+  // 8-bit inc/dec of a guest register, carry is preserved
+  void EmitIncDec(const void* reg, const void* f, bool decrement)
+  {
+    if (decrement)
+      m_emitter.DEC_M8(Reg(reg));
+    else
+      m_emitter.INC_M8(Reg(reg));
+
+    m_emitter.LAHF();
+    m_emitter.MOVZX_ECX_AH();
+    m_emitter.MOVZX_R32_M8(RDX, HostMem(REG_FLAG_TABLE, RCX, 0, 0));
+    m_emitter.ALU_R8_IMM8(ALU_AND, RDX, CPU::FLAG_Z | CPU::FLAG_H);
+    if (decrement)
+      m_emitter.ALU_R8_IMM8(ALU_OR, RDX, CPU::FLAG_N);
+    m_emitter.MOVZX_R32_M8(RAX, Reg(f));
+    m_emitter.ALU_R8_IMM8(ALU_AND, RAX, CPU::FLAG_C);
+    m_emitter.ALU_R8_R8(ALU_OR, RAX, RDX);
+    m_emitter.MOV_M_R8(Reg(f), RAX);
+  }
+
+  // any other instruction goes through the opcode handlers
+  void EmitInterpretedInstruction(uint32 instruction)
+  {
+    m_emitter.MOV_R64_R64(ARG0, REG_CPU);
+    m_emitter.MOV_R32_IMM32(ARG1, instruction);
+    m_emitter.CALL(m_env.interpret_instruction);
+  }
+
+private:
+  CodeEmitter m_emitter;
+  const CPU* m_cpu;
+  const System* m_system;
+  BlockEnvironment m_env;
+  uint32 m_speed_divider;
+
+  byte* m_exit_branches[3 * 256];
+  uint32 m_num_exit_branches;
+};
+
+} // namespace
+
+const void* CPU::RecompileBlock(const CachedBlock* block, uint16 address)
+{
+#define CPU_OFFSET(field) int32(reinterpret_cast<const byte*>(&field) - reinterpret_cast<const byte*>(this))
+#define SYSTEM_OFFSET(field) int32(reinterpret_cast<const byte*>(&field) - reinterpret_cast<const byte*>(m_system))
+  BlockEnvironment env;
+  env.instruction_counter = CPU_OFFSET(m_instruction_counter);
+  env.check_interrupts = CPU_OFFSET(m_check_interrupts);
+  env.cycle_number = SYSTEM_OFFSET(m_system->m_cycle_number);
+  env.clocks_since_reset = SYSTEM_OFFSET(m_system->m_clocks_since_reset);
+  env.cycles_since_speed_update = SYSTEM_OFFSET(m_system->m_cycles_since_speed_update);
+  env.next_event_cycle = SYSTEM_OFFSET(m_system->m_next_event_cycle);
+  env.execute_target_clocks = SYSTEM_OFFSET(m_system->m_execute_target_clocks);
+  env.memory_map_serial = SYSTEM_OFFSET(m_system->m_memory_map_serial);
+  env.read_pages = SYSTEM_OFFSET(m_system->m_memory_read_pages);
+  env.write_pages = SYSTEM_OFFSET(m_system->m_memory_write_pages);
+#undef CPU_OFFSET
+#undef SYSTEM_OFFSET
+  env.interpret_instruction = reinterpret_cast<const void*>(&CPU::RecompilerInterpretInstruction);
+  env.synchronize = reinterpret_cast<const void*>(&CPU::RecompilerSynchronize);
+  env.read_memory = reinterpret_cast<const void*>(&CPU::RecompilerReadMemory);
+  env.write_memory = reinterpret_cast<const void*>(&CPU::RecompilerWriteMemory);
+  env.trigger_oam_bug = reinterpret_cast<const void*>(&CPU::RecompilerTriggerOAMBug);
+
+  byte* code = m_recompiler_code_buffer + RECOMPILER_FLAG_TABLE_SIZE + m_recompiler_code_buffer_used;
+  BlockCompiler compiler(this, m_system, env, m_recompiler_speed_divider, code, RECOMPILER_MAX_BLOCK_SIZE);
+  CodeEmitter& emitter = compiler.GetEmitter();
+
+  // register operand encoding used by the opcodes, (hl) is handled separately
+  const void* const reg8[8] = {&m_registers.B, &m_registers.C, &m_registers.D, &m_registers.E,
+                               &m_registers.H, &m_registers.L, nullptr,        &m_registers.A};
+  const void* const reg16[4] = {&m_registers.BC, &m_registers.DE, &m_registers.HL, &m_registers.SP};
+  const void* const a = &m_registers.A;
+  const void* const f = &m_registers.F;
+  const void* const hl = &m_registers.HL;
+  const void* const pc = &m_registers.PC;
+
+  compiler.EmitPrologue(m_recompiler_code_buffer);
+
+  uint16 instruction_pc = address;
+  for (uint32 i = 0; i < block->num_instructions; i++)
+  {
+    const CachedInstruction* instruction = &block->instructions[i];
+    const uint8 opcode = instruction->opcode;
+    const uint8 imm8 = instruction->operands[0];
+    const uint16 imm16 = uint16(instruction->operands[0]) | (uint16(instruction->operands[1]) << 8);
+    const uint8 x = opcode >> 6;
+    const uint8 y = (opcode >> 3) & 7;
+    const uint8 z = opcode & 7;
+
+    const uint16 next_pc = instruction_pc + instruction->length;
+
+    if (opcode == 0x00)
+    {
+      // NOP
+      compiler.EmitInstructionStart(next_pc, pc);
+    }
+    else if (x == 1 && opcode != 0x76)
+    {
+      // LD r, r / LD r, (HL) / LD (HL), r
+      compiler.EmitInstructionStart(next_pc, pc);
+      if (z == 6)
+      {
+        compiler.EmitMemoryRead(hl, 0);
+        emitter.MOV_M_R8(compiler.Reg(reg8[y]), RAX);
+      }
+      else if (y == 6)
+      {
+        compiler.EmitMemoryWrite(hl, 0, reg8[z], 0);
+      }
+      else if (y != z)
+      {
+        emitter.MOV_R8_M(RAX, compiler.Reg(reg8[z]));
+        emitter.MOV_M_R8(compiler.Reg(reg8[y]), RAX);
+      }
+    }
+    else if (x == 0 && z == 6)
+    {
+      // LD r, d8 / LD (HL), d8
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitDelayCycles(4);
+      if (y == 6)
+        compiler.EmitMemoryWrite(hl, 0, nullptr, imm8);
+      else
+        emitter.MOV_M_IMM8(compiler.Reg(reg8[y]), imm8);
+    }
+    else if (x == 0 && z == 1 && (y & 1) == 0)
+    {
+      // LD rr, d16
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitDelayCycles(8);
+      emitter.MOV_M_IMM16(compiler.Reg(reg16[y >> 1]), imm16);
+    }
+    else if (opcode == 0x02 || opcode == 0x12)
+    {
+      // LD (BC), A / LD (DE), A
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitMemoryWrite(reg16[y >> 1], 0, a, 0);
+    }
+    else if (opcode == 0x0A || opcode == 0x1A)
+    {
+      // LD A, (BC) / LD A, (DE)
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitMemoryRead(reg16[y >> 1], 0);
+      emitter.MOV_M_R8(compiler.Reg(a), RAX);
+    }
+    else if (opcode == 0x22 || opcode == 0x32)
+    {
+      // LD (HL+), A / LD (HL-), A
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitCheckOAMBug(hl);
+      compiler.EmitMemoryWrite(hl, 0, a, 0);
+      if (opcode == 0x22)
+        emitter.INC_M16(compiler.Reg(hl));
+      else
+        emitter.DEC_M16(compiler.Reg(hl));
+    }
+    else if (opcode == 0x2A || opcode == 0x3A)
+    {
+      // LD A, (HL+) / LD A, (HL-)
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitCheckOAMBug(hl);
+      compiler.EmitMemoryRead(hl, 0);
+      emitter.MOV_M_R8(compiler.Reg(a), RAX);
+      if (opcode == 0x2A)
+        emitter.INC_M16(compiler.Reg(hl));
+      else
+        emitter.DEC_M16(compiler.Reg(hl));
+    }
+    else if (opcode == 0xEA)
+    {
+      // LD (a16), A
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitDelayCycles(8);
+      compiler.EmitMemoryWrite(nullptr, imm16, a, 0);
+    }
+    else if (opcode == 0xFA)
+    {
+      // LD A, (a16)
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitDelayCycles(8);
+      compiler.EmitMemoryRead(nullptr, imm16);
+      emitter.MOV_M_R8(compiler.Reg(a), RAX);
+    }
+    else if (x == 0 && (z == 4 || z == 5) && y != 6)
+    {
+      // INC r / DEC r
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitIncDec(reg8[y], f, (z == 5));
+    }
+    else if (x == 0 && z == 3)
+    {
+      // INC rr / DEC rr
+      const void* reg = reg16[y >> 1];
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitCheckOAMBug(reg);
+      if (y & 1)
+        emitter.DEC_M16(compiler.Reg(reg));
+      else
+        emitter.INC_M16(compiler.Reg(reg));
+      compiler.EmitDelayCycles(4);
+    }
+    else if (x == 2)
+    {
+      // ALU A, r / ALU A, (HL)
+      compiler.EmitInstructionStart(next_pc, pc);
+      if (z == 6)
+      {
+        compiler.EmitMemoryRead(hl, 0);
+        emitter.MOVZX_R32_R8(RCX, RAX);
+        compiler.EmitALU(y, a, f, nullptr, true, 0);
+      }
+      else
+      {
+        compiler.EmitALU(y, a, f, reg8[z], false, 0);
+      }
+    }
+    else if (x == 3 && z == 6)
+    {
+      // ALU A, d8
+      compiler.EmitInstructionStart(next_pc, pc);
+      compiler.EmitDelayCycles(4);
+      compiler.EmitALU(y, a, f, nullptr, false, imm8);
+    }
+    else if (opcode == 0x2F)
+    {
+      // CPL
+      compiler.EmitInstructionStart(next_pc, pc);
+      emitter.NOT_M8(compiler.Reg(a));
+      emitter.ALU_M8_IMM8(ALU_OR, compiler.Reg(f), CPU::FLAG_N | CPU::FLAG_H);
+    }
+    else if (opcode == 0x37)
+    {
+      // SCF
+      compiler.EmitInstructionStart(next_pc, pc);
+      emitter.ALU_M8_IMM8(ALU_AND, compiler.Reg(f), CPU::FLAG_Z);
+      emitter.ALU_M8_IMM8(ALU_OR, compiler.Reg(f), CPU::FLAG_C);
+    }
+    else if (opcode == 0x3F)
+    {
+      // CCF
+      compiler.EmitInstructionStart(next_pc, pc);
+      emitter.ALU_M8_IMM8(ALU_AND, compiler.Reg(f), CPU::FLAG_Z | CPU::FLAG_C);
+      emitter.ALU_M8_IMM8(ALU_XOR, compiler.Reg(f), CPU::FLAG_C);
+    }
+    else
+    {
+      compiler.EmitInterpretedInstruction(uint32(opcode) | (uint32(instruction->operands[0]) << 8) |
+                                          (uint32(instruction->operands[1]) << 16));
+    }
+
+    // nothing left to check after the last instruction
+    if (i != (block->num_instructions - 1))
+      compiler.EmitExitChecks();
+
+    instruction_pc = next_pc;
+  }
+
+  compiler.EmitEpilogue();
+
+  DebugAssert(emitter.GetSize() <= RECOMPILER_MAX_BLOCK_SIZE);
+  m_recompiler_code_buffer_used += emitter.GetSize();
+  return code;
+}
+
+#else
+
+bool CPU::InitializeRecompiler()
+{
+  Log_ErrorPrintf("The recompiler is not supported on this platform, falling back to cached interpreter.");
+  return false;
+}
+
+void CPU::ShutdownRecompiler() {}
+
+void CPU::ExecuteRecompiled()
+{
+  if (!m_recompiler_unavailable)
+    m_recompiler_unavailable = !InitializeRecompiler();
+
+  ExecuteCached();
+}
+
+const void* CPU::RecompileBlock(const CachedBlock* block, uint16 address)
+{
+  return nullptr;
+}
+
+void CPU::RecompilerSynchronize(System* system) {}
+
+uint32 CPU::RecompilerReadMemory(System* system, uint32 address)
+{
+  return 0;
+}
+
+void CPU::RecompilerWriteMemory(System* system, uint32 address, uint32 value) {}
+
+void CPU::RecompilerTriggerOAMBug(System* system) {}
+
+#endif
@@ -7,8 +7,17 @@
 #include "YBaseLib/Log.h"
 #include "YBaseLib/Memory.h"
 #include "YBaseLib/String.h"
+#include <cmath>
+#if defined(Y_CPU_X64)
+#include <emmintrin.h>
+#endif
 Log_SetChannel(Display);
 
+// the span renderers build each line in a buffer with a tile of padding either side, so whole tiles and sprites can be
+// written without clipping
+static const uint32 LINE_BUFFER_PADDING = 8;
+static const uint32 LINE_BUFFER_SIZE = LINE_BUFFER_PADDING + Display::SCREEN_WIDTH + LINE_BUFFER_PADDING;
+
 static uint32 CalculateHDMATransferCycles(uint32 length)
 {
   // 32 cycles per 16 bytes?
@@ -18,7 +27,25 @@ static uint32 CalculateHDMATransferCycles(uint32 length)
   return (length / 0x10) * 32;
 }
 
-Display::Display(System* memory) : m_system(memory), m_last_cycle(0), m_frameReady(false) {}
+Display::Display(System* memory)
+  : m_system(memory), m_last_cycle(0), m_indexed_output(false), m_frame_buffer_stale(false), m_frameReady(false),
+    m_rendering_enabled(true), m_renderer(DISPLAY_RENDERER_SPAN)
+{
+  SetColorCorrection(DISPLAY_COLOR_CORRECTION_RAW);
+  InvalidateTileCache();
+  InvalidateSpriteBins();
+  SetRendererVerification(false);
+
+  // every snapshot has the blank slot, so a line can always point at one
+  Y_memzero(m_palette_snapshots, sizeof(m_palette_snapshots));
+  for (uint32 i = 0; i < 2 * SCREEN_HEIGHT; i++)
+    m_palette_snapshots[i][PALETTE_SLOT_BLANK] = 0xFFFFFFFF;
+  m_palette_snapshot_base = 0;
+  m_num_palette_snapshots = 0;
+  m_palette_snapshot_cgb = false;
+  m_palettes_dirty = true;
+  ClearFrameBuffer();
+}
 
 Display::~Display() {}
 
@@ -109,12 +136,15 @@ void Display::CPUWriteRegister(uint8 index, uint8 value)
     return;
   case DISPLAY_REG_BGP:
     m_registers.BGP = value;
+    m_palettes_dirty = true;
     return;
   case DISPLAY_REG_OBP0:
     m_registers.OBP0 = value;
+    m_palettes_dirty = true;
     return;
   case DISPLAY_REG_OBP1:
     m_registers.OBP1 = value;
+    m_palettes_dirty = true;
     return;
   }
 
@@ -146,6 +176,7 @@ void Display::CPUWriteRegister(uint8 index, uint8 value)
     case DISPLAY_REG_BGPD:
     {
       m_cgb_bg_palette[m_registers.BGPI & 0x3F] = value;
+      m_palettes_dirty = true;
       if (m_registers.BGPI & 0x80)
         m_registers.BGPI = 0x80 | ((m_registers.BGPI + 1) & 0x3F);
 
@@ -154,6 +185,7 @@ void Display::CPUWriteRegister(uint8 index, uint8 value)
     case DISPLAY_REG_OBPD:
     {
       m_cgb_sprite_palette[m_registers.OBPI & 0x3F] = value;
+      m_palettes_dirty = true;
       if (m_registers.OBPI & 0x80)
         m_registers.OBPI = 0x80 | ((m_registers.OBPI + 1) & 0x3F);
 
@@ -172,12 +204,14 @@ void Display::Reset()
   m_last_cycle = 0;
 
   Y_memzero(&m_registers, sizeof(m_registers));
+  InvalidateTileCache();
+  InvalidateSpriteBins();
   Y_memzero(m_cgb_bg_palette, sizeof(m_cgb_bg_palette));
   Y_memzero(m_cgb_sprite_palette, sizeof(m_cgb_sprite_palette));
+  m_palettes_dirty = true;
 
   // start at the end of vblank which is equal to starting fresh
   m_modeClocksRemaining = 0;
-  m_HDMATransferClocksRemaining = 0;
   m_cyclesSinceVBlank = 0;
   m_currentScanLine = 0;
   SetState(DISPLAY_STATE_OAM_READ);
@@ -209,13 +243,25 @@ bool Display::LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error*
   // Read cgb palettes
   binaryReader.ReadBytes(m_cgb_bg_palette, sizeof(m_cgb_bg_palette));
   binaryReader.ReadBytes(m_cgb_sprite_palette, sizeof(m_cgb_sprite_palette));
+  m_palettes_dirty = true;
 
   // Read state
   m_state = (DISPLAY_STATE)binaryReader.ReadUInt8();
   m_modeClocksRemaining = binaryReader.ReadUInt32();
-  m_HDMATransferClocksRemaining = binaryReader.ReadUInt32();
+  uint32 hdma_transfer_clocks = binaryReader.ReadUInt32();
   m_cyclesSinceVBlank = binaryReader.ReadUInt32();
   m_currentScanLine = binaryReader.ReadUInt8();
+
+  // states are saved synchronized, so the display continues from the current cycle
+  m_last_cycle = m_system->GetCycleNumber();
+  m_system->SetNextDisplaySyncCycle(m_modeClocksRemaining);
+
+  // the cpu stays disabled until a transfer in progress completes
+  if (hdma_transfer_clocks > 0)
+    m_system->ScheduleEvent(SYSTEM_EVENT_HDMA, hdma_transfer_clocks);
+  else
+    m_system->CancelEvent(SYSTEM_EVENT_HDMA);
+
   return true;
 }
 
@@ -248,11 +294,36 @@ void Display::SaveState(ByteStream* pStream, BinaryWriter& binaryWriter)
   // Write state
   binaryWriter.WriteUInt8((uint8)m_state);
   binaryWriter.WriteUInt32(m_modeClocksRemaining);
-  binaryWriter.WriteUInt32(m_HDMATransferClocksRemaining);
+  binaryWriter.WriteUInt32(m_system->GetEventCyclesRemaining(SYSTEM_EVENT_HDMA));
   binaryWriter.WriteUInt32(m_cyclesSinceVBlank);
   binaryWriter.WriteUInt8(m_currentScanLine);
 }
 
+void Display::SaveSnapshot(SnapshotState* state) const
+{
+  state->registers = m_registers;
+  Y_memcpy(state->cgb_bg_palette, m_cgb_bg_palette, sizeof(m_cgb_bg_palette));
+  Y_memcpy(state->cgb_sprite_palette, m_cgb_sprite_palette, sizeof(m_cgb_sprite_palette));
+  state->state = m_state;
+  state->mode_clocks_remaining = m_modeClocksRemaining;
+  state->cycles_since_vblank = m_cyclesSinceVBlank;
+  state->last_cycle = m_last_cycle;
+  state->current_scanline = m_currentScanLine;
+}
+
+void Display::LoadSnapshot(const SnapshotState* state)
+{
+  m_registers = state->registers;
+  Y_memcpy(m_cgb_bg_palette, state->cgb_bg_palette, sizeof(m_cgb_bg_palette));
+  Y_memcpy(m_cgb_sprite_palette, state->cgb_sprite_palette, sizeof(m_cgb_sprite_palette));
+  m_palettes_dirty = true;
+  m_state = state->state;
+  m_modeClocksRemaining = state->mode_clocks_remaining;
+  m_cyclesSinceVBlank = state->cycles_since_vblank;
+  m_last_cycle = state->last_cycle;
+  m_currentScanLine = state->current_scanline;
+}
+
 void Display::SetState(DISPLAY_STATE state)
 {
   m_state = state;
@@ -405,7 +476,8 @@ void Display::ExecuteHDMATransferBlock(uint32 bytes)
 {
   uint16 source_address = (uint16(m_registers.HDMA1) << 8) | uint16(m_registers.HDMA2);
   uint16 destination_address = (uint16(m_registers.HDMA3) << 8) | uint16(m_registers.HDMA4);
-  byte* vram = m_system->GetVRAM(m_system->GetActiveCPUVRAMBank());
+  uint8 vram_bank = m_system->GetActiveCPUVRAMBank();
+  byte* vram = m_system->GetVRAM(vram_bank);
 
   // Writing to FF55 starts the transfer, the lower 7 bits of FF55 specify the Transfer Length (divided by 10h, minus
   // 1). Ie. lengths of 10h-800h bytes can be defined by the values 00h-7Fh.
@@ -424,11 +496,30 @@ void Display::ExecuteHDMATransferBlock(uint32 bytes)
   if ((source_address > 0x7FF0 && source_address < 0xA000) || source_address > 0xDFF0)
     Log_WarningPrintf("Source address out of range (0x%04X)", source_address);
 
-  // transfer bytes
-  for (uint32 i = 0; i < copy_length; i++)
+  // transfer bytes, a source page at a time. rom, wram and plain cart ram are mapped and can be copied directly, the
+  // rest (vram, rtc registers, locked by oam dma) goes through the cpu read path.
+  uint32 remaining_copy = copy_length;
+  while (remaining_copy > 0)
   {
     DebugAssert(current_destination_address < 0x2000);
-    vram[current_destination_address++] = m_system->CPURead(current_source_address++);
+    uint32 run_length = Min(remaining_copy, 0x100u - (current_source_address & 0xFFu));
+    run_length = Min(run_length, 0x2000u - current_destination_address);
+
+    const byte* source_page = m_system->m_memory_read_pages[current_source_address >> 8];
+    if (source_page != nullptr)
+    {
+      Y_memcpy(vram + current_destination_address, source_page + (current_source_address & 0xFF), run_length);
+    }
+    else
+    {
+      for (uint32 i = 0; i < run_length; i++)
+        vram[current_destination_address + i] = m_system->CPURead(current_source_address + uint16(i));
+    }
+
+    InvalidateCachedTiles(vram_bank, current_destination_address, run_length);
+    current_source_address += uint16(run_length);
+    current_destination_address = (current_destination_address + uint16(run_length)) & 0x1FFF;
+    remaining_copy -= run_length;
   }
 
   // update registers with addresses
@@ -449,10 +540,15 @@ void Display::ExecuteHDMATransferBlock(uint32 bytes)
   }
 
   // calculate how many cycles we need to block the cpu for
-  m_HDMATransferClocksRemaining = CalculateHDMATransferCycles(copy_length);
+  m_system->ScheduleEvent(SYSTEM_EVENT_HDMA, CalculateHDMATransferCycles(copy_length));
   m_system->DisableCPU(true);
 }
 
+void Display::EndHDMATransfer()
+{
+  m_system->DisableCPU(false);
+}
+
 bool Display::CanTriggerOAMBug() const
 {
   // Can't trigger with display off
@@ -481,24 +577,6 @@ void Display::Synchronize()
   uint32 cycles_to_execute = m_system->CalculateCycleCount(m_last_cycle);
   m_last_cycle = m_system->GetCycleNumber();
 
-  // Handle HDMA transfers blocking of cpu.
-  // This would be better placed elsewhere.
-  if (m_HDMATransferClocksRemaining > 0)
-  {
-    uint32 hdma_clocks = (cycles_to_execute << m_system->GetDoubleSpeedDivider());
-    if (hdma_clocks >= m_HDMATransferClocksRemaining)
-    {
-      // Re-enable the CPU.
-      m_system->DisableCPU(false);
-      m_HDMATransferClocksRemaining = 0;
-    }
-    else
-    {
-      // Still going.
-      m_HDMATransferClocksRemaining -= hdma_clocks;
-    }
-  }
-
   // Execute as much time as we can.
   while (cycles_to_execute > 0)
   {
@@ -528,10 +606,8 @@ void Display::Synchronize()
     case DISPLAY_STATE_OAM_VRAM_READ:
     {
       // Render this scanline.
-      if (!m_system->InCGBMode())
-        RenderScanline(m_currentScanLine);
-      else
-        RenderScanline_CGB(m_currentScanLine);
+      if (m_rendering_enabled)
+        DrawScanline(m_currentScanLine);
 
       // Enter HBLANK for this scanline
       SetState(DISPLAY_STATE_HBLANK);
@@ -589,51 +665,192 @@ void Display::Synchronize()
   m_system->SetNextDisplaySyncCycle(m_modeClocksRemaining);
 }
 
-uint8 Display::ReadTile(uint8 bank, bool high_tileset, int32 tile, uint8 x, uint8 y) const
+void Display::InvalidateCachedTiles(uint8 bank, uint16 offset, uint32 length)
 {
-  // find the base address of this tile
-  // uint16 BGTILEBASE = (high_tileset) ? 0x0800 : 0x0000;
-  const byte* tilemem = m_system->GetVRAM(bank); // + BGTILEBASE;
-  if (high_tileset)
-    tilemem += 0x800 + ((tile + 128) * 16);
-  else
-    tilemem += ((uint8)tile * 16);
+  uint32 start_tile = offset / 16;
+  uint32 end_tile = Min((uint32(offset) + length + 15) / 16, NUM_TILES);
+  for (uint32 tile = start_tile; tile < end_tile; tile++)
+    m_tile_cache_dirty[bank][tile] = true;
+}
 
-  // 2 bytes represent a line, with the LSB on the even byte
-  // and the MSB on the odd byte
-  uint32 byteIndex = y * 2;
-  uint32 bitIndex = x % 8;
+void Display::InvalidateTileCache()
+{
+  for (uint32 bank = 0; bank < 2; bank++)
+  {
+    for (uint32 tile = 0; tile < NUM_TILES; tile++)
+      m_tile_cache_dirty[bank][tile] = true;
+  }
+}
 
-  // extract 2-bit palette index
-  byte colourBit = (tilemem[byteIndex] >> (7 - bitIndex)) & 0x1;
-  colourBit |= ((tilemem[byteIndex + 1] >> (7 - bitIndex)) & 0x1) << 1;
+void Display::DecodeTile(uint8 bank, uint32 tile_index)
+{
+  // 2 bytes represent a line, with the LSB on the even byte and the MSB on the odd byte
+  const byte* tilemem = m_system->GetVRAM(bank) + tile_index * 16;
+  uint8* decoded = m_tile_cache[bank][tile_index][0];
+  uint8* decoded_flipped = m_tile_cache[bank][tile_index][1];
+  for (uint32 y = 0; y < 8; y++)
+  {
+    uint8 low = tilemem[y * 2];
+    uint8 high = tilemem[y * 2 + 1];
+    for (uint32 x = 0; x < 8; x++)
+    {
+      uint8 index = ((low >> (7 - x)) & 0x1) | (((high >> (7 - x)) & 0x1) << 1);
+      decoded[y * 8 + x] = index;
+      decoded_flipped[y * 8 + (7 - x)] = index;
+    }
+  }
 
-  // palette index
-  return colourBit & 0x3;
+  m_tile_cache_dirty[bank][tile_index] = false;
 }
 
-uint32 Display::ReadCGBPalette(const uint8* palette, uint8 palette_index, uint8 color_index) const
+// rgb555 to rgba8 for every colour correction, the tables are shared by every display and built on first use
+static const uint32* GetCGBColorTable(DISPLAY_COLOR_CORRECTION correction)
 {
-  DebugAssert(palette_index < 8 && color_index < 4);
-  const uint8* start = &palette[palette_index * 8 + color_index * 2];
-  uint16 color555 = (uint16)start[0] | ((uint16)start[1] << 8);
-
-  // approximate, not 100% accurate
-  // uint8 r = (color555 & 0x1F) * 8;
-  // uint8 g = ((color555 >> 5) & 0x1F) * 8;
-  // uint8 b = ((color555 >> 10) & 0x1F) * 8;
-  // http://stackoverflow.com/a/9069480
-  uint8 r = (((color555 & 0x1F) * 527 + 23) >> 6) & 0xFF;
-  uint8 g = ((((color555 >> 5) & 0x1F) * 527 + 23) >> 6) & 0xFF;
-  uint8 b = ((((color555 >> 10) & 0x1F) * 527 + 23) >> 6) & 0xFF;
-  return ((uint32)r | ((uint32)g << 8) | ((uint32)b << 16) | 0xFF000000);
+  struct ColorTables
+  {
+    uint32 colors[NUM_DISPLAY_COLOR_CORRECTIONS][32768];
+
+    ColorTables()
+    {
+      for (uint32 color555 = 0; color555 < 32768; color555++)
+      {
+        uint32 r5 = color555 & 0x1F;
+        uint32 g5 = (color555 >> 5) & 0x1F;
+        uint32 b5 = (color555 >> 10) & 0x1F;
+
+        // http://stackoverflow.com/a/9069480
+        uint32 r = ((r5 * 527 + 23) >> 6) & 0xFF;
+        uint32 g = ((g5 * 527 + 23) >> 6) & 0xFF;
+        uint32 b = ((b5 * 527 + 23) >> 6) & 0xFF;
+        colors[DISPLAY_COLOR_CORRECTION_RAW][color555] = r | (g << 8) | (b << 16) | 0xFF000000;
+
+        // the lcd's response is steeper than a pc monitor's, so midtones come out darker
+        auto gamma = [](uint32 c5) { return uint32(std::pow(float(c5) / 31.0f, 2.2f / 2.0f) * 255.0f + 0.5f); };
+        colors[DISPLAY_COLOR_CORRECTION_GAMMA][color555] =
+          gamma(r5) | (gamma(g5) << 8) | (gamma(b5) << 16) | 0xFF000000;
+
+        // channels bleed into each other and never reach full brightness on the gbc screen
+        r = Min(r5 * 26 + g5 * 4 + b5 * 2, 960u) * 255 / 960;
+        g = Min(g5 * 24 + b5 * 8, 960u) * 255 / 960;
+        b = Min(r5 * 6 + g5 * 4 + b5 * 22, 960u) * 255 / 960;
+        colors[DISPLAY_COLOR_CORRECTION_GBC_LCD][color555] = r | (g << 8) | (b << 16) | 0xFF000000;
+      }
+    }
+  };
+
+  static const ColorTables tables;
+  return tables.colors[correction];
 }
 
-void Display::RenderScanline(uint8 LINE)
+void Display::SetColorCorrection(DISPLAY_COLOR_CORRECTION correction)
+{
+  m_color_correction = correction;
+  m_cgb_color_table = GetCGBColorTable(correction);
+  m_palettes_dirty = true;
+}
+
+void Display::GetDMGPalettes(uint32 background_palette[4], uint32 obj_palette0[4], uint32 obj_palette1[4]) const
 {
   const uint32 grayscale_colors[4] = {0xFFFFFFFF, 0xFFC0C0C0, 0xFF606060, 0xFF000000};
   // const uint32 grayscale_colors[4] = { 0xFF000000, 0xFF606060, 0xFFC0C0C0, 0xFFFFFFFF};
 
+  // read background palette
+  for (uint32 i = 0; i < 4; i++)
+    background_palette[i] = grayscale_colors[(m_registers.BGP >> (i * 2)) & 0x3];
+
+  // read sprite palettes
+  obj_palette0[0] = obj_palette1[0] = 0xFF555555;
+  for (uint32 i = 1; i < 4; i++)
+  {
+    obj_palette0[i] = grayscale_colors[(m_registers.OBP0 >> (i * 2)) & 0x3];
+    obj_palette1[i] = grayscale_colors[(m_registers.OBP1 >> (i * 2)) & 0x3];
+  }
+
+  // CGB compatibility mode?
+  // We should really use the CGB render function instead..
+  if (m_system->GetBootMode() == SYSTEM_MODE_CGB)
+  {
+    for (uint32 i = 0; i < 4; i++)
+    {
+      background_palette[i] = ReadCGBPalette(m_cgb_bg_palette, 0, ((m_registers.BGP >> (i * 2)) & 0x3));
+      obj_palette0[i] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP0 >> (i * 2)) & 0x3));
+      obj_palette1[i] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP1 >> (i * 2)) & 0x3));
+    }
+  }
+}
+
+void Display::BinSprites()
+{
+  uint8 sprite_size = m_registers.LCDC & 0x04;
+  int32 sprite_height = (sprite_size) ? 16 : 8;
+  bool cgb = m_system->InCGBMode();
+
+  Y_memzero(m_sprite_bin_counts, sizeof(m_sprite_bin_counts));
+  for (uint32 i = 0; i < NUM_OAM_SPRITES; i++)
+  {
+    // x/y in oam describes the bottom-right corner position (to position sprite at 0,0 it would be 8,16)
+    const OAM_ENTRY* sprite = reinterpret_cast<const OAM_ENTRY*>(m_system->GetOAM()) + i;
+    if (sprite->x == 0 || sprite->y == 0 || sprite->x >= 168 || sprite->y >= 160) // offscreen
+      continue;
+
+    int32 sprite_start_y = (int32)sprite->y - 16;
+    int32 first_line = Max(sprite_start_y, 0);
+    int32 last_line = Min(sprite_start_y + sprite_height, (int32)SCREEN_HEIGHT);
+    for (int32 line = first_line; line < last_line; line++)
+    {
+      // cgb follows oam order and draws every sprite on the line
+      OAM_ENTRY* bin = m_sprite_bins[line];
+      if (cgb)
+      {
+        bin[m_sprite_bin_counts[line]++] = *sprite;
+        continue;
+      }
+
+      // non-cgb mode -> x coordinate determines priority, oam order breaks ties.
+      // hardware can only draw 10 sprites, highest priority first
+      uint32 position = m_sprite_bin_counts[line];
+      if (position == MAX_SPRITES_PER_LINE)
+      {
+        if (bin[position - 1].x <= sprite->x)
+          continue;
+
+        position--;
+      }
+      else
+      {
+        m_sprite_bin_counts[line]++;
+      }
+
+      for (; position > 0 && bin[position - 1].x > sprite->x; position--)
+        bin[position] = bin[position - 1];
+
+      bin[position] = *sprite;
+    }
+  }
+
+  m_sprite_bins_size = sprite_size;
+  m_sprite_bins_cgb = cgb;
+  m_sprite_bins_dirty = false;
+}
+
+const OAM_ENTRY* Display::GetLineSprites(uint8 LINE, uint32* num_sprites)
+{
+  // an accurate oam dma is only copied when someone looks, bring it up to the current cycle first
+  m_system->SynchronizeOAMDMA();
+
+  // sprite size and the priority rules are part of the bins too
+  if (m_sprite_bins_dirty || m_sprite_bins_size != (m_registers.LCDC & 0x04) ||
+      m_sprite_bins_cgb != m_system->InCGBMode())
+  {
+    BinSprites();
+  }
+
+  *num_sprites = m_sprite_bin_counts[LINE];
+  return m_sprite_bins[LINE];
+}
+
+void Display::RenderScanline(uint8 LINE)
+{
   // blank the line
   byte* pFrameBufferLine = m_frameBuffer + (LINE * SCREEN_WIDTH * 4);
   Y_memset(pFrameBufferLine, 0xFF, SCREEN_WIDTH * 4);
@@ -659,80 +876,17 @@ void Display::RenderScanline(uint8 LINE)
   uint8 SPRITE_HEIGHT = 8 + SPRITE_SIZE_BIT * 8; // bit 2
   uint8 SPRITE_ENABLE = !!(LCDC & 0x02);
 
-  // read background palette
-  uint32 background_palette[4] = {
-    grayscale_colors[m_registers.BGP & 0x3], grayscale_colors[(m_registers.BGP >> 2) & 0x3],
-    grayscale_colors[(m_registers.BGP >> 4) & 0x3], grayscale_colors[(m_registers.BGP >> 6) & 0x3]};
-
-  // read sprite palettes
-  uint32 obj_palette0[4] = {0xFF555555, grayscale_colors[(m_registers.OBP0 >> 2) & 0x3],
-                            grayscale_colors[(m_registers.OBP0 >> 4) & 0x3],
-                            grayscale_colors[(m_registers.OBP0 >> 6) & 0x3]};
-  uint32 obj_palette1[4] = {0xFF555555, grayscale_colors[(m_registers.OBP1 >> 2) & 0x3],
-                            grayscale_colors[(m_registers.OBP1 >> 4) & 0x3],
-                            grayscale_colors[(m_registers.OBP1 >> 6) & 0x3]};
-
-  // CGB compatibility mode?
-  // We should really use the CGB render function instead..
-  if (m_system->GetBootMode() == SYSTEM_MODE_CGB)
-  {
-    background_palette[0] = ReadCGBPalette(m_cgb_bg_palette, 0, (m_registers.BGP & 0x3));
-    background_palette[1] = ReadCGBPalette(m_cgb_bg_palette, 0, ((m_registers.BGP >> 2) & 0x3));
-    background_palette[2] = ReadCGBPalette(m_cgb_bg_palette, 0, ((m_registers.BGP >> 4) & 0x3));
-    background_palette[3] = ReadCGBPalette(m_cgb_bg_palette, 0, ((m_registers.BGP >> 6) & 0x3));
-    obj_palette0[0] = ReadCGBPalette(m_cgb_sprite_palette, 0, (m_registers.OBP0 & 0x3));
-    obj_palette0[1] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP0 >> 2) & 0x3));
-    obj_palette0[2] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP0 >> 4) & 0x3));
-    obj_palette0[3] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP0 >> 6) & 0x3));
-    obj_palette1[0] = ReadCGBPalette(m_cgb_sprite_palette, 0, (m_registers.OBP1 & 0x3));
-    obj_palette1[1] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP1 >> 2) & 0x3));
-    obj_palette1[2] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP1 >> 4) & 0x3));
-    obj_palette1[3] = ReadCGBPalette(m_cgb_sprite_palette, 0, ((m_registers.OBP1 >> 6) & 0x3));
-  }
+  // read palettes
+  uint32 background_palette[4], obj_palette0[4], obj_palette1[4];
+  GetDMGPalettes(background_palette, obj_palette0, obj_palette1);
 
   // read sprites
-  OAM_ENTRY active_sprites[40];
   uint32 num_active_sprites = 0;
-  if (SPRITE_ENABLE)
-  {
-    // cull sprites
-    for (uint32 i = 0; i < 40; i++)
-    {
-      // x/y in oam describes the bottom-right corner position (to position sprite at 0,0 it would be 8,16)
-      const OAM_ENTRY* attributes = reinterpret_cast<const OAM_ENTRY*>(m_system->GetOAM()) + i;
-      if (attributes->x == 0 || attributes->y == 0 || attributes->x >= 168 || attributes->y >= 160) // offscreen
-        continue;
-
-      // translate to upper left/top, test if within our scanline
-      int32 sprite_start_y = (int32)attributes->y - 16;
-      int32 sprite_end_y = sprite_start_y + (int32)SPRITE_HEIGHT - 1;
-      if ((int32)LINE < sprite_start_y || (int32)LINE > sprite_end_y)
-        continue;
+  const OAM_ENTRY* active_sprites = (SPRITE_ENABLE) ? GetLineSprites(LINE, &num_active_sprites) : nullptr;
 
-      // add to list
-      active_sprites[num_active_sprites] = *attributes;
-      num_active_sprites++;
-    }
-
-    // sort sprites
-    if (num_active_sprites > 0)
-    {
-      Y_qsort(active_sprites, num_active_sprites, sizeof(active_sprites[0]), [](const void* a, const void* b) -> int {
-        // non-cgb mode -> x coordinate determines priority
-        OAM_ENTRY* oa = (OAM_ENTRY*)a;
-        OAM_ENTRY* ob = (OAM_ENTRY*)b;
-        if (oa->x < ob->x)
-          return -1;
-        else if (oa->x > ob->x)
-          return 1;
-        else
-          return 0;
-      });
-
-      // hardware can only draw 10 sprites, highest priority first
-      num_active_sprites = Min(num_active_sprites, (uint32)10);
-    }
-  }
+  // background tile row being drawn, fetched again when moving into another tile
+  uint32 tile_row_key = 0xFFFFFFFF;
+  const uint8* tile_row = nullptr;
 
   // render the scanline
   for (uint32 pixel_x = 0; pixel_x < 160; pixel_x++)
@@ -771,15 +925,18 @@ void Display::RenderScanline(uint8 LINE)
       int32 tilemapy = iy / 8;
       int32 tilemapindex = tilemapy * 32 + tilemapx;
 
-      // read the tile byte
-      int8 tile;
-      if (tilemap == 0)
-        tile = (int8)VRAM[0x1800 + tilemapindex];
-      else
-        tile = (int8)VRAM[0x1C00 + tilemapindex];
+      // read the tile byte and pattern row
+      uint32 tilemap_address = ((tilemap == 0) ? 0x1800 : 0x1C00) + tilemapindex;
+      uint32 row_key = (tilemap_address << 3) | uint32(iy % 8);
+      if (row_key != tile_row_key)
+      {
+        uint8 tile = VRAM[tilemap_address];
+        tile_row = GetTileRow(0, GetTileIndex(BGTILESET_SELECT == 0, tile), iy % 8, false);
+        tile_row_key = row_key;
+      }
 
-      // read the tile pattern, access palette
-      bgcolor_index = ReadTile(0, (BGTILESET_SELECT == 0), tile, ix % 8, iy % 8);
+      // access palette
+      bgcolor_index = tile_row[ix % 8];
       color = background_palette[bgcolor_index];
     }
 
@@ -809,9 +966,7 @@ void Display::RenderScanline(uint8 LINE)
         int32 tile_y = (int32)LINE - sprite_start_y;
         DebugAssert(tile_x >= 0 && tile_x < 16 && tile_y >= 0 && tile_y < (int32)SPRITE_HEIGHT);
 
-        // handle flipped sprites
-        if (sprite->hflip)
-          tile_x = 7 - tile_x;
+        // handle flipped sprites, the cache holds mirrored rows
         if (sprite->vflip)
           tile_y = (SPRITE_HEIGHT - 1) - tile_y;
 
@@ -836,7 +991,7 @@ void Display::RenderScanline(uint8 LINE)
         }
 
         // get palette index
-        uint8 palette_index = ReadTile(0, 0, tile_index, (uint8)tile_x, (uint8)tile_y);
+        uint8 palette_index = GetTileRow(0, tile_index, tile_y, sprite->hflip != 0)[tile_x];
         if (palette_index == 0)
         {
           // sprite colour 0 is transparent, try to draw other sprites instead.
@@ -889,30 +1044,13 @@ void Display::RenderScanline_CGB(uint8 LINE)
   // TODO: different behaviour of bits 0-3
 
   // read sprites
-  OAM_ENTRY active_sprites[40];
   uint32 num_active_sprites = 0;
-  if (SPRITE_ENABLE)
-  {
-    // cull sprites
-    // no need to sort them since CGB follows memory order
-    for (uint32 i = 0; i < 40; i++)
-    {
-      // x/y in oam describes the bottom-right corner position (to position sprite at 0,0 it would be 8,16)
-      const OAM_ENTRY* attributes = reinterpret_cast<const OAM_ENTRY*>(m_system->GetOAM()) + i;
-      if (attributes->x == 0 || attributes->y == 0 || attributes->x >= 168 || attributes->y >= 160) // offscreen
-        continue;
+  const OAM_ENTRY* active_sprites = (SPRITE_ENABLE) ? GetLineSprites(LINE, &num_active_sprites) : nullptr;
 
-      // translate to upper left/top, test if within our scanline
-      int32 sprite_start_y = (int32)attributes->y - 16;
-      int32 sprite_end_y = sprite_start_y + (int32)SPRITE_HEIGHT - 1;
-      if ((int32)LINE < sprite_start_y || (int32)LINE > sprite_end_y)
-        continue;
-
-      // add to list
-      active_sprites[num_active_sprites] = *attributes;
-      num_active_sprites++;
-    }
-  }
+  // background tile row being drawn and its attributes, fetched again when moving into another tile
+  uint32 tile_row_key = 0xFFFFFFFF;
+  const uint8* tile_row = nullptr;
+  uint8 tile_flags = 0;
 
   // render the scanline
   for (uint32 pixel_x = 0; pixel_x < 160; pixel_x++)
@@ -955,42 +1093,32 @@ void Display::RenderScanline_CGB(uint8 LINE)
       ix %= 8;
       iy %= 8;
 
-      // read the tile byte
-      int8 tile;
-      uint8 flags;
-      if (tilemap == 0)
+      // read the tile byte and attributes
+      uint32 tilemap_address = ((tilemap == 0) ? 0x1800 : 0x1C00) + tilemapindex;
+      uint32 row_key = (tilemap_address << 3) | uint32(iy);
+      if (row_key != tile_row_key)
       {
-        tile = (int8)VRAM0[0x1800 + tilemapindex];
-        flags = VRAM1[0x1800 + tilemapindex];
+        // flags:
+        // bits 0-2 - background palette number
+        // bit 3 - tile bank number
+        // bit 4 - unused
+        // bit 5 - hflip
+        // bit 6 - vflip
+        // bit 7 - bg-to-oam priority (1=override oam priority)
+        uint8 tile = VRAM0[tilemap_address];
+        tile_flags = VRAM1[tilemap_address];
+        uint8 bank = (tile_flags >> 3) & 0x1;
+        uint32 row = (tile_flags & (1 << 6)) ? (7 - iy) : iy;
+        tile_row = GetTileRow(bank, GetTileIndex(BGTILESET_SELECT == 0, tile), row, (tile_flags & (1 << 5)) != 0);
+        tile_row_key = row_key;
       }
-      else
-      {
-        tile = (int8)VRAM0[0x1C00 + tilemapindex];
-        flags = VRAM1[0x1C00 + tilemapindex];
-      }
-
-      // flags:
-      // bits 0-2 - background palette number
-      // bit 3 - tile bank number
-      // bit 4 - unused
-      // bit 5 - hflip
-      // bit 6 - vflip
-      // bit 7 - bg-to-oam priority (1=override oam priority)
-      uint8 palette = (flags & 0x7);
-      uint8 bank = (flags >> 3) & 0x1;
-
-      // hflip/vflip
-      if (flags & (1 << 5))
-        ix = 7 - ix;
-      if (flags & (1 << 6))
-        iy = 7 - iy;
 
       // read the tile pattern, access palette
-      bgcolor_index = ReadTile(bank, (BGTILESET_SELECT == 0), tile, (uint8)ix, (uint8)iy);
-      color = ReadCGBPalette(m_cgb_bg_palette, palette, bgcolor_index);
+      bgcolor_index = tile_row[ix];
+      color = ReadCGBPalette(m_cgb_bg_palette, tile_flags & 0x7, bgcolor_index);
 
       // check bg priority. if set, skip the obj (it's in front)
-      bg_priority = ((flags >> 7) & 0x01) & BG_PRIORITY;
+      bg_priority = ((tile_flags >> 7) & 0x01) & BG_PRIORITY;
     }
 
     // sprites on?
@@ -1019,9 +1147,7 @@ void Display::RenderScanline_CGB(uint8 LINE)
         int32 tile_y = (int32)LINE - sprite_start_y;
         DebugAssert(tile_x >= 0 && tile_x < 16 && tile_y >= 0 && tile_y < (int32)SPRITE_HEIGHT);
 
-        // handle flipped sprites
-        if (sprite->hflip)
-          tile_x = 7 - tile_x;
+        // handle flipped sprites, the cache holds mirrored rows
         if (sprite->vflip)
           tile_y = (SPRITE_HEIGHT - 1) - tile_y;
 
@@ -1046,7 +1172,7 @@ void Display::RenderScanline_CGB(uint8 LINE)
         }
 
         // get palette index
-        uint8 color_index = ReadTile(sprite->cgb_bank, 0, tile_index, (uint8)tile_x, (uint8)tile_y);
+        uint8 color_index = GetTileRow(sprite->cgb_bank, tile_index, tile_y, sprite->hflip != 0)[tile_x];
         if (color_index == 0)
         {
           // sprite colour 0 is transparent, try to draw other sprites instead.
@@ -1066,9 +1192,360 @@ void Display::RenderScanline_CGB(uint8 LINE)
   }
 }
 
+// draws the opaque pixels of an 8 pixel sprite row over the line, unless the background is in front
+// line, bg_index and bg_priority are at the sprite's position, slot is the palette slot of the sprite's colour 0
+static inline void CompositeSpriteRow(uint8* line, const uint8* sprite_row, const uint8* bg_index,
+                                      const uint8* bg_priority, bool behind_background, uint8 slot)
+{
+#if defined(Y_CPU_X64)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i row = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(sprite_row));
+  __m128i hidden = _mm_or_si128(_mm_cmpeq_epi8(row, zero),
+                                _mm_cmpgt_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bg_priority)), zero));
+  if (behind_background)
+  {
+    __m128i bg = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(bg_index));
+    hidden = _mm_or_si128(hidden, _mm_cmpgt_epi8(bg, zero));
+  }
+
+  __m128i dst = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(line));
+  __m128i src = _mm_add_epi8(row, _mm_set1_epi8(char(slot)));
+  dst = _mm_or_si128(_mm_and_si128(hidden, dst), _mm_andnot_si128(hidden, src));
+  _mm_storel_epi64(reinterpret_cast<__m128i*>(line), dst);
+#else
+  for (uint32 i = 0; i < 8; i++)
+  {
+    if (sprite_row[i] != 0 && bg_priority[i] == 0 && (!behind_background || bg_index[i] == 0))
+      line[i] = slot + sprite_row[i];
+  }
+#endif
+}
+
+// converts a line of palette slots to colours in the framebuffer
+static inline void WriteLineColors(byte* pFrameBufferLine, const uint8* line, const uint32* palette)
+{
+#if defined(Y_CPU_X64)
+  for (uint32 i = 0; i < Display::SCREEN_WIDTH; i += 4)
+  {
+    __m128i colors = _mm_set_epi32(int32(palette[line[i + 3]]), int32(palette[line[i + 2]]),
+                                   int32(palette[line[i + 1]]), int32(palette[line[i]]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pFrameBufferLine + i * 4), colors);
+  }
+#else
+  uint32 colors[Display::SCREEN_WIDTH];
+  for (uint32 i = 0; i < Display::SCREEN_WIDTH; i++)
+    colors[i] = palette[line[i]];
+
+  Y_memcpy(pFrameBufferLine, colors, sizeof(colors));
+#endif
+}
+
+// fnv-1a, for comparing renderer output
+static uint64 HashFrameBufferLine(uint64 hash, const byte* pFrameBufferLine)
+{
+  for (uint32 i = 0; i < Display::SCREEN_WIDTH * 4; i++)
+    hash = (hash ^ pFrameBufferLine[i]) * 1099511628211ull;
+
+  return hash;
+}
+
+static const uint64 FRAME_HASH_SEED = 14695981039346656037ull;
+
+const uint8* Display::GetSpriteRow(const OAM_ENTRY* sprite, uint8 LINE, uint8 bank)
+{
+  uint32 sprite_height = (m_registers.LCDC & 0x04) ? 16 : 8;
+  uint32 tile_y = uint32(LINE) - (uint32(sprite->y) - 16);
+  if (sprite->vflip)
+    tile_y = (sprite_height - 1) - tile_y;
+
+  // "In 8x16 mode, the lower bit of the tile number is ignored. Ie. the upper 8x8 tile is "NN AND FEh", and the
+  // lower 8x8 tile is "NN OR 01h"."
+  uint32 tile_index = sprite->tile;
+  if (sprite_height == 16)
+  {
+    if (tile_y >= 8)
+    {
+      tile_index |= 0x01;
+      tile_y -= 8;
+    }
+    else
+    {
+      tile_index &= 0xFE;
+    }
+  }
+
+  return GetTileRow(bank, tile_index, tile_y, sprite->hflip != 0);
+}
+
+void Display::FetchBackgroundTile(uint32 tilemap_address, uint32 y, uint8* bg_index, uint8* line, uint8* bg_priority)
+{
+  // cgb tile attributes:
+  // bits 0-2 - background palette number
+  // bit 3 - tile bank number
+  // bit 5 - hflip
+  // bit 6 - vflip
+  // bit 7 - bg-to-oam priority (1=override oam priority), only if LCDC bit 0 is set
+  uint8 tile = m_system->GetVRAM(0)[tilemap_address];
+  uint8 flags = m_system->InCGBMode() ? m_system->GetVRAM(1)[tilemap_address] : 0;
+  uint32 row_y = (flags & (1 << 6)) ? (7 - y) : y;
+  const uint8* row = GetTileRow((flags >> 3) & 0x1, GetTileIndex((m_registers.LCDC & 0x10) == 0, tile), row_y,
+                                (flags & (1 << 5)) != 0);
+
+  uint8 slot = (flags & 0x7) * 4;
+  for (uint32 i = 0; i < 8; i++)
+  {
+    bg_index[i] = row[i];
+    line[i] = slot + row[i];
+  }
+
+  Y_memset(bg_priority, (flags >> 7) & m_registers.LCDC & 0x01, 8);
+}
+
+void Display::FetchBackgroundLine(uint8 LINE, uint8* bg_index, uint8* line, uint8* bg_priority)
+{
+  uint8 LCDC = m_registers.LCDC;
+  uint8 SCX = m_registers.SCX;
+  uint8 SCY = m_registers.SCY;
+  int32 WINDOW_X = int32(m_registers.WX) - 7;
+  uint8 WY = m_registers.WY;
+  const int32 end_x = int32(LINE_BUFFER_PADDING + SCREEN_WIDTH);
+
+  // background, from the tile the scrolled left edge falls in. the line buffer is padded so whole tiles fit.
+  uint32 bg_y = (uint32(LINE) + SCY) & 0xFF;
+  uint32 bg_tilemap = ((LCDC & 0x08) ? 0x1C00 : 0x1800) + (bg_y / 8) * 32;
+  int32 x = int32(LINE_BUFFER_PADDING) - int32(SCX % 8);
+  for (uint32 tile_x = SCX / 8; x < end_x; tile_x++, x += 8)
+    FetchBackgroundTile(bg_tilemap + (tile_x % 32), bg_y % 8, &bg_index[x], &line[x], &bg_priority[x]);
+
+  // the window covers everything from its left edge to the end of the line
+  if ((LCDC & 0x20) && LINE >= WY && WINDOW_X < int32(SCREEN_WIDTH))
+  {
+    uint32 window_y = uint32(LINE) - WY;
+    uint32 window_tilemap = ((LCDC & 0x40) ? 0x1C00 : 0x1800) + (window_y / 8) * 32;
+    x = int32(LINE_BUFFER_PADDING) + WINDOW_X;
+    for (uint32 tile_x = 0; x < end_x; tile_x++, x += 8)
+      FetchBackgroundTile(window_tilemap + tile_x, window_y % 8, &bg_index[x], &line[x], &bg_priority[x]);
+  }
+}
+
+void Display::DrawScanline(uint8 LINE)
+{
+  bool cgb = m_system->InCGBMode();
+  const byte* pFrameBufferLine = m_frameBuffer + (LINE * SCREEN_WIDTH * 4);
+
+  // the reference output is hashed, then drawn over by the renderer being checked
+  if (m_renderer_verification)
+  {
+    if (cgb)
+      RenderScanline_CGB(LINE);
+    else
+      RenderScanline(LINE);
+
+    m_reference_frame_hash = HashFrameBufferLine(m_reference_frame_hash, pFrameBufferLine);
+  }
+
+  // only the span renderer produces palette slots
+  if (m_renderer == DISPLAY_RENDERER_SPAN || m_indexed_output)
+  {
+    if (cgb)
+      RenderScanlineSpans_CGB(LINE);
+    else
+      RenderScanlineSpans(LINE);
+  }
+  else
+  {
+    if (cgb)
+      RenderScanline_CGB(LINE);
+    else
+      RenderScanline(LINE);
+  }
+
+  if (m_renderer_verification)
+  {
+    if (m_indexed_output)
+      ResolveLine(LINE);
+
+    m_frame_hash = HashFrameBufferLine(m_frame_hash, pFrameBufferLine);
+  }
+}
+
+void Display::SnapshotLinePalette(uint8 LINE)
+{
+  // snapshots are numbered from the top of the frame, a new one is only taken when the palettes have changed.
+  // frames alternate between the two halves, so the lines of the last frame not drawn again yet keep their colours.
+  // only lines drawn out of order can run out, the lines drawn before that then show later palettes
+  bool cgb = m_system->InCGBMode();
+  if (LINE == 0)
+    m_palette_snapshot_base = SCREEN_HEIGHT - m_palette_snapshot_base;
+  if (LINE == 0 || m_num_palette_snapshots == SCREEN_HEIGHT)
+    m_num_palette_snapshots = 0;
+
+  if (m_num_palette_snapshots == 0 || m_palettes_dirty || m_palette_snapshot_cgb != cgb)
+  {
+    // slots 0-31 are the background palettes and 32-63 the sprite palettes, the dmg only has the first three
+    uint32* palette = m_palette_snapshots[m_palette_snapshot_base + m_num_palette_snapshots++];
+    if (cgb)
+    {
+      for (uint32 i = 0; i < 32; i++)
+      {
+        palette[i] = ReadCGBPalette(m_cgb_bg_palette, uint8(i / 4), uint8(i % 4));
+        palette[32 + i] = ReadCGBPalette(m_cgb_sprite_palette, uint8(i / 4), uint8(i % 4));
+      }
+    }
+    else
+    {
+      GetDMGPalettes(&palette[0], &palette[4], &palette[8]);
+    }
+
+    m_palette_snapshot_cgb = cgb;
+    m_palettes_dirty = false;
+  }
+
+  m_line_palettes[LINE] = uint16(m_palette_snapshot_base + m_num_palette_snapshots - 1);
+}
+
+void Display::OutputLine(uint8 LINE, const uint8* line)
+{
+  if (m_indexed_output)
+  {
+    Y_memcpy(&m_index_buffer[LINE * SCREEN_WIDTH], line, SCREEN_WIDTH);
+    m_frame_buffer_stale = true;
+  }
+  else
+  {
+    WriteLineColors(m_frameBuffer + (LINE * SCREEN_WIDTH * 4), line, GetLinePalette(LINE));
+  }
+}
+
+void Display::ResolveLine(uint8 LINE)
+{
+  WriteLineColors(m_frameBuffer + (LINE * SCREEN_WIDTH * 4), &m_index_buffer[LINE * SCREEN_WIDTH],
+                  GetLinePalette(LINE));
+}
+
+const byte* Display::GetFrameBuffer()
+{
+  if (m_frame_buffer_stale)
+  {
+    for (uint32 y = 0; y < SCREEN_HEIGHT; y++)
+      ResolveLine(uint8(y));
+
+    m_frame_buffer_stale = false;
+  }
+
+  return m_frameBuffer;
+}
+
+void Display::SetIndexedOutput(bool enabled)
+{
+  // whatever was drawn indexed so far stays visible
+  GetFrameBuffer();
+  m_indexed_output = enabled;
+}
+
+void Display::SetRendererVerification(bool enabled)
+{
+  m_renderer_verification = enabled;
+  m_verified_frames = 0;
+  m_mismatched_frames = 0;
+  m_frame_hash = FRAME_HASH_SEED;
+  m_reference_frame_hash = FRAME_HASH_SEED;
+}
+
+void Display::RenderScanlineSpans(uint8 LINE)
+{
+  // blank the line
+  uint8 line[LINE_BUFFER_SIZE];
+  SnapshotLinePalette(LINE);
+  if (!IsDisplayEnabled())
+  {
+    Y_memset(line, PALETTE_SLOT_BLANK, sizeof(line));
+    OutputLine(LINE, &line[LINE_BUFFER_PADDING]);
+    return;
+  }
+
+  // read control register
+  uint8 LCDC = m_registers.LCDC;
+  uint8 BG_ENABLE = !!(LCDC & 0x01);
+  uint8 WINDOW_ENABLE = (LCDC >> 5) & 0x1;
+  uint8 SPRITE_ENABLE = !!(LCDC & 0x02);
+
+  // background colour indices and the palette slot of every pixel, the dmg has no background priority so it is zero
+  // palette slots are 0-3 background, 4-7 sprite palette 0, 8-11 sprite palette 1
+  uint8 bg_index[LINE_BUFFER_SIZE];
+  uint8 bg_priority[LINE_BUFFER_SIZE];
+  if (BG_ENABLE || WINDOW_ENABLE)
+  {
+    FetchBackgroundLine(LINE, bg_index, line, bg_priority);
+  }
+  else
+  {
+    // background off is white, and never in front of sprites
+    Y_memzero(bg_index, sizeof(bg_index));
+    Y_memzero(bg_priority, sizeof(bg_priority));
+    Y_memset(line, PALETTE_SLOT_BLANK, sizeof(line));
+  }
+
+  // sprites are drawn lowest priority first, so the highest priority one ends up on top
+  if (SPRITE_ENABLE)
+  {
+    uint32 num_active_sprites;
+    const OAM_ENTRY* active_sprites = GetLineSprites(LINE, &num_active_sprites);
+    for (uint32 i = num_active_sprites; i > 0; i--)
+    {
+      const OAM_ENTRY* sprite = &active_sprites[i - 1];
+      const uint8* sprite_row = GetSpriteRow(sprite, LINE, 0);
+      uint32 x = sprite->x; // left edge is x - 8, the line buffer is offset by 8
+      CompositeSpriteRow(&line[x], sprite_row, &bg_index[x], &bg_priority[x], sprite->priority != 0,
+                         uint8(4 + sprite->palette * 4));
+    }
+  }
+
+  OutputLine(LINE, &line[LINE_BUFFER_PADDING]);
+}
+
+void Display::RenderScanlineSpans_CGB(uint8 LINE)
+{
+  // blank the line
+  uint8 line[LINE_BUFFER_SIZE];
+  SnapshotLinePalette(LINE);
+  if (!IsDisplayEnabled())
+  {
+    Y_memset(line, PALETTE_SLOT_BLANK, sizeof(line));
+    OutputLine(LINE, &line[LINE_BUFFER_PADDING]);
+    return;
+  }
+
+  // the background is always drawn on the cgb, tile attributes pick the palette and priority
+  // palette slots are 0-31 the background palettes and 32-63 the sprite palettes
+  uint8 bg_index[LINE_BUFFER_SIZE];
+  uint8 bg_priority[LINE_BUFFER_SIZE];
+  FetchBackgroundLine(LINE, bg_index, line, bg_priority);
+
+  // sprites are drawn lowest priority first, so the highest priority one ends up on top
+  if (m_registers.LCDC & 0x02)
+  {
+    uint32 num_active_sprites;
+    const OAM_ENTRY* active_sprites = GetLineSprites(LINE, &num_active_sprites);
+    for (uint32 i = num_active_sprites; i > 0; i--)
+    {
+      const OAM_ENTRY* sprite = &active_sprites[i - 1];
+      const uint8* sprite_row = GetSpriteRow(sprite, LINE, sprite->cgb_bank);
+      uint32 x = sprite->x; // left edge is x - 8, the line buffer is offset by 8
+      CompositeSpriteRow(&line[x], sprite_row, &bg_index[x], &bg_priority[x], sprite->priority != 0,
+                         uint8(32 + sprite->cgb_palette * 4));
+    }
+  }
+
+  OutputLine(LINE, &line[LINE_BUFFER_PADDING]);
+}
+
 void Display::ClearFrameBuffer()
 {
   Y_memset(m_frameBuffer, 0xFF, sizeof(m_frameBuffer));
+  Y_memset(m_index_buffer, PALETTE_SLOT_BLANK, sizeof(m_index_buffer));
+  Y_memzero(m_line_palettes, sizeof(m_line_palettes));
+  m_frame_buffer_stale = false;
 }
 
 void Display::PutPixel(uint32 x, uint32 y, uint32 color)
@@ -1082,12 +1559,32 @@ void Display::PutPixel(uint32 x, uint32 y, uint32 color)
 
 void Display::PushFrame()
 {
-  if (m_system->m_callbacks != nullptr)
+  if (m_renderer_verification)
+  {
+    if (m_frame_hash != m_reference_frame_hash)
+    {
+      if (m_mismatched_frames == 0)
+        Log_WarningPrintf("Frame %u differs from the reference renderer", m_system->GetFrameCounter());
+
+      m_mismatched_frames++;
+    }
+
+    m_verified_frames++;
+    m_frame_hash = FRAME_HASH_SEED;
+    m_reference_frame_hash = FRAME_HASH_SEED;
+  }
+
+  // indexed frames are left for the owner to read
+  if (m_system->m_callbacks != nullptr && m_rendering_enabled && !m_indexed_output)
     m_system->m_callbacks->PresentDisplayBuffer(m_frameBuffer, SCREEN_WIDTH * 4);
 
   m_system->m_frame_counter++;
   m_system->m_frames_since_speed_update++;
+  Y_memcpy(m_system->m_frame_event_counts, m_system->m_event_counts, sizeof(m_system->m_frame_event_counts));
+  Y_memzero(m_system->m_event_counts, sizeof(m_system->m_event_counts));
   m_system->m_last_vblank_clocks = m_system->m_clocks_since_reset;
+  if (m_system->m_execute_stop_at_vblank)
+    m_system->StopExecution();
   // Log_DevPrintf("SCX: %u, SCY: %u", m_registers.SCX, m_registers.SCY);
 
   // static Timer timer;
@@ -1103,23 +1600,18 @@ void Display::DisplayTiles()
   uint32 draw_y = 0;
 
   Y_memzero(m_frameBuffer, sizeof(m_frameBuffer));
+  m_frame_buffer_stale = false;
 
   for (uint32 bank = 0; bank < 2; bank++)
   {
     for (uint32 tile = 0; tile < 192; tile++)
     {
+      uint32 tile_index = (tile <= 64) ? tile : (128 + tile);
       for (uint8 y = 0; y < 8; y++)
       {
+        const uint8* row = GetTileRow(uint8(bank), tile_index, y, false);
         for (uint8 x = 0; x < 8; x++)
-        {
-          uint8 paletteidx;
-          if (tile <= 64)
-            paletteidx = ReadTile(bank, false, tile, x, y);
-          else
-            paletteidx = ReadTile(bank, true, -128 + (int32)(tile), x, y);
-
-          PutPixel(draw_x + x, draw_y + y, grayscale_colors[paletteidx]);
-        }
+          PutPixel(draw_x + x, draw_y + y, grayscale_colors[row[x]]);
       }
 
       draw_x += 8;
@@ -1142,12 +1634,7 @@ void Display::DisplayTiles()
 void Display::RenderFull()
 {
   for (uint32 y = 0; y < SCREEN_HEIGHT; y++)
-  {
-    if (m_system->InCGBMode())
-      RenderScanline_CGB((uint8)y);
-    else
-      RenderScanline((uint8)y);
-  }
+    DrawScanline((uint8)y);
 
   PushFrame();
 }
@@ -16,6 +16,14 @@ public:
   static const uint32 SCREEN_WIDTH = 160;
   static const uint32 SCREEN_HEIGHT = 144;
 
+  // sprites in oam, and the ones drawn on one line outside cgb mode
+  static const uint32 NUM_OAM_SPRITES = 40;
+  static const uint32 MAX_SPRITES_PER_LINE = 10;
+
+  // tile data is the first 0x1800 bytes of each vram bank, 16 bytes per tile
+  static const uint32 TILE_DATA_SIZE = 0x1800;
+  static const uint32 NUM_TILES = TILE_DATA_SIZE / 16;
+
   struct Registers
   {
     uint8 LCDC;
@@ -44,10 +52,45 @@ public:
   Display(System* system);
   ~Display();
 
-  const byte* GetFrameBuffer() const { return m_frameBuffer; }
+  // palette slots of the indexed output are palette number * 4 + colour index. the dmg uses palette 0 for the
+  // background and 1-2 for the sprites, the cgb 0-7 for the background and 8-15 for the sprites.
+  static const uint32 PALETTE_SLOT_BLANK = 64;
+  static const uint32 NUM_PALETTE_SLOTS = 65;
+
+  // RGBA framebuffer, converted from the indexed output first when that is in use
+  const byte* GetFrameBuffer();
   const bool GetFrameReady() const { return m_frameReady; }
   void ClearFrameReady() { m_frameReady = false; }
 
+  // with rendering off the display still runs but the framebuffer is neither drawn nor presented
+  bool GetRenderingEnabled() const { return m_rendering_enabled; }
+  void SetRenderingEnabled(bool enabled) { m_rendering_enabled = enabled; }
+
+  // scanline renderer, the span renderer composes whole lines and is checked against the per-pixel reference one
+  DISPLAY_RENDERER GetRenderer() const { return m_renderer; }
+  void SetRenderer(DISPLAY_RENDERER renderer) { m_renderer = renderer; }
+
+  // with verification on every line is also drawn by the reference renderer, and frames where the two differ counted
+  bool GetRendererVerification() const { return m_renderer_verification; }
+  void SetRendererVerification(bool enabled);
+  uint32 GetVerifiedFrameCount() const { return m_verified_frames; }
+  uint32 GetMismatchedFrameCount() const { return m_mismatched_frames; }
+
+  // with indexed output, lines are written as one palette slot per pixel with a snapshot of the palettes they used,
+  // and only converted to colours when the framebuffer is asked for. lines are always drawn by the span renderer, and
+  // frames are not presented through the callbacks.
+  bool GetIndexedOutput() const { return m_indexed_output; }
+  void SetIndexedOutput(bool enabled);
+  const uint8* GetIndexBuffer() const { return m_index_buffer; }
+  const uint32* GetLinePalette(uint32 line) const { return m_palette_snapshots[m_line_palettes[line]]; }
+
+  // cgb colours go through a table per correction, so switching costs nothing per pixel
+  DISPLAY_COLOR_CORRECTION GetColorCorrection() const { return m_color_correction; }
+  void SetColorCorrection(DISPLAY_COLOR_CORRECTION correction);
+
+  // draws every line with the current registers and presents it, for benchmarking
+  void RenderFull();
+
   // current scanline access
   const uint32 GetCurrentScanLine() const { return m_currentScanLine; }
 
@@ -61,10 +104,27 @@ public:
   // step
   void Synchronize();
 
+  // tile cache invalidation, anything writing to vram outside of the cpu write path has to call these
+  void InvalidateCachedTile(uint8 bank, uint16 offset)
+  {
+    if (offset < TILE_DATA_SIZE)
+      m_tile_cache_dirty[bank][offset / 16] = true;
+  }
+  void InvalidateCachedTiles(uint8 bank, uint16 offset, uint32 length);
+  void InvalidateTileCache();
+
+  // the per-line sprite lists are built again from oam on the next line drawn, anything writing oam has to call this
+  void InvalidateSpriteBins() { m_sprite_bins_dirty = true; }
+
 private:
   void RenderScanline(uint8 LINE);
   void RenderScanline_CGB(uint8 LINE);
-  void RenderFull();
+  void RenderScanlineSpans(uint8 LINE);
+  void RenderScanlineSpans_CGB(uint8 LINE);
+  void DrawScanline(uint8 LINE);
+  void SnapshotLinePalette(uint8 LINE);
+  void OutputLine(uint8 LINE, const uint8* line);
+  void ResolveLine(uint8 LINE);
   void DumpTiles(uint8 tilemap);
   void DisplayTiles();
   void PushFrame();
@@ -82,19 +142,60 @@ private:
   bool LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError);
   void SaveState(ByteStream* pStream, BinaryWriter& binaryWriter);
 
+  // machine state for System::Snapshot, the hdma transfer is restored with the event queue
+  struct SnapshotState
+  {
+    Registers registers;
+    uint8 cgb_bg_palette[64];
+    uint8 cgb_sprite_palette[64];
+    DISPLAY_STATE state;
+    uint32 mode_clocks_remaining;
+    uint32 cycles_since_vblank;
+    uint64 last_cycle;
+    uint8 current_scanline;
+  };
+  void SaveSnapshot(SnapshotState* state) const;
+  void LoadSnapshot(const SnapshotState* state);
+
   // framebuffer ops
   void ClearFrameBuffer();
   void PutPixel(uint32 x, uint32 y, uint32 color);
 
-  // returns index into palette
-  uint8 ReadTile(uint8 bank, bool high_tileset, int32 tile, uint8 x, uint8 y) const;
-  uint32 ReadCGBPalette(const uint8* palette, uint8 palette_index, uint8 color_index) const;
+  // index into the tile data of a tile number from a tilemap or oam, the high tileset numbers tiles from 0x9000 signed
+  static uint32 GetTileIndex(bool high_tileset, uint8 tile) { return high_tileset ? uint32(256 + int8(tile)) : tile; }
+
+  // row y of a tile as one palette index per pixel, mirrored if hflip is set
+  const uint8* GetTileRow(uint8 bank, uint32 tile_index, uint32 y, bool hflip)
+  {
+    if (m_tile_cache_dirty[bank][tile_index])
+      DecodeTile(bank, tile_index);
 
-  // HDMA transfer
+    return &m_tile_cache[bank][tile_index][hflip ? 1 : 0][y * 8];
+  }
+  void DecodeTile(uint8 bank, uint32 tile_index);
+  uint32 ReadCGBPalette(const uint8* palette, uint8 palette_index, uint8 color_index) const
+  {
+    DebugAssert(palette_index < 8 && color_index < 4);
+    const uint8* start = &palette[palette_index * 8 + color_index * 2];
+    return m_cgb_color_table[((uint32)start[0] | ((uint32)start[1] << 8)) & 0x7FFF];
+  }
+  void GetDMGPalettes(uint32 background_palette[4], uint32 obj_palette0[4], uint32 obj_palette1[4]) const;
+
+  // sprites on the line in the order they are drawn, highest priority first
+  const OAM_ENTRY* GetLineSprites(uint8 LINE, uint32* num_sprites);
+  void BinSprites();
+  const uint8* GetSpriteRow(const OAM_ENTRY* sprite, uint8 LINE, uint8 bank);
+
+  // background and window colour indices, palette slots and bg-to-oam priority for a whole line, in line buffers
+  void FetchBackgroundLine(uint8 LINE, uint8* bg_index, uint8* line, uint8* bg_priority);
+  void FetchBackgroundTile(uint32 tilemap_address, uint32 y, uint8* bg_index, uint8* line, uint8* bg_priority);
+
+  // HDMA transfer, the cpu is re-enabled when SYSTEM_EVENT_HDMA fires
   void ExecuteHDMATransferBlock(uint32 bytes);
+  void EndHDMATransfer();
 
   System* m_system;
-  uint32 m_last_cycle;
+  uint64 m_last_cycle;
 
   // registers - use a struct here?
   Registers m_registers;
@@ -102,14 +203,47 @@ private:
   // CGB palette
   uint8 m_cgb_bg_palette[64];
   uint8 m_cgb_sprite_palette[64];
+  DISPLAY_COLOR_CORRECTION m_color_correction;
+  const uint32* m_cgb_color_table;
 
   // state
   DISPLAY_STATE m_state;
   uint32 m_modeClocksRemaining;
-  uint32 m_HDMATransferClocksRemaining;
   uint32 m_cyclesSinceVBlank;
   uint8 m_currentScanLine;
 
+  // every tile of both banks decoded to palette indices, as drawn and horizontally flipped. tiles are decoded again
+  // on first use after being written.
+  uint8 m_tile_cache[2][NUM_TILES][2][64];
+  bool m_tile_cache_dirty[2][NUM_TILES];
+
+  // sprites of every line in priority order, binned once from oam and again only after it or the sprite size changes
+  OAM_ENTRY m_sprite_bins[SCREEN_HEIGHT][NUM_OAM_SPRITES];
+  uint8 m_sprite_bin_counts[SCREEN_HEIGHT];
+  uint8 m_sprite_bins_size;
+  bool m_sprite_bins_cgb;
+  bool m_sprite_bins_dirty;
+
   byte m_frameBuffer[SCREEN_WIDTH * SCREEN_HEIGHT * 4]; // RGBA
+  uint8 m_index_buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+  bool m_indexed_output;
+  bool m_frame_buffer_stale;
+
+  // colours of every palette slot, snapshotted when a line is drawn after the palettes changed. the current frame
+  // takes its snapshots from the half starting at m_palette_snapshot_base, the last frame's lines use the other half.
+  uint32 m_palette_snapshots[2 * SCREEN_HEIGHT][NUM_PALETTE_SLOTS];
+  uint16 m_line_palettes[SCREEN_HEIGHT];
+  uint32 m_palette_snapshot_base;
+  uint32 m_num_palette_snapshots;
+  bool m_palette_snapshot_cgb;
+  bool m_palettes_dirty;
   bool m_frameReady;
+  bool m_rendering_enabled;
+
+  DISPLAY_RENDERER m_renderer;
+  bool m_renderer_verification;
+  uint64 m_frame_hash;
+  uint64 m_reference_frame_hash;
+  uint32 m_verified_frames;
+  uint32 m_mismatched_frames;
 };
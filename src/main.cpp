@@ -8,8 +8,12 @@
 
 #include "audio.h"
 #include "cartridge.h"
+#include "cpu.h"
 #include "display.h"
 #include "link.h"
+#include "movie.h"
+#include "rewind.h"
+#include "serial.h"
 #include "system.h"
 
 #include "YBaseLib/AutoReleasePtr.h"
@@ -21,7 +25,9 @@
 #include "YBaseLib/FileSystem.h"
 #include "YBaseLib/Log.h"
 #include "YBaseLib/Math.h"
+#include "YBaseLib/Memory.h"
 #include "YBaseLib/Platform.h"
+#include "YBaseLib/StringConverter.h"
 #include "YBaseLib/Thread.h"
 
 #include "imgui_impl.h"
@@ -38,7 +44,30 @@ struct ProgramArgs
   bool accurate_timing;
   bool frame_limiter;
   bool enable_audio;
+  uint32 audio_buffer_ms;
+  uint32 audio_latency_ms;
+  uint32 audio_sync_ms;
   bool enable_hqx;
+  CPU_BACKEND cpu_backend;
+  bool idle_loop_skipping;
+  bool accurate_oam_dma;
+  DISPLAY_COLOR_CORRECTION color_correction;
+  uint32 benchmark_frames;
+  uint32 alu_benchmark_frames;
+  uint32 timer_benchmark_frames;
+  uint32 oam_dma_benchmark_frames;
+  uint32 differential_frames;
+  uint32 verify_idle_frames;
+  uint32 snapshot_benchmark_iterations;
+  uint32 render_benchmark_iterations;
+  uint32 rewind_memory_mb;
+  uint32 rewind_interval;
+  uint32 run_ahead_frames;
+  const char* movie_record_filename;
+  int32 movie_record_slot;
+  const char* movie_play_filename;
+  uint32 movie_seek_frame;
+  uint32 movie_keyframe_interval;
 };
 
 struct State : public System::CallbackInterface
@@ -49,6 +78,17 @@ struct State : public System::CallbackInterface
 
   System* system;
 
+  // rewind, nullptr when disabled. audio is muted while rewinding.
+  RewindBuffer* rewind;
+  bool rewinding;
+  bool rewind_audio_enabled;
+
+  // input movie, nullptr when not used. while one is active the pad is latched and applied a frame at a time.
+  Movie* movie;
+  const char* movie_filename;
+  uint8 pad_button_state;
+  uint8 pad_direction_state;
+
   SDL_Window* window;
   SDL_GLContext gl_context;
 
@@ -65,6 +105,7 @@ struct State : public System::CallbackInterface
   uint32 hq_scale;
 
   SDL_AudioDeviceID audio_device_id;
+  SDL_sem* audio_read_semaphore;
 
   String savestate_prefix;
 
@@ -98,6 +139,49 @@ struct State : public System::CallbackInterface
     FileSystem::BuildPathRelativeToFile(savestate_prefix, savestate_prefix, savestate_prefix_filepart, true, true);
   }
 
+  bool IsMovieActive() const { return (movie != nullptr && (movie->IsRecording() || movie->IsPlaying())); }
+
+  void SetPadDirection(PAD_DIRECTION direction, bool down)
+  {
+    pad_direction_state = down ? (pad_direction_state | direction) : (pad_direction_state & ~direction);
+    if (!IsMovieActive())
+      system->SetPadDirection(direction, down);
+  }
+
+  void SetPadButton(PAD_BUTTON button, bool down)
+  {
+    pad_button_state = down ? (pad_button_state | button) : (pad_button_state & ~button);
+    if (!IsMovieActive())
+      system->SetPadButton(button, down);
+  }
+
+  bool SaveMovie()
+  {
+    ByteStream* pStream =
+      FileSystem::OpenFile(movie_filename, BYTESTREAM_OPEN_CREATE | BYTESTREAM_OPEN_CREATE_PATH | BYTESTREAM_OPEN_WRITE |
+                                             BYTESTREAM_OPEN_TRUNCATE | BYTESTREAM_OPEN_STREAMED |
+                                             BYTESTREAM_OPEN_ATOMIC_UPDATE);
+    if (pStream == nullptr)
+    {
+      Log_ErrorPrintf("Failed to save movie '%s': could not open file", movie_filename);
+      return false;
+    }
+
+    if (!movie->Save(pStream))
+    {
+      Log_ErrorPrintf("Failed to save movie '%s': save error", movie_filename);
+      pStream->Discard();
+      pStream->Release();
+      return false;
+    }
+
+    Log_InfoPrintf("Movie '%s' saved, %u frames and %u keyframes.", movie_filename, movie->GetFrameCount(),
+                   movie->GetKeyframeCount());
+    pStream->Commit();
+    pStream->Release();
+    return true;
+  }
+
   static void AudioCallback(void* pThis, uint8* stream, int length)
   {
     State* pState = (State*)pThis;
@@ -108,6 +192,9 @@ struct State : public System::CallbackInterface
     size_t i = audio->ReadSamples(samples, nsamples);
     if (i < nsamples)
       Y_memzero(samples + i, (nsamples - i) * 2);
+
+    // wakes the main loop if it is waiting for the queue to drain
+    SDL_SemPost(pState->audio_read_semaphore);
   }
 
   void ReallocateGPUTexture(uint32 scale, bool force = true)
@@ -199,6 +286,14 @@ struct State : public System::CallbackInterface
       if (ImGui::MenuItem("Accurate Timing", nullptr, &boolOption))
         system->SetAccurateTiming(boolOption);
 
+      boolOption = system->GetAccurateOAMDMA();
+      if (ImGui::MenuItem("Accurate OAM DMA", nullptr, &boolOption))
+        system->SetAccurateOAMDMA(boolOption);
+
+      boolOption = system->GetIdleLoopSkipping();
+      if (ImGui::MenuItem("Skip Idle Loops", nullptr, &boolOption))
+        system->SetIdleLoopSkipping(boolOption);
+
       boolOption = system->GetFrameLimiter();
       if (ImGui::MenuItem("Frame Limiter", nullptr, &boolOption))
         system->SetFrameLimiter(boolOption);
@@ -222,6 +317,20 @@ struct State : public System::CallbackInterface
         ImGui::EndMenu();
       }
 
+      if (ImGui::BeginMenu("Color Correction"))
+      {
+        static const char* correction_names[NUM_DISPLAY_COLOR_CORRECTIONS] = {"Raw", "LCD Gamma", "GBC Screen"};
+        Display* display = system->GetDisplay();
+        for (uint32 i = 0; i < NUM_DISPLAY_COLOR_CORRECTIONS; i++)
+        {
+          DISPLAY_COLOR_CORRECTION correction = DISPLAY_COLOR_CORRECTION(i);
+          if (ImGui::MenuItem(correction_names[i], nullptr, (display->GetColorCorrection() == correction)))
+            display->SetColorCorrection(correction);
+        }
+
+        ImGui::EndMenu();
+      }
+
       ImGui::Separator();
 
       if (ImGui::MenuItem("Host Link Server"))
@@ -248,12 +357,26 @@ struct State : public System::CallbackInterface
     {
       ImGui::SetNextWindowPos(ImVec2(4.0f, 4.0f), ImGuiSetCond_FirstUseEver);
 
-      if (ImGui::Begin("Info Window", &show_info_window, ImVec2(148.0f, 48.0f), 0.5f,
+      if (ImGui::Begin("Info Window", &show_info_window, ImVec2(200.0f, 64.0f), 0.5f,
                        ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove |
                          ImGuiWindowFlags_NoSavedSettings))
       {
         ImGui::Text("Frame %u (%.0f%%)", system->GetFrameCounter() + 1, system->GetCurrentSpeed() * 100.0f);
         ImGui::Text("%.2f FPS", system->GetCurrentFPS());
+        if (system->GetAudioEnabled())
+        {
+          Audio::OutputStats audio_stats;
+          system->GetAudio()->GetOutputStats(&audio_stats);
+          float buffered_ms = float(audio_stats.buffered_samples) / (44100.0f * 2.0f / 1000.0f);
+          ImGui::Text("Audio %.0f ms %+.2f%% (%u/%u)", buffered_ms, (audio_stats.rate_ratio - 1.0f) * 100.0f,
+                      audio_stats.overruns, audio_stats.underruns);
+        }
+        if (rewind != nullptr)
+          ImGui::Text("Rewind %u (%.1f MB)", rewind->GetStateCount(), rewind->GetMemoryUsed() / 1048576.0f);
+        if (movie != nullptr && movie->IsRecording())
+          ImGui::Text("Recording %u", movie->GetCurrentFrame());
+        else if (movie != nullptr && movie->IsPlaying())
+          ImGui::Text("Playing %u/%u", movie->GetCurrentFrame(), movie->GetFrameCount());
         ImGui::End();
       }
     }
@@ -342,6 +465,13 @@ struct State : public System::CallbackInterface
 
   bool LoadState(uint32 index)
   {
+    // the movie would no longer match what the game is doing
+    if (IsMovieActive())
+    {
+      Log_ErrorPrintf("Can't load a save state while a movie is recording or playing.");
+      return false;
+    }
+
     SmallString filename;
     filename.Format("%s_%02u.savestate", savestate_prefix.GetCharArray(), index);
     Log_DevPrintf("Savestate filename: '%s'", filename.GetCharArray());
@@ -461,6 +591,10 @@ struct State : public System::CallbackInterface
 
   virtual void SaveCartridgeRAM(const void* pData, size_t data_size) override final
   {
+    // played back saves are the movie's, not the player's
+    if (movie != nullptr && movie->IsPlaying())
+      return;
+
     SmallString filename;
     filename.Format("%s.sram", savestate_prefix.GetCharArray());
     Log_DevPrintf("Cartridge SRAM filename: '%s'", filename.GetCharArray());
@@ -515,6 +649,9 @@ struct State : public System::CallbackInterface
 
   virtual void SaveCartridgeRTC(const void* pData, size_t data_size) override final
   {
+    if (movie != nullptr && movie->IsPlaying())
+      return;
+
     SmallString filename;
     filename.Format("%s.rtc", savestate_prefix.GetCharArray());
     Log_DevPrintf("Cartridge RTC filename: '%s'", filename.GetCharArray());
@@ -610,7 +747,18 @@ static bool LoadCart(const char* filename, State* state)
 static void ShowUsage(const char* progname)
 {
   fprintf(stderr, "gbe\n");
-  fprintf(stderr, "usage: %s [-h] [-bios <bios file>] [-nobios] [-permissivememory] [cart file]\n", progname);
+  fprintf(stderr,
+          "usage: %s [-h] [-bios <bios file>] [-nobios] [-permissivememory] "
+          "[-cpu <interpreter|threaded|cached|recompiler>] [-noidleskip] [-accurateoamdma] "
+          "[-colorcorrection <raw|gamma|gbc>] [-audiobuffer <ms>] [-audiolatency <ms>] "
+          "[-audiosync <ms>] [-benchmark <frames>] "
+          "[-alubenchmark <frames>] [-timerbenchmark <frames>] [-oamdmabenchmark <frames>] "
+          "[-differential <frames>] [-verifyidle <frames>] [-snapshotbenchmark <iterations>] "
+          "[-renderbenchmark <iterations>] "
+          "[-rewind <megabytes>] [-rewindinterval <frames>] [-runahead <frames>] "
+          "[-record <movie file>] [-recordslot <slot>] [-play <movie file>] [-seek <frame>] "
+          "[-keyframeinterval <frames>] [cart file]\n",
+          progname);
 }
 
 static bool ParseArguments(int argc, char* argv[], ProgramArgs* out_args)
@@ -624,9 +772,32 @@ static bool ParseArguments(int argc, char* argv[], ProgramArgs* out_args)
   out_args->disable_bios = false;
   out_args->permissive_memory = false;
   out_args->accurate_timing = true;
+  out_args->accurate_oam_dma = false;
+  out_args->color_correction = DISPLAY_COLOR_CORRECTION_RAW;
   out_args->frame_limiter = true;
   out_args->enable_audio = true;
+  out_args->audio_buffer_ms = 250;
+  out_args->audio_latency_ms = 0;
+  out_args->audio_sync_ms = 0;
   out_args->enable_hqx = false;
+  out_args->cpu_backend = CPU_BACKEND_INTERPRETER;
+  out_args->idle_loop_skipping = true;
+  out_args->benchmark_frames = 0;
+  out_args->alu_benchmark_frames = 0;
+  out_args->timer_benchmark_frames = 0;
+  out_args->oam_dma_benchmark_frames = 0;
+  out_args->differential_frames = 0;
+  out_args->verify_idle_frames = 0;
+  out_args->snapshot_benchmark_iterations = 0;
+  out_args->render_benchmark_iterations = 0;
+  out_args->rewind_memory_mb = 0;
+  out_args->rewind_interval = 1;
+  out_args->run_ahead_frames = 0;
+  out_args->movie_record_filename = nullptr;
+  out_args->movie_record_slot = -1;
+  out_args->movie_play_filename = nullptr;
+  out_args->movie_seek_frame = 0;
+  out_args->movie_keyframe_interval = 1800;
 
   for (int i = 1; i < argc; i++)
   {
@@ -684,6 +855,37 @@ static bool ParseArguments(int argc, char* argv[], ProgramArgs* out_args)
     {
       out_args->accurate_timing = false;
     }
+    else if (CHECK_ARG("-accurateoamdma"))
+    {
+      out_args->accurate_oam_dma = true;
+    }
+    else if (CHECK_ARG_PARAM("-colorcorrection"))
+    {
+      i++;
+      if (!Y_stricmp(argv[i], "raw"))
+        out_args->color_correction = DISPLAY_COLOR_CORRECTION_RAW;
+      else if (!Y_stricmp(argv[i], "gamma"))
+        out_args->color_correction = DISPLAY_COLOR_CORRECTION_GAMMA;
+      else if (!Y_stricmp(argv[i], "gbc"))
+        out_args->color_correction = DISPLAY_COLOR_CORRECTION_GBC_LCD;
+      else
+      {
+        fprintf(stderr, "Unknown color correction: '%s'", argv[i]);
+        return false;
+      }
+    }
+    else if (CHECK_ARG_PARAM("-audiobuffer"))
+    {
+      out_args->audio_buffer_ms = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-audiolatency"))
+    {
+      out_args->audio_latency_ms = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-audiosync"))
+    {
+      out_args->audio_sync_ms = StringConverter::StringToUInt32(argv[++i]);
+    }
     else if (CHECK_ARG("-audio"))
     {
       out_args->enable_audio = true;
@@ -700,6 +902,95 @@ static bool ParseArguments(int argc, char* argv[], ProgramArgs* out_args)
     {
       out_args->enable_hqx = false;
     }
+    else if (CHECK_ARG_PARAM("-cpu"))
+    {
+      i++;
+      if (!Y_stricmp(argv[i], "interpreter"))
+        out_args->cpu_backend = CPU_BACKEND_INTERPRETER;
+      else if (!Y_stricmp(argv[i], "threaded"))
+        out_args->cpu_backend = CPU_BACKEND_THREADED_INTERPRETER;
+      else if (!Y_stricmp(argv[i], "cached"))
+        out_args->cpu_backend = CPU_BACKEND_CACHED_INTERPRETER;
+      else if (!Y_stricmp(argv[i], "recompiler"))
+        out_args->cpu_backend = CPU_BACKEND_RECOMPILER;
+      else
+      {
+        fprintf(stderr, "Unknown cpu backend: '%s'", argv[i]);
+        return false;
+      }
+    }
+    else if (CHECK_ARG("-idleskip"))
+    {
+      out_args->idle_loop_skipping = true;
+    }
+    else if (CHECK_ARG("-noidleskip"))
+    {
+      out_args->idle_loop_skipping = false;
+    }
+    else if (CHECK_ARG_PARAM("-benchmark"))
+    {
+      out_args->benchmark_frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-alubenchmark"))
+    {
+      out_args->alu_benchmark_frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-timerbenchmark"))
+    {
+      out_args->timer_benchmark_frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-oamdmabenchmark"))
+    {
+      out_args->oam_dma_benchmark_frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-differential"))
+    {
+      out_args->differential_frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-verifyidle"))
+    {
+      out_args->verify_idle_frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-snapshotbenchmark"))
+    {
+      out_args->snapshot_benchmark_iterations = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-renderbenchmark"))
+    {
+      out_args->render_benchmark_iterations = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-rewind"))
+    {
+      out_args->rewind_memory_mb = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-rewindinterval"))
+    {
+      out_args->rewind_interval = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-runahead"))
+    {
+      out_args->run_ahead_frames = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-record"))
+    {
+      out_args->movie_record_filename = argv[++i];
+    }
+    else if (CHECK_ARG_PARAM("-recordslot"))
+    {
+      out_args->movie_record_slot = StringConverter::StringToInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-play"))
+    {
+      out_args->movie_play_filename = argv[++i];
+    }
+    else if (CHECK_ARG_PARAM("-seek"))
+    {
+      out_args->movie_seek_frame = StringConverter::StringToUInt32(argv[++i]);
+    }
+    else if (CHECK_ARG_PARAM("-keyframeinterval"))
+    {
+      out_args->movie_keyframe_interval = StringConverter::StringToUInt32(argv[++i]);
+    }
     else
     {
       out_args->cart_filename = argv[i];
@@ -852,6 +1143,13 @@ static bool InitializeState(const ProgramArgs* args, State* state)
   state->bios_length = 0;
   state->cart = nullptr;
   state->system = nullptr;
+  state->rewind = nullptr;
+  state->rewinding = false;
+  state->rewind_audio_enabled = false;
+  state->movie = nullptr;
+  state->movie_filename = nullptr;
+  state->pad_button_state = 0;
+  state->pad_direction_state = 0;
   state->texture = 0;
   state->display_vertex_shader = 0;
   state->display_fragment_shader = 0;
@@ -863,6 +1161,7 @@ static bool InitializeState(const ProgramArgs* args, State* state)
   state->hq_texture_buffer_stride = 0;
   state->hq_scale = 0;
   state->audio_device_id = 0;
+  state->audio_read_semaphore = nullptr;
   state->enable_hqx = args->enable_hqx;
   state->running = true;
   state->needs_redraw = false;
@@ -924,9 +1223,11 @@ static bool InitializeState(const ProgramArgs* args, State* state)
   if (!ImGui_Impl_Init(state->window))
     return false;
 
-  // create audio device
-  SDL_AudioSpec audio_spec = {44100, AUDIO_S16, 2, 0, 2048, 0, 0, &State::AudioCallback, (void*)state};
+  // create audio device, audio sync needs the device to read in pieces well under the latency it keeps queued
+  uint16 audio_device_samples = (args->audio_sync_ms > 0) ? 512 : 2048;
+  SDL_AudioSpec audio_spec = {44100, AUDIO_S16, 2, 0, audio_device_samples, 0, 0, &State::AudioCallback, (void*)state};
   SDL_AudioSpec obtained_audio_spec;
+  state->audio_read_semaphore = SDL_CreateSemaphore(0);
   state->audio_device_id = SDL_OpenAudioDevice(nullptr, 0, &audio_spec, &obtained_audio_spec, 0);
   if (state->audio_device_id == 0)
     Log_WarningPrintf("Failed to open audio device (error: %s). No audio will be heard.", SDL_GetError());
@@ -954,16 +1255,84 @@ static bool InitializeState(const ProgramArgs* args, State* state)
     return false;
   }
 
+  // the frontend system is the one attached to the link cable
+  state->system->GetSerial()->SetLinkConnectionManager(&LinkConnectionManager::GetInstance());
+
   // apply options
   state->system->SetPermissiveMemoryAccess(args->permissive_memory);
   state->system->SetAccurateTiming(args->accurate_timing);
   state->system->SetAudioEnabled(args->enable_audio);
   state->system->SetFrameLimiter(args->frame_limiter);
+  state->system->SetCPUBackend(args->cpu_backend);
+  state->system->SetIdleLoopSkipping(args->idle_loop_skipping);
+  state->system->SetAccurateOAMDMA(args->accurate_oam_dma);
+  state->system->GetDisplay()->SetColorCorrection(args->color_correction);
+
+  // the device is still paused here, the callback starts in Run
+  uint32 audio_latency_ms = (args->audio_latency_ms > 0) ? args->audio_latency_ms : args->audio_buffer_ms;
+  state->system->GetAudio()->SetOutputBuffering(args->audio_buffer_ms, audio_latency_ms);
+  state->system->SetAudioSyncLatency(args->audio_sync_ms);
+  if (args->audio_sync_ms > 0)
+    Log_InfoPrintf("Audio sync enabled, keeping %u ms of audio queued.", args->audio_sync_ms);
+
+  // snapshots are sized for the cartridge, so this has to come after init
+  state->system->SetRunAheadFrames(args->run_ahead_frames);
+  if (args->rewind_memory_mb > 0)
+  {
+    state->rewind = new RewindBuffer(state->system, args->rewind_memory_mb * 1024 * 1024, args->rewind_interval);
+    Log_InfoPrintf("Rewind enabled with %u MB, hold backspace to rewind.", args->rewind_memory_mb);
+  }
+
+  if (args->movie_play_filename != nullptr)
+  {
+    AutoReleasePtr<ByteStream> pStream =
+      FileSystem::OpenFile(args->movie_play_filename, BYTESTREAM_OPEN_READ | BYTESTREAM_OPEN_STREAMED);
+    if (pStream == nullptr)
+    {
+      Log_ErrorPrintf("Failed to open movie '%s'", args->movie_play_filename);
+      return false;
+    }
+
+    Error error;
+    state->movie = new Movie(state->system);
+    if (!state->movie->Load(pStream, &error))
+    {
+      Log_ErrorPrintf("Failed to load movie '%s': %s", args->movie_play_filename,
+                      error.GetErrorCodeAndDescription().GetCharArray());
+      return false;
+    }
+
+    if (!state->movie->StartPlayback() || (args->movie_seek_frame > 0 && !state->movie->Seek(args->movie_seek_frame)))
+      return false;
+  }
+  else if (args->movie_record_filename != nullptr)
+  {
+    // from the given save slot, or from power-on
+    if (args->movie_record_slot >= 0 && !state->LoadState(uint32(args->movie_record_slot)))
+      return false;
+
+    state->movie = new Movie(state->system);
+    state->movie_filename = args->movie_record_filename;
+    if (!state->movie->StartRecording((args->movie_record_slot >= 0) ? MOVIE_START_SAVE_STATE : MOVIE_START_POWER_ON,
+                                      args->movie_keyframe_interval))
+    {
+      return false;
+    }
+  }
+
   return true;
 }
 
 static void CleanupState(State* state)
 {
+  if (state->movie != nullptr && state->movie->IsRecording())
+  {
+    state->movie->Stop();
+    state->SaveMovie();
+  }
+
+  delete state->movie;
+  delete state->rewind;
   delete[] state->bios;
   delete state->cart;
   delete state->system;
@@ -979,11 +1348,14 @@ static void CleanupState(State* state)
 
   if (state->audio_device_id != 0)
     SDL_CloseAudioDevice(state->audio_device_id);
+  if (state->audio_read_semaphore != nullptr)
+    SDL_DestroySemaphore(state->audio_read_semaphore);
 }
 
 static int Run(State* state)
 {
   Timer time_since_last_report;
+  uint64 last_run_ahead_frame_count = state->system->GetRunAheadFrameCount();
 
   // resume audio
   if (state->audio_device_id != 0)
@@ -1025,40 +1397,58 @@ static int Run(State* state)
           {
           case SDLK_w:
           case SDLK_UP:
-            state->system->SetPadDirection(PAD_DIRECTION_UP, down);
+            state->SetPadDirection(PAD_DIRECTION_UP, down);
             break;
 
           case SDLK_a:
           case SDLK_LEFT:
-            state->system->SetPadDirection(PAD_DIRECTION_LEFT, down);
+            state->SetPadDirection(PAD_DIRECTION_LEFT, down);
             break;
 
           case SDLK_s:
           case SDLK_DOWN:
-            state->system->SetPadDirection(PAD_DIRECTION_DOWN, down);
+            state->SetPadDirection(PAD_DIRECTION_DOWN, down);
             break;
 
           case SDLK_d:
           case SDLK_RIGHT:
-            state->system->SetPadDirection(PAD_DIRECTION_RIGHT, down);
+            state->SetPadDirection(PAD_DIRECTION_RIGHT, down);
             break;
 
           case SDLK_z:
-            state->system->SetPadButton(PAD_BUTTON_B, down);
+            state->SetPadButton(PAD_BUTTON_B, down);
             break;
 
           case SDLK_x:
-            state->system->SetPadButton(PAD_BUTTON_A, down);
+            state->SetPadButton(PAD_BUTTON_A, down);
             break;
 
           case SDLK_RSHIFT:
-            state->system->SetPadButton(PAD_BUTTON_SELECT, down);
+            state->SetPadButton(PAD_BUTTON_SELECT, down);
             break;
 
           case SDLK_RETURN:
-            state->system->SetPadButton(PAD_BUTTON_START, down);
+            state->SetPadButton(PAD_BUTTON_START, down);
             break;
 
+          case SDLK_BACKSPACE:
+          {
+            if (state->rewind != nullptr && state->rewinding != down && !state->IsMovieActive())
+            {
+              state->rewinding = down;
+              if (down)
+              {
+                state->rewind_audio_enabled = state->system->GetAudioEnabled();
+                state->system->SetAudioEnabled(false);
+              }
+              else
+              {
+                state->system->SetAudioEnabled(state->rewind_audio_enabled);
+              }
+            }
+          }
+          break;
+
           case SDLK_TAB:
           {
             bool new_state = !down;
@@ -1100,7 +1490,8 @@ static int Run(State* state)
     }
 
     // report statistics (done first so to not interfere with sleep time calc)
-    if (time_since_last_report.GetTimeSeconds() >= 1.0)
+    double report_seconds = time_since_last_report.GetTimeSeconds();
+    if (report_seconds >= 1.0)
     {
       state->system->CalculateCurrentSpeed();
       // Log_InfoPrintf("Current frame: %u, emulation speed: %.3f%% (%.2f FPS), target emulation speed: %.3f%%",
@@ -1114,11 +1505,52 @@ static int Run(State* state)
                           (state->cart != nullptr) ? state->cart->GetName().GetCharArray() : "NO CARTRIDGE",
                           state->system->GetFrameCounter() + 1, state->system->GetCurrentSpeed() * 100.0f,
                           state->system->GetCurrentFPS());
+
+      // the speculative frames are on top of the real ones, which is what the speed above counts
+      uint64 run_ahead_frame_count = state->system->GetRunAheadFrameCount();
+      if (state->system->GetRunAheadFrames() > 0)
+      {
+        window_title.AppendFormattedString(" - Run-ahead %u (+%.1f frames/s)", state->system->GetRunAheadFrames(),
+                                           double(run_ahead_frame_count - last_run_ahead_frame_count) / report_seconds);
+      }
+      last_run_ahead_frame_count = run_ahead_frame_count;
       SDL_SetWindowTitle(state->window, window_title);
     }
 
     // run a frame
-    double sleep_time_seconds = state->system->ExecuteFrame();
+    // or step back one, the restored frame is run again to draw it
+    double sleep_time_seconds;
+    if (state->rewinding)
+    {
+      if (state->rewind->RewindState())
+        state->system->RunFrames(1);
+
+      sleep_time_seconds = state->system->GetFrameLimiter() ? (1.0 / 60.0) : 0.0;
+    }
+    else if (state->IsMovieActive())
+    {
+      // movies step whole frames with the latched pad state, run-ahead and accurate timing don't apply
+      Timer frame_timer;
+      if (state->rewind != nullptr)
+        state->rewind->CaptureState();
+
+      if (!state->movie->RunFrame(state->pad_button_state, state->pad_direction_state))
+      {
+        // playback finished, hand the pad back
+        state->system->SetPadButtonState(state->pad_button_state);
+        state->system->SetPadDirectionState(state->pad_direction_state);
+      }
+
+      bool timed = state->system->GetFrameLimiter() && !state->system->IsAudioSyncActive();
+      sleep_time_seconds = timed ? Max((1.0 / 60.0) - frame_timer.GetTimeSeconds(), 0.0) : 0.0;
+    }
+    else
+    {
+      if (state->rewind != nullptr)
+        state->rewind->CaptureState();
+
+      sleep_time_seconds = state->system->ExecuteFrame();
+    }
 
     // needs redraw?
     if (state->needs_redraw)
@@ -1128,6 +1560,32 @@ static int Run(State* state)
       ImGui_Impl_NewFrame();
     }
 
+    // with audio sync the wait depends on how much audio the device took while presenting. the device drains the
+    // queue a buffer at a time, so wait on its reads and carry on at the one that takes it down to the target.
+    double audio_wait_time = (!state->rewinding) ? state->system->GetAudioSyncWaitTime() : 0.0;
+    if (audio_wait_time > 0.0 && state->audio_read_semaphore != nullptr)
+    {
+      // reads from before the wait started don't count
+      while (SDL_SemTryWait(state->audio_read_semaphore) == 0)
+        continue;
+
+      // a stalled device can't hold up the frontend for more than a frame past when the queue should have drained
+      Timer wait_timer;
+      double wait_limit = audio_wait_time + (1.0 / 60.0);
+      while (state->system->GetAudio()->IsOutputAboveWaitLevel())
+      {
+        double remaining_seconds = wait_limit - wait_timer.GetTimeSeconds();
+        if (remaining_seconds <= 0.0)
+          break;
+
+        SDL_SemWaitTimeout(state->audio_read_semaphore, (uint32)std::ceil(remaining_seconds * 1000.0));
+      }
+    }
+    else
+    {
+      sleep_time_seconds = Max(sleep_time_seconds, audio_wait_time);
+    }
+
     // sleep until the next frame
     uint32 sleep_time_ms = (uint32)std::floor(sleep_time_seconds * 1000.0);
     if (sleep_time_ms > 0)
@@ -1141,6 +1599,711 @@ static int Run(State* state)
   return 0;
 }
 
+// systems run without the frontend (differential reference, alu benchmark) have no outputs
+struct NullCallbacks : public System::CallbackInterface
+{
+  virtual void PresentDisplayBuffer(const void* pPixels, uint32 row_stride) override final {}
+  virtual bool LoadCartridgeRAM(void* pData, size_t expected_data_size) override final { return false; }
+  virtual void SaveCartridgeRAM(const void* pData, size_t data_size) override final {}
+  virtual bool LoadCartridgeRTC(void* pData, size_t expected_data_size) override final { return false; }
+  virtual void SaveCartridgeRTC(const void* pData, size_t data_size) override final {}
+};
+
+static int BenchmarkSystem(System* system, uint32 frames)
+{
+  // every backend starts from the same state
+  ByteStream* pStream = ByteStream_CreateGrowableMemoryStream();
+  if (!system->SaveState(pStream))
+  {
+    Log_ErrorPrintf("Benchmark failed: could not save initial state");
+    pStream->Release();
+    return 3;
+  }
+
+  system->SetAudioEnabled(false);
+  system->SetFrameLimiter(false);
+
+  for (uint32 i = 0; i < NUM_CPU_BACKENDS; i++)
+  {
+    Error error;
+    pStream->SeekAbsolute(0);
+    if (!system->LoadState(pStream, &error))
+    {
+      Log_ErrorPrintf("Benchmark failed: could not load initial state: %s",
+                      error.GetErrorCodeAndDescription().GetCharArray());
+      pStream->Release();
+      return 3;
+    }
+
+    system->SetCPUBackend(CPU_BACKEND(i));
+
+    // a frame worth of clocks at a time, even when the display is off
+    uint64 start_instructions = system->GetCPU()->GetInstructionCounter();
+    Timer timer;
+    for (uint32 frame = 0; frame < frames; frame++)
+      system->RunCycles(70224);
+
+    double seconds = timer.GetTimeSeconds();
+    double instructions = double(system->GetCPU()->GetInstructionCounter() - start_instructions);
+    Log_InfoPrintf("%s: %u frames in %.3f seconds, %.0f instructions, %.2f MIPS (%.0f%% speed)",
+                   NameTable_GetNameString(NameTables::CPUBackend, CPU_BACKEND(i)), frames, seconds, instructions,
+                   instructions / seconds / 1000000.0, (double(frames) * 70224.0 / 4194304.0) / seconds * 100.0);
+
+    // scheduler load, shows which components are waking the cpu loop most often
+    SmallString event_counts;
+    for (uint32 event = 0; event < NUM_SYSTEM_EVENTS; event++)
+    {
+      const char* name = NameTable_GetNameString(NameTables::SystemEvent, SYSTEM_EVENT(event));
+      event_counts.AppendFormattedString(" %s=%u", name, system->GetFrameEventCount(SYSTEM_EVENT(event)));
+    }
+    Log_InfoPrintf("  events fired in the last frame:%s", event_counts.GetCharArray());
+  }
+
+  pStream->Release();
+  return 0;
+}
+
+static int RunBenchmark(State* state, uint32 frames)
+{
+  return BenchmarkSystem(state->system, frames);
+}
+
+// flag-heavy alu loop with interrupts disabled, so the cpu core dominates the frame time
+static const uint8 s_alu_benchmark_code[] = {
+  0xF3,             // DI
+  0x31, 0xFE, 0xFF, // LD SP, $FFFE
+  0x01, 0x34, 0x12, // LD BC, $1234
+  0x11, 0x78, 0x56, // LD DE, $5678
+  0x21, 0xBC, 0x9A, // LD HL, $9ABC
+  0x06, 0x40,       // outer: LD B, 64
+  0x81,             // inner: ADD A, C
+  0x8A,             // ADC A, D
+  0x93,             // SUB E
+  0x9C,             // SBC A, H
+  0xA9,             // XOR C
+  0xB2,             // OR D
+  0xBB,             // CP E
+  0x27,             // DAA
+  0x0C,             // INC C
+  0x15,             // DEC D
+  0x17,             // RLA
+  0x0F,             // RRCA
+  0xC6, 0x1B,       // ADD A, $1B
+  0x30, 0x01,       // JR NC, +1
+  0x1C,             // INC E
+  0xCE, 0x2F,       // ADC A, $2F
+  0xE6, 0xF7,       // AND $F7
+  0xCB, 0x11,       // RL C
+  0xCB, 0x3A,       // SRL D
+  0x05,             // DEC B
+  0x20, 0xE4,       // JR NZ, inner
+  0x24,             // INC H
+  0x18, 0xDF,       // JR outer
+};
+
+// timer interrupt woken halt with the display off, so nearly all the time is spent idle between timer overflows
+static const uint8 s_timer_benchmark_code[] = {
+  0xF3,             // DI
+  0x31, 0xFE, 0xFF, // LD SP, $FFFE
+  0xAF,             // XOR A
+  0xE0, 0x40,       // LDH (LCDC), A
+  0xE0, 0x06,       // LDH (TMA), A
+  0x3E, 0x04,       // LD A, $04
+  0xE0, 0xFF,       // LDH (IE), A
+  0xE0, 0x07,       // LDH (TAC), A
+  0xAF,             // loop: XOR A
+  0xE0, 0x0F,       // LDH (IF), A
+  0x76,             // HALT
+  0x00,             // NOP
+  0xF0, 0x04,       // LDH A, (DIV)
+  0x18, 0xF7,       // JR loop
+};
+
+// 40 sprites moved and copied to oam by a dma from an hram routine every vblank, the rest of the frame polls LY
+static const uint8 s_oam_dma_benchmark_code[] = {
+  0xF3,             // DI
+  0x31, 0xFE, 0xFF, // LD SP, $FFFE
+  0xF0, 0x44,       // wait: LDH A, (LY)
+  0xFE, 0x90,       // CP 144
+  0x20, 0xFA,       // JR NZ, wait
+  0xAF,             // XOR A
+  0xE0, 0x40,       // LDH (LCDC), A
+  0x21, 0x10, 0x80, // LD HL, $8010
+  0x3E, 0xFF,       // LD A, $FF
+  0x06, 0x10,       // LD B, 16
+  0x22,             // tile: LD (HL+), A
+  0x05,             // DEC B
+  0x20, 0xFC,       // JR NZ, tile
+  0x21, 0x00, 0xC0, // LD HL, $C000
+  0x0E, 0x10,       // LD C, 16
+  0x16, 0x08,       // LD D, 8
+  0x06, 0x28,       // LD B, 40
+  0x79,             // sprite: LD A, C
+  0x22,             // LD (HL+), A
+  0xC6, 0x03,       // ADD A, 3
+  0x4F,             // LD C, A
+  0x7A,             // LD A, D
+  0x22,             // LD (HL+), A
+  0xC6, 0x04,       // ADD A, 4
+  0x57,             // LD D, A
+  0x3E, 0x01,       // LD A, 1
+  0x22,             // LD (HL+), A
+  0xAF,             // XOR A
+  0x22,             // LD (HL+), A
+  0x05,             // DEC B
+  0x20, 0xED,       // JR NZ, sprite
+  0x21, 0x80, 0xFF, // LD HL, $FF80
+  0x11, 0xB5, 0x01, // LD DE, dma
+  0x06, 0x08,       // LD B, 8
+  0x1A,             // copy: LD A, (DE)
+  0x13,             // INC DE
+  0x22,             // LD (HL+), A
+  0x05,             // DEC B
+  0x20, 0xFA,       // JR NZ, copy
+  0x3E, 0x93,       // LD A, $93
+  0xE0, 0x40,       // LDH (LCDC), A
+  0xF0, 0x44,       // loop: LDH A, (LY)
+  0xFE, 0x90,       // CP 144
+  0x20, 0xFA,       // JR NZ, loop
+  0x21, 0x01, 0xC0, // LD HL, $C001
+  0x06, 0x28,       // LD B, 40
+  0x34,             // move: INC (HL)
+  0x2C,             // INC L
+  0x2C,             // INC L
+  0x2C,             // INC L
+  0x2C,             // INC L
+  0x05,             // DEC B
+  0x20, 0xF8,       // JR NZ, move
+  0x3E, 0xC0,       // LD A, $C0
+  0xCD, 0x80, 0xFF, // CALL $FF80
+  0xF0, 0x44,       // vblank: LDH A, (LY)
+  0xFE, 0x90,       // CP 144
+  0x28, 0xFA,       // JR Z, vblank
+  0x18, 0xE0,       // JR loop
+  0xE0, 0x46,       // dma ($01B5): LDH (DMA), A
+  0x3E, 0x28,       // LD A, 40
+  0x3D,             // delay: DEC A
+  0x20, 0xFD,       // JR NZ, delay
+  0xC9,             // RET
+};
+
+static int RunGeneratedCartBenchmark(const char* title, const uint8* code, uint32 code_size, uint32 frames,
+                                     int (*benchmark)(System*, uint32) = BenchmarkSystem)
+{
+  // 32KB rom-only cart, entry point jumps straight to the code
+  static const uint32 ROM_SIZE = 0x8000;
+  static const uint8 entry_code[] = {0x00, 0xC3, 0x50, 0x01}; // NOP; JP $0150
+  byte* rom = (byte*)Y_malloc(ROM_SIZE);
+  Y_memzero(rom, ROM_SIZE);
+  Y_memcpy(rom + 0x100, entry_code, sizeof(entry_code));
+  Y_memcpy(rom + 0x134, title, Y_strlen(title));
+  Y_memcpy(rom + 0x150, code, code_size);
+
+  NullCallbacks callbacks;
+  System system(&callbacks);
+  Cartridge* cart = new Cartridge(&system);
+  ByteStream* pStream = ByteStream_CreateReadOnlyMemoryStream(rom, ROM_SIZE);
+  Error error;
+  int return_code;
+  if (!cart->Load(pStream, &error) || !system.Init(SYSTEM_MODE_DMG, nullptr, 0, cart))
+  {
+    Log_ErrorPrintf("%s failed: could not create system", title);
+    return_code = 3;
+  }
+  else
+  {
+    return_code = benchmark(&system, frames);
+  }
+
+  pStream->Release();
+  delete cart;
+  Y_free(rom);
+  return return_code;
+}
+
+static int RunALUBenchmark(uint32 frames)
+{
+  return RunGeneratedCartBenchmark("ALUBENCH", s_alu_benchmark_code, sizeof(s_alu_benchmark_code), frames);
+}
+
+static int RunTimerBenchmark(uint32 frames)
+{
+  return RunGeneratedCartBenchmark("TIMERBENCH", s_timer_benchmark_code, sizeof(s_timer_benchmark_code), frames);
+}
+
+static bool CompareCPUState(const CPU::Registers* expected, const CPU::Registers* actual)
+{
+  return (expected->AF == actual->AF && expected->BC == actual->BC && expected->DE == actual->DE &&
+          expected->HL == actual->HL && expected->SP == actual->SP && expected->PC == actual->PC &&
+          expected->IME == actual->IME && expected->IE == actual->IE && expected->IF == actual->IF);
+}
+
+static void LogCPUState(const char* prefix, const CPU::Registers* regs)
+{
+  Log_ErrorPrintf("%s: AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X PC=%04X IME=%u IE=%02X IF=%02X", prefix, regs->AF,
+                  regs->BC, regs->DE, regs->HL, regs->SP, regs->PC, regs->IME ? 1 : 0, regs->IE, regs->IF);
+}
+
+static uint64 HashFrameBuffer(const byte* pFrameBuffer)
+{
+  // fnv-1a, as System::GetMemoryHash
+  uint64 hash = 14695981039346656037ull;
+  for (uint32 i = 0; i < Display::SCREEN_WIDTH * Display::SCREEN_HEIGHT * 4; i++)
+    hash = (hash ^ pFrameBuffer[i]) * 1099511628211ull;
+
+  return hash;
+}
+
+// what a rerun from the same state has to reproduce, the registers, the frame on screen and the memory behind it
+struct ReplayState
+{
+  CPU::Registers registers;
+  uint32 frame_counter;
+  uint64 frame_hash;
+  uint64 memory_hash;
+};
+
+static void CaptureReplayState(System* system, ReplayState* replay_state)
+{
+  replay_state->registers = system->GetCPU()->GetRegisters();
+  replay_state->frame_counter = system->GetFrameCounter();
+  replay_state->frame_hash = HashFrameBuffer(system->GetDisplay()->GetFrameBuffer());
+  replay_state->memory_hash = system->GetMemoryHash();
+}
+
+static bool CompareReplayState(const ReplayState* expected, const ReplayState* actual)
+{
+  if (CompareCPUState(&expected->registers, &actual->registers) && expected->frame_counter == actual->frame_counter &&
+      expected->frame_hash == actual->frame_hash && expected->memory_hash == actual->memory_hash)
+  {
+    return true;
+  }
+
+  LogCPUState("Expected", &expected->registers);
+  LogCPUState("Actual", &actual->registers);
+  Log_ErrorPrintf("Expected: frame %u, frame hash %016llX, memory hash %016llX", expected->frame_counter,
+                  expected->frame_hash, expected->memory_hash);
+  Log_ErrorPrintf("Actual: frame %u, frame hash %016llX, memory hash %016llX", actual->frame_counter,
+                  actual->frame_hash, actual->memory_hash);
+  return false;
+}
+
+static int BenchmarkOAMDMA(System* system, uint32 frames)
+{
+  // measures what accurate mode costs over fast mode and checks both end in the same state. it is not a measure of
+  // the bulk copy itself, one transfer a frame is below the noise against the old per-byte reads.
+  System::Snapshot* snapshot = system->AllocateSnapshot();
+  system->SetAudioEnabled(false);
+  system->SetFrameLimiter(false);
+  system->CaptureSnapshot(snapshot);
+
+  ReplayState expected, actual;
+  double fast_frame_ms = 0.0;
+  int return_code = 0;
+  for (uint32 accurate = 0; accurate < 2 && return_code == 0; accurate++)
+  {
+    system->RestoreSnapshot(snapshot);
+    system->SetAccurateOAMDMA(accurate != 0);
+
+    uint32 start_frame = system->GetFrameCounter();
+    uint64 start_instructions = system->GetCPU()->GetInstructionCounter();
+    Timer timer;
+    while ((system->GetFrameCounter() - start_frame) < frames)
+      system->RunFrames(1);
+
+    double seconds = timer.GetTimeSeconds();
+    double frame_ms = seconds * 1000.0 / double(frames);
+    double instructions = double(system->GetCPU()->GetInstructionCounter() - start_instructions);
+    if (!accurate)
+    {
+      fast_frame_ms = frame_ms;
+      CaptureReplayState(system, &expected);
+    }
+    else
+    {
+      CaptureReplayState(system, &actual);
+      if (!CompareReplayState(&expected, &actual))
+      {
+        Log_ErrorPrintf("OAM DMA benchmark failed: accurate transfers changed the result");
+        return_code = 4;
+      }
+    }
+
+    Log_InfoPrintf("%s oam dma: %u frames in %.3f seconds, %.3f ms per frame (%.2fx fast), %.2f MIPS (%.0f%% speed)",
+                   accurate ? "accurate" : "fast", frames, seconds, frame_ms, frame_ms / fast_frame_ms,
+                   instructions / seconds / 1000000.0, (double(frames) * 70224.0 / 4194304.0) / seconds * 100.0);
+  }
+
+  system->SetAccurateOAMDMA(false);
+  System::FreeSnapshot(snapshot);
+  return return_code;
+}
+
+static int RunOAMDMABenchmark(uint32 frames)
+{
+  return RunGeneratedCartBenchmark("OAMDMABENCH", s_oam_dma_benchmark_code, sizeof(s_oam_dma_benchmark_code), frames,
+                                   BenchmarkOAMDMA);
+}
+
+// a system without outputs, started from the frontend system's current state
+static bool InitializeShadowSystem(State* state, const ProgramArgs* args, System* system, Cartridge** cart)
+{
+  *cart = nullptr;
+  if (args->cart_filename != nullptr)
+  {
+    AutoReleasePtr<ByteStream> pCartStream =
+      FileSystem::OpenFile(args->cart_filename, BYTESTREAM_OPEN_READ | BYTESTREAM_OPEN_STREAMED);
+    Error error;
+    *cart = new Cartridge(system);
+    if (pCartStream == nullptr || !(*cart)->Load(pCartStream, &error))
+    {
+      Log_ErrorPrintf("Could not load cartridge for the shadow system");
+      return false;
+    }
+  }
+
+  Error error;
+  ByteStream* pStream = ByteStream_CreateGrowableMemoryStream();
+  bool result = (system->Init(state->system->GetBootMode(), state->bios, state->bios_length, *cart) &&
+                 state->system->SaveState(pStream) && pStream->SeekAbsolute(0) && system->LoadState(pStream, &error));
+  pStream->Release();
+  if (!result)
+  {
+    Log_ErrorPrintf("Could not copy state to the shadow system");
+    return false;
+  }
+
+  system->SetCPUBackend(state->system->GetCPUBackend());
+  system->SetIdleLoopSkipping(state->system->GetIdleLoopSkipping());
+  system->SetPermissiveMemoryAccess(state->system->GetPermissiveMemoryAccess());
+  system->SetAudioEnabled(false);
+  system->SetFrameLimiter(false);
+  return true;
+}
+
+static int RunDifferential(State* state, const ProgramArgs* args, uint32 frames)
+{
+  // a second system running the reference interpreter, started from the same state
+  NullCallbacks reference_callbacks;
+  System reference(&reference_callbacks);
+  Cartridge* reference_cart;
+  int return_code = 0;
+  if (!InitializeShadowSystem(state, args, &reference, &reference_cart))
+  {
+    Log_ErrorPrintf("Differential run failed: could not create the reference system");
+    return_code = 3;
+  }
+
+  if (return_code == 0)
+  {
+    // the interpreter is the reference, checking it against itself would always pass
+    if (state->system->GetCPUBackend() == CPU_BACKEND_INTERPRETER)
+    {
+      Log_WarningPrintf("The interpreter is the reference, testing %s instead",
+                        NameTable_GetNameString(NameTables::CPUBackend, CPU_BACKEND_RECOMPILER));
+      state->system->SetCPUBackend(CPU_BACKEND_RECOMPILER);
+    }
+
+    Log_InfoPrintf("Comparing %s against %s in lockstep for %u frames",
+                   NameTable_GetNameString(NameTables::CPUBackend, state->system->GetCPUBackend()),
+                   NameTable_GetNameString(NameTables::CPUBackend, CPU_BACKEND_INTERPRETER), frames);
+
+    reference.SetCPUBackend(CPU_BACKEND_INTERPRETER);
+    state->system->SetAudioEnabled(false);
+    state->system->SetFrameLimiter(false);
+
+    // the backend under test runs one block at a time, then the reference catches up to the same clock. identical
+    // instruction streams end on the same instruction boundary, so the registers must match after every step.
+    uint64 end_clocks = uint64(frames) * 70224;
+    uint64 clocks = 0;
+    uint64 reference_clocks = 0;
+    while (clocks < end_clocks)
+    {
+      uint16 start_pc = reference.GetCPU()->GetRegisters().PC;
+      uint32 start_frame = state->system->GetFrameCounter();
+      clocks += state->system->RunCycles(4);
+      if (reference_clocks < clocks)
+        reference_clocks += reference.RunCycles(clocks - reference_clocks);
+
+      CPU::Registers expected = reference.GetCPU()->GetRegisters();
+      CPU::Registers actual = state->system->GetCPU()->GetRegisters();
+      if (reference_clocks != clocks || !CompareCPUState(&expected, &actual) ||
+          reference.GetFrameCounter() != state->system->GetFrameCounter())
+      {
+        Log_ErrorPrintf("CPU state diverged in the step starting at PC=%04X, clock %llu (frame %u)", start_pc, clocks,
+                        start_frame);
+        if (reference_clocks != clocks)
+          Log_ErrorPrintf("Clocks: expected %llu, actual %llu", reference_clocks, clocks);
+        LogCPUState("Expected", &expected);
+        LogCPUState("Actual", &actual);
+        return_code = 4;
+        break;
+      }
+    }
+
+    if (return_code == 0)
+      Log_InfoPrintf("No divergence after %u frames", frames);
+  }
+
+  delete reference_cart;
+  return return_code;
+}
+
+static int RunIdleLoopVerification(State* state, const ProgramArgs* args, uint32 frames)
+{
+  // the same backend with and without idle loop skipping, the frames must match exactly
+  NullCallbacks skipping_callbacks, reference_callbacks;
+  System skipping(&skipping_callbacks);
+  System reference(&reference_callbacks);
+  Cartridge* skipping_cart = nullptr;
+  Cartridge* reference_cart = nullptr;
+  int return_code = 0;
+  if (!InitializeShadowSystem(state, args, &skipping, &skipping_cart) ||
+      !InitializeShadowSystem(state, args, &reference, &reference_cart))
+  {
+    Log_ErrorPrintf("Idle loop verification failed: could not create the systems");
+    return_code = 3;
+  }
+
+  if (return_code == 0)
+  {
+    Log_InfoPrintf("Comparing %s with and without idle loop skipping for %u frames",
+                   NameTable_GetNameString(NameTables::CPUBackend, state->system->GetCPUBackend()), frames);
+
+    skipping.SetIdleLoopSkipping(true);
+    reference.SetIdleLoopSkipping(false);
+    for (uint32 frame = 0; frame < frames; frame++)
+    {
+      skipping.RunFrames(1);
+      reference.RunFrames(1);
+
+      CPU::Registers expected = reference.GetCPU()->GetRegisters();
+      CPU::Registers actual = skipping.GetCPU()->GetRegisters();
+      if (!CompareCPUState(&expected, &actual) || reference.GetFrameCounter() != skipping.GetFrameCounter() ||
+          Y_memcmp(reference.GetDisplay()->GetFrameBuffer(), skipping.GetDisplay()->GetFrameBuffer(),
+                   Display::SCREEN_WIDTH * Display::SCREEN_HEIGHT * 4) != 0)
+      {
+        Log_ErrorPrintf("Output diverged after frame %u", frame);
+        LogCPUState("Expected", &expected);
+        LogCPUState("Actual", &actual);
+        return_code = 4;
+        break;
+      }
+    }
+
+    Log_InfoPrintf("%s after %u frames, %llu cycles skipped in idle loops",
+                   (return_code == 0) ? "No divergence" : "Stopped", frames,
+                   skipping.GetCPU()->GetIdleLoopSkippedCycles());
+  }
+
+  delete skipping_cart;
+  delete reference_cart;
+  return return_code;
+}
+
+static int RunSnapshotBenchmark(State* state, uint32 iterations)
+{
+  System* system = state->system;
+  system->SetAudioEnabled(false);
+  system->SetFrameLimiter(false);
+
+  // get past the bootstrap so there is some state worth saving
+  system->RunFrames(60);
+
+  // the restored system has to run exactly as it did the first time
+  System::Snapshot* snapshot = system->AllocateSnapshot();
+  system->CaptureSnapshot(snapshot);
+  system->RunFrames(60);
+  ReplayState expected, actual;
+  CaptureReplayState(system, &expected);
+  system->RestoreSnapshot(snapshot);
+  system->RunFrames(60);
+  CaptureReplayState(system, &actual);
+  if (!CompareReplayState(&expected, &actual))
+  {
+    Log_ErrorPrintf("Snapshot benchmark failed: state diverged after restoring");
+    System::FreeSnapshot(snapshot);
+    return 4;
+  }
+
+  Timer timer;
+  for (uint32 i = 0; i < iterations; i++)
+  {
+    system->CaptureSnapshot(snapshot);
+    system->RestoreSnapshot(snapshot);
+  }
+  double snapshot_seconds = timer.GetTimeSeconds();
+  System::FreeSnapshot(snapshot);
+
+  // the save state path, through a memory stream
+  ByteStream* pStream = ByteStream_CreateGrowableMemoryStream();
+  timer.Reset();
+  for (uint32 i = 0; i < iterations; i++)
+  {
+    Error error;
+    pStream->SeekAbsolute(0);
+    if (!system->SaveState(pStream) || !pStream->SeekAbsolute(0) || !system->LoadState(pStream, &error))
+    {
+      Log_ErrorPrintf("Snapshot benchmark failed: could not save or load state");
+      pStream->Release();
+      return 3;
+    }
+  }
+  double state_seconds = timer.GetTimeSeconds();
+  pStream->Release();
+
+  Log_InfoPrintf("snapshot: %u capture+restore in %.3f seconds, %.2f us each", iterations, snapshot_seconds,
+                 snapshot_seconds * 1000000.0 / double(iterations));
+  Log_InfoPrintf("save state: %u save+load in %.3f seconds, %.2f us each (%.1fx slower)", iterations, state_seconds,
+                 state_seconds * 1000000.0 / double(iterations), state_seconds / snapshot_seconds);
+
+  // ten seconds of rewind captured every frame, then stepped back through
+  RewindBuffer rewind(system, 64 * 1024 * 1024);
+  for (uint32 i = 0; i < 600; i++)
+  {
+    rewind.CaptureState();
+    system->RunFrames(1);
+  }
+
+  uint32 rewind_memory_used = rewind.GetMemoryUsed();
+  uint32 rewind_states = 0;
+  timer.Reset();
+  while (rewind.RewindState())
+    rewind_states++;
+
+  double rewind_seconds = timer.GetTimeSeconds();
+  Log_InfoPrintf("rewind: %u states in %.2f MB (%u bytes each on average), %.2f us per step back", rewind_states,
+                 rewind_memory_used / 1048576.0, rewind_memory_used / Max(rewind_states, 1u),
+                 rewind_seconds * 1000000.0 / double(Max(rewind_states, 1u)));
+
+  // run-ahead has to leave the real frames exactly as they were, what it costs is the speculative frames on top.
+  // a plain run gives the state after the real frames, and the frames that run-ahead should be showing. it starts
+  // mid-frame, so a real slice that isn't run to a vblank leaves lines of the shown frame undrawn.
+  static const uint32 RUN_AHEAD_TEST_FRAMES = 600;
+  static const uint32 MAX_TEST_RUN_AHEAD_FRAMES = 3;
+  uint64 frame_hashes[RUN_AHEAD_TEST_FRAMES + MAX_TEST_RUN_AHEAD_FRAMES + 1];
+  system->RunCycles(70224 / 2);
+  snapshot = system->AllocateSnapshot();
+  system->CaptureSnapshot(snapshot);
+  uint32 start_frame = system->GetFrameCounter();
+  while ((system->GetFrameCounter() - start_frame) < countof(frame_hashes) - 1)
+  {
+    system->RunFrames(1);
+    frame_hashes[system->GetFrameCounter() - start_frame] = HashFrameBuffer(system->GetDisplay()->GetFrameBuffer());
+    if ((system->GetFrameCounter() - start_frame) == RUN_AHEAD_TEST_FRAMES)
+      CaptureReplayState(system, &expected);
+  }
+
+  double base_frame_ms = 0.0;
+  for (uint32 run_ahead_frames = 0; run_ahead_frames <= MAX_TEST_RUN_AHEAD_FRAMES; run_ahead_frames++)
+  {
+    system->RestoreSnapshot(snapshot);
+    system->SetRunAheadFrames(run_ahead_frames);
+    uint64 start_run_ahead_count = system->GetRunAheadFrameCount();
+    timer.Reset();
+    while ((system->GetFrameCounter() - start_frame) < RUN_AHEAD_TEST_FRAMES)
+      system->ExecuteFrame();
+
+    double frame_ms = timer.GetTimeMilliseconds() / double(RUN_AHEAD_TEST_FRAMES);
+    uint64 extra_frames = system->GetRunAheadFrameCount() - start_run_ahead_count;
+    if (run_ahead_frames == 0)
+    {
+      base_frame_ms = frame_ms;
+      continue;
+    }
+
+    // the real frames end on a vblank with run-ahead, the framebuffer is left holding the last speculative frame
+    CaptureReplayState(system, &actual);
+    actual.frame_hash = expected.frame_hash;
+    bool result = CompareReplayState(&expected, &actual);
+    if (!result)
+      Log_ErrorPrintf("Snapshot benchmark failed: run-ahead of %u frames changed the real frames", run_ahead_frames);
+
+    // and every frame shown has to be the one the plain run pushed run_ahead_frames later
+    system->RestoreSnapshot(snapshot);
+    while (result && (system->GetFrameCounter() - start_frame) < RUN_AHEAD_TEST_FRAMES)
+    {
+      system->ExecuteFrame();
+      uint32 frame = system->GetFrameCounter() - start_frame;
+      if (HashFrameBuffer(system->GetDisplay()->GetFrameBuffer()) != frame_hashes[frame + run_ahead_frames])
+      {
+        Log_ErrorPrintf("Snapshot benchmark failed: run-ahead of %u frames showed the wrong frame after frame %u",
+                        run_ahead_frames, frame);
+        result = false;
+      }
+    }
+    if (!result)
+    {
+      system->SetRunAheadFrames(0);
+      System::FreeSnapshot(snapshot);
+      return 4;
+    }
+
+    // at 60 real frames per second, the extra emulated frames per second is simply 60 times the run-ahead
+    Log_InfoPrintf("run-ahead %u: %.3f ms per frame (+%.3f ms), %.2f extra frames per frame, %.0f extra frames/s "
+                   "and %.1f%% of a core at 60 fps",
+                   run_ahead_frames, frame_ms, frame_ms - base_frame_ms,
+                   double(extra_frames) / double(RUN_AHEAD_TEST_FRAMES), double(extra_frames) / 10.0, frame_ms * 6.0);
+  }
+
+  system->SetRunAheadFrames(0);
+  System::FreeSnapshot(snapshot);
+  return 0;
+}
+
+static int RunRenderBenchmark(State* state, uint32 iterations)
+{
+  System* system = state->system;
+  Display* display = system->GetDisplay();
+  system->SetAudioEnabled(false);
+  system->SetFrameLimiter(false);
+
+  // ten seconds with every line drawn by both renderers, so there is something on screen to draw afterwards
+  display->SetRendererVerification(true);
+  system->RunFrames(600);
+  uint32 verified_frames = display->GetVerifiedFrameCount();
+  uint32 mismatched_frames = display->GetMismatchedFrameCount();
+  display->SetRendererVerification(false);
+  Log_InfoPrintf("verification: %u frames, %u differ from the reference renderer", verified_frames,
+                 mismatched_frames);
+
+  // the same frame drawn over and over, only the renderer changes
+  DISPLAY_RENDERER original_renderer = display->GetRenderer();
+  double reference_us = 0.0;
+  for (uint32 i = NUM_DISPLAY_RENDERERS; i > 0; i--)
+  {
+    DISPLAY_RENDERER renderer = DISPLAY_RENDERER(i - 1);
+    display->SetRenderer(renderer);
+
+    Timer timer;
+    for (uint32 iteration = 0; iteration < iterations; iteration++)
+      display->RenderFull();
+
+    double frame_us = timer.GetTimeSeconds() * 1000000.0 / double(iterations);
+    if (renderer == DISPLAY_RENDERER_REFERENCE)
+      reference_us = frame_us;
+
+    Log_InfoPrintf("%s: %u frames, %.2f us per frame (%.2fx the reference)",
+                   NameTable_GetNameString(NameTables::DisplayRenderer, renderer), iterations, frame_us,
+                   reference_us / frame_us);
+  }
+
+  // palette slots only, converted once at the end as a consumer asking for the framebuffer would
+  display->SetIndexedOutput(true);
+  Timer timer;
+  for (uint32 iteration = 0; iteration < iterations; iteration++)
+    display->RenderFull();
+
+  display->SetIndexedOutput(false);
+  double indexed_us = timer.GetTimeSeconds() * 1000000.0 / double(iterations);
+  Log_InfoPrintf("indexed output: %u frames, %.2f us per frame (%.2fx the reference)", iterations, indexed_us,
+                 reference_us / indexed_us);
+
+  display->SetRenderer(original_renderer);
+  display->ClearFrameReady();
+  return (mismatched_frames > 0) ? 4 : 0;
+}
+
 // SDL requires the entry point declared without c++ decoration
 extern "C" int main(int argc, char* argv[])
 {
@@ -1169,6 +2332,21 @@ extern "C" int main(int argc, char* argv[])
   if (!ParseArguments(argc, argv, &args))
     return 1;
 
+  // the alu, timer and oam dma benchmarks run their own generated carts, and need no display
+  if (args.alu_benchmark_frames > 0 || args.timer_benchmark_frames > 0 || args.oam_dma_benchmark_frames > 0)
+  {
+    int return_code;
+    if (args.alu_benchmark_frames > 0)
+      return_code = RunALUBenchmark(args.alu_benchmark_frames);
+    else if (args.timer_benchmark_frames > 0)
+      return_code = RunTimerBenchmark(args.timer_benchmark_frames);
+    else
+      return_code = RunOAMDMABenchmark(args.oam_dma_benchmark_frames);
+
+    SDL_Quit();
+    return return_code;
+  }
+
   // init state
   State state;
   if (!InitializeState(&args, &state))
@@ -1178,7 +2356,19 @@ extern "C" int main(int argc, char* argv[])
   }
 
   // run
-  int return_code = Run(&state);
+  int return_code;
+  if (args.benchmark_frames > 0)
+    return_code = RunBenchmark(&state, args.benchmark_frames);
+  else if (args.differential_frames > 0)
+    return_code = RunDifferential(&state, &args, args.differential_frames);
+  else if (args.verify_idle_frames > 0)
+    return_code = RunIdleLoopVerification(&state, &args, args.verify_idle_frames);
+  else if (args.snapshot_benchmark_iterations > 0)
+    return_code = RunSnapshotBenchmark(&state, args.snapshot_benchmark_iterations);
+  else if (args.render_benchmark_iterations > 0)
+    return_code = RunRenderBenchmark(&state, args.render_benchmark_iterations);
+  else
+    return_code = Run(&state);
 
   // cleanup
   CleanupState(&state);
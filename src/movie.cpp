@@ -0,0 +1,330 @@
+#include "movie.h"
+#include "YBaseLib/BinaryReader.h"
+#include "YBaseLib/BinaryWriter.h"
+#include "YBaseLib/ByteStream.h"
+#include "YBaseLib/Error.h"
+#include "YBaseLib/Log.h"
+#include "audio.h"
+#include "cartridge.h"
+#include "display.h"
+Log_SetChannel(Movie);
+
+static const uint32 MOVIE_SIGNATURE = 0x4D454247; // GBEM
+static const uint32 MOVIE_VERSION = 1;
+
+// bytes each frame takes in the file
+static const uint32 MOVIE_FRAME_SIZE = 6;
+
+Movie::Movie(System* system)
+  : m_system(system), m_start(MOVIE_START_POWER_ON), m_keyframe_interval(1), m_current_frame(0), m_recording(false),
+    m_playing(false), m_desync_reported(false), m_saved_rtc_emulated_time(false)
+{
+}
+
+Movie::~Movie()
+{
+  Stop();
+}
+
+bool Movie::StartRecording(MOVIE_START start, uint32 keyframe_interval)
+{
+  Stop();
+  m_start = start;
+  m_keyframe_interval = Max(keyframe_interval, 1u);
+  m_frames.clear();
+  m_keyframes.clear();
+  m_current_frame = 0;
+
+  // the emulated rtc time is part of the starting state, so it has to be switched over first
+  SetEmulatedRTC(true);
+  if (start == MOVIE_START_POWER_ON)
+    m_system->Reset();
+
+  if (!AddKeyframe())
+  {
+    Log_ErrorPrintf("Failed to capture the starting state of the movie.");
+    SetEmulatedRTC(false);
+    return false;
+  }
+
+  m_recording = true;
+  Log_InfoPrintf("Recording movie from %s, keyframe every %u frames.",
+                 (start == MOVIE_START_POWER_ON) ? "power-on" : "save state", m_keyframe_interval);
+  return true;
+}
+
+bool Movie::StartPlayback()
+{
+  Stop();
+  if (m_keyframes.empty())
+    return false;
+
+  SetEmulatedRTC(true);
+  if (m_start == MOVIE_START_POWER_ON)
+    m_system->Reset();
+
+  if (!LoadKeyframe(m_keyframes[0]))
+  {
+    SetEmulatedRTC(false);
+    return false;
+  }
+
+  m_current_frame = 0;
+  m_playing = true;
+  m_desync_reported = false;
+  Log_InfoPrintf("Playing movie of %u frames with %u keyframes.", GetFrameCount(), GetKeyframeCount());
+  return true;
+}
+
+void Movie::Stop()
+{
+  if (!m_recording && !m_playing)
+    return;
+
+  if (m_recording)
+    Log_InfoPrintf("Movie recording stopped after %u frames.", GetFrameCount());
+
+  m_recording = false;
+  m_playing = false;
+  SetEmulatedRTC(false);
+}
+
+bool Movie::RunFrame(uint8 button_state, uint8 direction_state)
+{
+  if (m_recording)
+  {
+    if (m_current_frame > 0 && (m_current_frame % m_keyframe_interval) == 0 && !AddKeyframe())
+      Log_WarningPrintf("Failed to capture movie keyframe at frame %u.", m_current_frame);
+
+    Frame frame = {m_system->GetFrameCounter(), button_state, direction_state};
+    m_frames.push_back(frame);
+  }
+  else if (m_playing)
+  {
+    if (m_current_frame >= GetFrameCount())
+    {
+      Log_InfoPrintf("Movie playback finished after %u frames.", m_current_frame);
+      Stop();
+      return false;
+    }
+
+    // the system frame counter only differs if playback went somewhere the recording didn't
+    const Frame& frame = m_frames[m_current_frame];
+    if (frame.frame_counter != m_system->GetFrameCounter() && !m_desync_reported)
+    {
+      Log_WarningPrintf("Movie desync at frame %u: frame counter is %u, recorded as %u.", m_current_frame,
+                        m_system->GetFrameCounter(), frame.frame_counter);
+      m_desync_reported = true;
+    }
+
+    button_state = frame.button_state;
+    direction_state = frame.direction_state;
+  }
+
+  // whole frames only, so the input always changes on the same cycle
+  m_system->SetPadButtonState(button_state);
+  m_system->SetPadDirectionState(direction_state);
+  m_system->RunFrames(1);
+  m_current_frame++;
+  return true;
+}
+
+bool Movie::Seek(uint32 frame)
+{
+  if (!m_playing || frame > GetFrameCount())
+    return false;
+
+  // keyframes are in frame order, and the first one is always at frame zero
+  size_t index = m_keyframes.size() - 1;
+  while (m_keyframes[index].frame > frame)
+    index--;
+
+  // carrying on is cheaper than going back to the keyframe when it is already past it
+  const Keyframe& keyframe = m_keyframes[index];
+  if (m_current_frame > frame || m_current_frame < keyframe.frame)
+  {
+    if (!LoadKeyframe(keyframe))
+      return false;
+
+    m_current_frame = keyframe.frame;
+  }
+
+  Display* display = m_system->GetDisplay();
+  Audio* audio = m_system->GetAudio();
+  bool synthesis_enabled = audio->GetSynthesisEnabled();
+  audio->SetSynthesisEnabled(false);
+  while (m_current_frame < frame)
+  {
+    display->SetRenderingEnabled((m_current_frame + 1) == frame);
+    RunFrame(0, 0);
+  }
+  display->SetRenderingEnabled(true);
+  audio->SetSynthesisEnabled(synthesis_enabled);
+
+  Log_InfoPrintf("Movie seeked to frame %u from the keyframe at frame %u.", frame, keyframe.frame);
+  return true;
+}
+
+bool Movie::Save(ByteStream* pStream) const
+{
+  const Cartridge* cartridge = m_system->GetCartridge();
+
+  BinaryWriter binaryWriter(pStream);
+  binaryWriter.WriteUInt32(MOVIE_SIGNATURE);
+  binaryWriter.WriteUInt32(MOVIE_VERSION);
+  binaryWriter.WriteUInt32((cartridge != nullptr) ? cartridge->GetCRC() : 0);
+  binaryWriter.WriteUInt8((uint8)m_start);
+  binaryWriter.WriteUInt32(m_keyframe_interval);
+  binaryWriter.WriteUInt32(GetFrameCount());
+  binaryWriter.WriteUInt32(GetKeyframeCount());
+
+  for (const Frame& frame : m_frames)
+  {
+    binaryWriter.WriteUInt32(frame.frame_counter);
+    binaryWriter.WriteUInt8(frame.button_state);
+    binaryWriter.WriteUInt8(frame.direction_state);
+  }
+
+  for (const Keyframe& keyframe : m_keyframes)
+  {
+    binaryWriter.WriteUInt32(keyframe.frame);
+    binaryWriter.WriteUInt32(uint32(keyframe.data.size()));
+    binaryWriter.WriteBytes(keyframe.data.data(), uint32(keyframe.data.size()));
+  }
+
+  binaryWriter.WriteUInt32(~MOVIE_SIGNATURE);
+  return !binaryWriter.InErrorState();
+}
+
+bool Movie::Load(ByteStream* pStream, Error* pError)
+{
+  Stop();
+  m_frames.clear();
+  m_keyframes.clear();
+  m_current_frame = 0;
+
+  BinaryReader binaryReader(pStream);
+  uint32 signature = binaryReader.ReadUInt32();
+  uint32 version = binaryReader.ReadUInt32();
+  if (signature != MOVIE_SIGNATURE || version != MOVIE_VERSION)
+  {
+    pError->SetErrorUserFormatted(1, "Not a movie file, or unsupported version %u", version);
+    return false;
+  }
+
+  const Cartridge* cartridge = m_system->GetCartridge();
+  uint32 crc = binaryReader.ReadUInt32();
+  if (cartridge == nullptr || crc != cartridge->GetCRC())
+  {
+    pError->SetErrorUser(1, "CRC mismatch between movie cartridge and this cartridge");
+    return false;
+  }
+
+  // sizes are checked against the stream so a corrupted file can't make us allocate everything
+  uint32 start = binaryReader.ReadUInt8();
+  uint32 keyframe_interval = binaryReader.ReadUInt32();
+  uint32 frame_count = binaryReader.ReadUInt32();
+  uint32 keyframe_count = binaryReader.ReadUInt32();
+  uint64 remaining = pStream->GetSize() - pStream->GetPosition();
+  if (pStream->InErrorState() || start >= NUM_MOVIE_STARTS || keyframe_count == 0 ||
+      uint64(frame_count) * MOVIE_FRAME_SIZE > remaining)
+  {
+    pError->SetErrorUser(1, "Corrupted movie header");
+    return false;
+  }
+
+  m_frames.resize(frame_count);
+  for (Frame& frame : m_frames)
+  {
+    frame.frame_counter = binaryReader.ReadUInt32();
+    frame.button_state = binaryReader.ReadUInt8();
+    frame.direction_state = binaryReader.ReadUInt8();
+  }
+
+  m_keyframes.resize(keyframe_count);
+  for (uint32 i = 0; i < keyframe_count; i++)
+  {
+    Keyframe& keyframe = m_keyframes[i];
+    keyframe.frame = binaryReader.ReadUInt32();
+    uint32 size = binaryReader.ReadUInt32();
+    uint32 previous_frame = (i > 0) ? m_keyframes[i - 1].frame : 0;
+    if (pStream->InErrorState() || keyframe.frame > frame_count || keyframe.frame < previous_frame ||
+        (i == 0 && keyframe.frame != 0) || size > (pStream->GetSize() - pStream->GetPosition()))
+    {
+      pError->SetErrorUserFormatted(1, "Corrupted movie keyframe %u", i);
+      m_frames.clear();
+      m_keyframes.clear();
+      return false;
+    }
+
+    keyframe.data.resize(size);
+    binaryReader.ReadBytes(keyframe.data.data(), size);
+  }
+
+  if (binaryReader.ReadUInt32() != ~MOVIE_SIGNATURE || pStream->InErrorState())
+  {
+    pError->SetErrorUser(1, "Error reading movie trailing signature");
+    m_frames.clear();
+    m_keyframes.clear();
+    return false;
+  }
+
+  m_start = (MOVIE_START)start;
+  m_keyframe_interval = Max(keyframe_interval, 1u);
+  return true;
+}
+
+bool Movie::AddKeyframe()
+{
+  ByteStream* pStream = ByteStream_CreateGrowableMemoryStream();
+  if (!m_system->SaveState(pStream))
+  {
+    pStream->Release();
+    return false;
+  }
+
+  Keyframe keyframe;
+  keyframe.frame = m_current_frame;
+  keyframe.data.resize(size_t(pStream->GetPosition()));
+  bool result = pStream->SeekAbsolute(0) && pStream->Read2(keyframe.data.data(), uint32(keyframe.data.size()));
+  pStream->Release();
+  if (!result)
+    return false;
+
+  m_keyframes.push_back(std::move(keyframe));
+  return true;
+}
+
+bool Movie::LoadKeyframe(const Keyframe& keyframe)
+{
+  ByteStream* pStream = ByteStream_CreateReadOnlyMemoryStream(keyframe.data.data(), uint32(keyframe.data.size()));
+  Error error;
+  bool result = m_system->LoadState(pStream, &error);
+  pStream->Release();
+  if (!result)
+  {
+    Log_ErrorPrintf("Failed to load movie keyframe at frame %u: %s", keyframe.frame,
+                    error.GetErrorCodeAndDescription().GetCharArray());
+    return false;
+  }
+
+  return true;
+}
+
+void Movie::SetEmulatedRTC(bool enabled)
+{
+  Cartridge* cartridge = m_system->GetCartridge();
+  if (cartridge == nullptr)
+    return;
+
+  // the host clock would make every run different, put back whatever was used before afterwards
+  if (enabled)
+  {
+    m_saved_rtc_emulated_time = cartridge->GetRTCEmulatedTime();
+    cartridge->SetRTCEmulatedTime(true);
+  }
+  else
+  {
+    cartridge->SetRTCEmulatedTime(m_saved_rtc_emulated_time);
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "YBaseLib/Common.h"
+#include "system.h"
+#include <vector>
+
+class ByteStream;
+class Error;
+
+enum MOVIE_START
+{
+  MOVIE_START_POWER_ON,
+  MOVIE_START_SAVE_STATE,
+  NUM_MOVIE_STARTS
+};
+
+// input movie, the pad state applied at the start of every frame from a known starting point
+// save states are embedded every keyframe_interval frames so seeking only replays from the closest one before it. the
+// first keyframe is the starting point itself, which also carries the cartridge ram. while a movie is recording or
+// playing the rtc runs on emulated time, so playback is exact.
+class Movie
+{
+public:
+  Movie(System* system);
+  ~Movie();
+
+  MOVIE_START GetStart() const { return m_start; }
+  uint32 GetKeyframeInterval() const { return m_keyframe_interval; }
+  uint32 GetKeyframeCount() const { return uint32(m_keyframes.size()); }
+  uint32 GetFrameCount() const { return uint32(m_frames.size()); }
+  uint32 GetCurrentFrame() const { return m_current_frame; }
+  bool IsRecording() const { return m_recording; }
+  bool IsPlaying() const { return m_playing; }
+
+  // starts a new recording from the current state, or resets the system first when starting from power-on
+  bool StartRecording(MOVIE_START start, uint32 keyframe_interval = 1800);
+
+  // loads the first keyframe and starts playing from there
+  bool StartPlayback();
+
+  // stops recording or playback, recorded frames are kept
+  void Stop();
+
+  // runs one frame, recording the given pad state or applying the recorded one
+  // returns false without running anything once playback reaches the end of the movie
+  bool RunFrame(uint8 button_state, uint8 direction_state);
+
+  // during playback, moves to the start of the given frame by loading the closest keyframe and replaying from it
+  // the replayed frames are not heard, and only the last of them is drawn
+  bool Seek(uint32 frame);
+
+  // movie files, only valid for the cartridge they were recorded with
+  bool Save(ByteStream* pStream) const;
+  bool Load(ByteStream* pStream, Error* pError);
+
+private:
+  // pad state of one frame, tagged with the system frame counter it was recorded at to detect desyncs
+  struct Frame
+  {
+    uint32 frame_counter;
+    uint8 button_state;
+    uint8 direction_state;
+  };
+
+  // save state taken at the start of a frame
+  struct Keyframe
+  {
+    uint32 frame;
+    std::vector<byte> data;
+  };
+
+  bool AddKeyframe();
+  bool LoadKeyframe(const Keyframe& keyframe);
+  void SetEmulatedRTC(bool enabled);
+
+  System* m_system;
+  MOVIE_START m_start;
+  uint32 m_keyframe_interval;
+
+  std::vector<Frame> m_frames;
+  std::vector<Keyframe> m_keyframes;
+
+  uint32 m_current_frame;
+  bool m_recording;
+  bool m_playing;
+  bool m_desync_reported;
+  bool m_saved_rtc_emulated_time;
+};
@@ -0,0 +1,247 @@
+#include "rewind.h"
+#include "YBaseLib/Assert.h"
+#include "YBaseLib/Log.h"
+#include "YBaseLib/Memory.h"
+Log_SetChannel(RewindBuffer);
+
+// one entry slot per this many bytes of memory, deltas of frames where little changed can be smaller than this
+static const uint32 BYTES_PER_ENTRY_SLOT = 256;
+
+// delta runs are counted in 32-bit words, each run header holds a zero count and a literal count
+static const uint32 MAX_RUN_LENGTH = 0xFFFF;
+
+RewindBuffer::RewindBuffer(System* system, uint32 memory_size, uint32 capture_interval, uint32 keyframe_interval)
+  : m_system(system), m_capture_interval(Max(capture_interval, 1u)), m_keyframe_interval(Max(keyframe_interval, 1u)),
+    m_last_capture_frame(0), m_has_captured(false), m_memory_size(memory_size & ~3u), m_first_entry(0),
+    m_entry_count(0), m_memory_used(0), m_keyframe_entry(-1), m_deltas_since_keyframe(0)
+{
+  m_snapshot = system->AllocateSnapshot();
+  m_snapshot_size = system->GetSnapshotSize();
+  DebugAssert((m_snapshot_size % 4) == 0);
+
+  // a delta costs at most one header per word, which is never kept as it is larger than a keyframe
+  m_delta_buffer = reinterpret_cast<byte*>(Y_malloc(m_snapshot_size * 2 + 8));
+  m_memory = reinterpret_cast<byte*>(Y_malloc(m_memory_size));
+  m_max_entries = Max(m_memory_size / BYTES_PER_ENTRY_SLOT, 2u);
+  m_entries = new Entry[m_max_entries];
+
+  Log_DevPrintf("Rewind buffer: %u bytes, %u entries, %u byte states", m_memory_size, m_max_entries, m_snapshot_size);
+}
+
+RewindBuffer::~RewindBuffer()
+{
+  delete[] m_entries;
+  Y_free(m_memory);
+  Y_free(m_delta_buffer);
+  System::FreeSnapshot(m_snapshot);
+}
+
+bool RewindBuffer::CaptureState()
+{
+  uint32 frame = m_system->GetFrameCounter();
+  if (m_has_captured && (frame - m_last_capture_frame) < m_capture_interval)
+    return false;
+
+  m_system->CaptureSnapshot(m_snapshot);
+  m_last_capture_frame = frame;
+  m_has_captured = true;
+
+  const byte* state = reinterpret_cast<const byte*>(m_snapshot);
+  bool keyframe = (m_keyframe_entry < 0 || (m_deltas_since_keyframe + 1) >= m_keyframe_interval);
+  uint32 delta_size = 0;
+  if (!keyframe)
+  {
+    const Entry& key = GetEntry(uint32(m_keyframe_entry));
+    delta_size =
+      EncodeDelta(reinterpret_cast<const uint32*>(state), reinterpret_cast<const uint32*>(m_memory + key.offset),
+                  reinterpret_cast<uint32*>(m_delta_buffer));
+    keyframe = (delta_size >= m_snapshot_size);
+  }
+
+  // making room can drop the keyframe the delta was taken against, in which case it becomes a keyframe itself
+  byte* dest = keyframe ? nullptr : AllocateEntry(delta_size, false);
+  if (dest != nullptr)
+  {
+    Y_memcpy(dest, m_delta_buffer, delta_size);
+    return true;
+  }
+
+  dest = AllocateEntry(m_snapshot_size, true);
+  if (dest == nullptr)
+  {
+    Log_WarningPrintf("Rewind buffer of %u bytes is too small for a %u byte state", m_memory_size, m_snapshot_size);
+    return false;
+  }
+
+  Y_memcpy(dest, state, m_snapshot_size);
+  return true;
+}
+
+bool RewindBuffer::RewindState()
+{
+  if (m_entry_count == 0)
+    return false;
+
+  // the newest entry is either a keyframe or a delta against the newest keyframe
+  uint32 index = m_entry_count - 1;
+  const Entry& entry = GetEntry(index);
+  if (entry.keyframe)
+  {
+    Y_memcpy(m_snapshot, m_memory + entry.offset, m_snapshot_size);
+  }
+  else
+  {
+    const Entry& key = GetEntry(uint32(m_keyframe_entry));
+    DecodeDelta(reinterpret_cast<const uint32*>(m_memory + entry.offset), entry.size,
+                reinterpret_cast<const uint32*>(m_memory + key.offset), reinterpret_cast<uint32*>(m_snapshot));
+  }
+
+  m_system->RestoreSnapshot(m_snapshot);
+  m_last_capture_frame = m_system->GetFrameCounter();
+
+  // drop it, going back to the previous keyframe if it was one
+  m_memory_used -= entry.size;
+  m_entry_count--;
+  if (entry.keyframe)
+  {
+    m_keyframe_entry = -1;
+    m_deltas_since_keyframe = 0;
+    for (uint32 i = m_entry_count; i > 0; i--)
+    {
+      if (GetEntry(i - 1).keyframe)
+      {
+        m_keyframe_entry = int32(i - 1);
+        m_deltas_since_keyframe = m_entry_count - i;
+        break;
+      }
+    }
+  }
+  else
+  {
+    m_deltas_since_keyframe--;
+  }
+
+  return true;
+}
+
+void RewindBuffer::Clear()
+{
+  m_first_entry = 0;
+  m_entry_count = 0;
+  m_memory_used = 0;
+  m_keyframe_entry = -1;
+  m_deltas_since_keyframe = 0;
+  m_has_captured = false;
+}
+
+uint32 RewindBuffer::EncodeDelta(const uint32* state, const uint32* keyframe, uint32* out) const
+{
+  const uint32 count = m_snapshot_size / 4;
+  uint32 out_pos = 0;
+  uint32 pos = 0;
+  while (pos < count)
+  {
+    uint32 zero_words = 0;
+    while (pos < count && zero_words < MAX_RUN_LENGTH && state[pos] == keyframe[pos])
+    {
+      pos++;
+      zero_words++;
+    }
+
+    uint32 header_pos = out_pos++;
+    uint32 literal_words = 0;
+    while (pos < count && literal_words < MAX_RUN_LENGTH && state[pos] != keyframe[pos])
+    {
+      out[out_pos++] = state[pos] ^ keyframe[pos];
+      pos++;
+      literal_words++;
+    }
+
+    out[header_pos] = (zero_words << 16) | literal_words;
+  }
+
+  return out_pos * 4;
+}
+
+void RewindBuffer::DecodeDelta(const uint32* delta, uint32 delta_size, const uint32* keyframe, uint32* state) const
+{
+  Y_memcpy(state, keyframe, m_snapshot_size);
+
+  const uint32* delta_end = delta + (delta_size / 4);
+  uint32 pos = 0;
+  while (delta < delta_end)
+  {
+    uint32 header = *(delta++);
+    pos += header >> 16;
+    for (uint32 literal_words = header & 0xFFFF; literal_words > 0; literal_words--)
+      state[pos++] ^= *(delta++);
+  }
+}
+
+byte* RewindBuffer::AllocateEntry(uint32 size, bool keyframe)
+{
+  if (size > m_memory_size)
+    return nullptr;
+
+  uint32 head = 0;
+  if (m_entry_count > 0)
+  {
+    const Entry& newest = GetEntry(m_entry_count - 1);
+    head = newest.offset + newest.size;
+  }
+
+  // entries never straddle the end, anything still left above the head is older than what's below it
+  uint32 offset = head;
+  if ((offset + size) > m_memory_size)
+  {
+    while (m_entry_count > 0 && GetEntry(0).offset >= head)
+      RemoveOldestEntry();
+
+    offset = 0;
+  }
+
+  // the oldest entry is always the next one in the way
+  while (m_entry_count > 0 && GetEntry(0).offset < (offset + size) && (GetEntry(0).offset + GetEntry(0).size) > offset)
+    RemoveOldestEntry();
+  while (m_entry_count == m_max_entries)
+    RemoveOldestEntry();
+
+  if (!keyframe && m_keyframe_entry < 0)
+    return nullptr;
+
+  Entry& entry = m_entries[(m_first_entry + m_entry_count) % m_max_entries];
+  entry.offset = offset;
+  entry.size = size;
+  entry.keyframe = keyframe;
+  if (keyframe)
+  {
+    m_keyframe_entry = int32(m_entry_count);
+    m_deltas_since_keyframe = 0;
+  }
+  else
+  {
+    m_deltas_since_keyframe++;
+  }
+
+  m_entry_count++;
+  m_memory_used += size;
+  return m_memory + offset;
+}
+
+void RewindBuffer::RemoveOldestEntry()
+{
+  // deltas are useless without the keyframe they were taken against, so they go with it
+  do
+  {
+    m_memory_used -= GetEntry(0).size;
+    m_first_entry = (m_first_entry + 1) % m_max_entries;
+    m_entry_count--;
+    m_keyframe_entry--;
+  } while (m_entry_count > 0 && !GetEntry(0).keyframe);
+
+  if (m_keyframe_entry < 0)
+  {
+    m_keyframe_entry = -1;
+    m_deltas_since_keyframe = 0;
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "YBaseLib/Common.h"
+#include "system.h"
+
+// ring buffer of past machine states for stepping backwards through time
+// states are stored as XOR deltas against the most recent keyframe with zero runs removed, every keyframe_interval'th
+// state (or any state the delta would not shrink) is a keyframe stored in full, so restoring needs at most one decode
+class RewindBuffer
+{
+public:
+  RewindBuffer(System* system, uint32 memory_size, uint32 capture_interval = 1, uint32 keyframe_interval = 60);
+  ~RewindBuffer();
+
+  uint32 GetMemorySize() const { return m_memory_size; }
+  uint32 GetMemoryUsed() const { return m_memory_used; }
+  uint32 GetStateCount() const { return m_entry_count; }
+  uint32 GetCaptureInterval() const { return m_capture_interval; }
+
+  // captures the current state if capture_interval frames have passed since the last capture, returns true if it did
+  // meant to be called between frames, the oldest states are dropped to make room
+  bool CaptureState();
+
+  // restores the most recently captured state and removes it, returns false if there is nothing left
+  bool RewindState();
+
+  // drops all states
+  void Clear();
+
+private:
+  struct Entry
+  {
+    uint32 offset;
+    uint32 size;
+    bool keyframe;
+  };
+
+  uint32 EncodeDelta(const uint32* state, const uint32* keyframe, uint32* out) const;
+  void DecodeDelta(const uint32* delta, uint32 delta_size, const uint32* keyframe, uint32* state) const;
+
+  // returns space for size bytes at the head of the arena, dropping the oldest entries if needed
+  byte* AllocateEntry(uint32 size, bool keyframe);
+  void RemoveOldestEntry();
+
+  Entry& GetEntry(uint32 index) { return m_entries[(m_first_entry + index) % m_max_entries]; }
+  const Entry& GetEntry(uint32 index) const { return m_entries[(m_first_entry + index) % m_max_entries]; }
+
+  System* m_system;
+  uint32 m_capture_interval;
+  uint32 m_keyframe_interval;
+  uint32 m_last_capture_frame;
+  bool m_has_captured;
+
+  // the state being captured or restored, and the encoded delta before it is copied into the arena
+  System::Snapshot* m_snapshot;
+  uint32 m_snapshot_size;
+  byte* m_delta_buffer;
+
+  // states are written into the arena in order, wrapping back to the start when they would run past the end
+  byte* m_memory;
+  uint32 m_memory_size;
+
+  // entries oldest first, the index of the newest keyframe and the deltas taken against it
+  Entry* m_entries;
+  uint32 m_max_entries;
+  uint32 m_first_entry;
+  uint32 m_entry_count;
+  uint32 m_memory_used;
+  int32 m_keyframe_entry;
+  uint32 m_deltas_since_keyframe;
+};
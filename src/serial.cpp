@@ -7,9 +7,10 @@
 Log_SetChannel(Serial);
 
 Serial::Serial(System* system)
-  : m_system(system), m_last_cycle(0), m_has_connection(false), m_serial_control(0x00), m_serial_read_data(0xFF),
-    m_serial_write_data(0xFF), m_sequence(0), m_expected_sequence(Y_UINT32_MAX), m_external_clocks(0),
-    m_clocks_since_transfer_start(0), m_serial_wait_clocks(0), m_nonready_clocks(0), m_nonready_sequence(0)
+  : m_system(system), m_link(nullptr), m_last_cycle(0), m_has_connection(false), m_serial_control(0x00),
+    m_serial_read_data(0xFF), m_serial_write_data(0xFF), m_sequence(0), m_expected_sequence(Y_UINT32_MAX),
+    m_external_clocks(0), m_clocks_since_transfer_start(0), m_serial_wait_clocks(0), m_nonready_clocks(0),
+    m_nonready_sequence(0)
 {
 }
 
@@ -29,7 +30,7 @@ void Serial::SendNotReadyResponse()
   // Send the response back immediately.
   WritePacket response(LINK_COMMAND_NOT_READY);
   response << uint32(m_nonready_sequence);
-  LinkConnectionManager::GetInstance().SendPacket(&response);
+  m_link->SendPacket(&response);
 
   // Clear state.
   m_nonready_clocks = 0;
@@ -69,10 +70,10 @@ void Serial::SetSerialControl(uint8 value)
         // Send the byte to the client.
         WritePacket packet(LINK_COMMAND_CLOCK);
         packet << uint32(m_sequence) << uint32(GetTransferClocks()) << uint8(m_serial_write_data);
-        LinkConnectionManager::GetInstance().SendPacket(&packet);
+        m_link->SendPacket(&packet);
 
         // Wait for ACK (i.e. DATA) before simulating.
-        m_system->m_serial_pause = true;
+        m_system->SetSerialPause(true);
         return;
       }
 
@@ -92,7 +93,7 @@ void Serial::SetSerialControl(uint8 value)
         // Send the response back immediately.
         WritePacket response(LINK_COMMAND_DATA);
         response << uint32(m_nonready_sequence) << uint8(m_serial_write_data);
-        LinkConnectionManager::GetInstance().SendPacket(&response);
+        m_link->SendPacket(&response);
 
         // Assuming incoming data has already been set.
         EndTransfer(m_external_clocks);
@@ -134,20 +135,23 @@ void Serial::Reset()
   m_nonready_sequence = 0;
 }
 
-bool Serial::LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError)
+bool Serial::LoadState(ByteStream* pStream, BinaryReader& binaryReader, uint32 version, Error* pError)
 {
   m_serial_control = binaryReader.ReadUInt8();
   m_serial_read_data = binaryReader.ReadUInt8();
   m_serial_write_data = binaryReader.ReadUInt8();
 
-  // reset transfer state when loading state
+  // a transfer we are clocking with nothing attached is kept, anything involving the link cable starts over
+  m_serial_wait_clocks = (version >= 7) ? binaryReader.ReadUInt32() : 0;
+  m_clocks_since_transfer_start = (version >= 7) ? binaryReader.ReadUInt32() : 0;
   m_sequence = 0;
   m_expected_sequence = 0;
   m_external_clocks = 0;
-  m_serial_wait_clocks = 0;
-  m_clocks_since_transfer_start = 0;
   m_nonready_clocks = 0;
   m_nonready_sequence = 0;
+
+  // saved synchronized, so continue from the current cycle
+  m_last_cycle = m_system->GetCycleNumber();
   ScheduleSynchronization();
   return true;
 }
@@ -157,6 +161,38 @@ void Serial::SaveState(ByteStream* pStream, BinaryWriter& binaryWriter)
   binaryWriter.WriteUInt8(m_serial_control);
   binaryWriter.WriteUInt8(m_serial_read_data);
   binaryWriter.WriteUInt8(m_serial_write_data);
+  binaryWriter.WriteUInt32(m_serial_wait_clocks);
+  binaryWriter.WriteUInt32(m_clocks_since_transfer_start);
+}
+
+void Serial::SaveSnapshot(SnapshotState* state) const
+{
+  state->last_cycle = m_last_cycle;
+  state->serial_control = m_serial_control;
+  state->serial_read_data = m_serial_read_data;
+  state->serial_write_data = m_serial_write_data;
+  state->sequence = m_sequence;
+  state->expected_sequence = m_expected_sequence;
+  state->external_clocks = m_external_clocks;
+  state->serial_wait_clocks = m_serial_wait_clocks;
+  state->clocks_since_transfer_start = m_clocks_since_transfer_start;
+  state->nonready_clocks = m_nonready_clocks;
+  state->nonready_sequence = m_nonready_sequence;
+}
+
+void Serial::LoadSnapshot(const SnapshotState* state)
+{
+  m_last_cycle = state->last_cycle;
+  m_serial_control = state->serial_control;
+  m_serial_read_data = state->serial_read_data;
+  m_serial_write_data = state->serial_write_data;
+  m_sequence = state->sequence;
+  m_expected_sequence = state->expected_sequence;
+  m_external_clocks = state->external_clocks;
+  m_serial_wait_clocks = state->serial_wait_clocks;
+  m_clocks_since_transfer_start = state->clocks_since_transfer_start;
+  m_nonready_clocks = state->nonready_clocks;
+  m_nonready_sequence = state->nonready_sequence;
 }
 
 void Serial::EndTransfer(uint32 clocks)
@@ -241,11 +277,18 @@ void Serial::ScheduleSynchronization()
 
 void Serial::HandleRequests()
 {
+  // No cable attached.
+  if (m_link == nullptr)
+  {
+    m_has_connection = false;
+    return;
+  }
+
   // Drain the network thread queue.
   for (;;)
   {
     ReadPacket* packet;
-    LinkConnectionManager::LinkState state = LinkConnectionManager::GetInstance().MainThreadPull(&packet);
+    LinkConnectionManager::LinkState state = m_link->MainThreadPull(&packet);
     if (state == LinkConnectionManager::LinkState_NotConnected)
     {
       // Not connected in the first place.
@@ -292,7 +335,7 @@ void Serial::HandleRequests()
         // Send the response back immediately.
         WritePacket response(LINK_COMMAND_DATA);
         response << uint32(sequence) << uint8(m_serial_write_data);
-        LinkConnectionManager::GetInstance().SendPacket(&response);
+        m_link->SendPacket(&response);
 
         // Set the data we received, and end the transfer.
         m_serial_read_data = data;
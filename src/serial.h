@@ -2,6 +2,7 @@
 #include "structures.h"
 #include "system.h"
 
+class LinkConnectionManager;
 class LinkSocket;
 
 class Serial
@@ -18,6 +19,10 @@ public:
   void SetSerialControl(uint8 value);
   void SetSerialData(uint8 value);
 
+  // link cable, nullptr if the system is not connected to anything
+  LinkConnectionManager* GetLinkConnectionManager() const { return m_link; }
+  void SetLinkConnectionManager(LinkConnectionManager* link) { m_link = link; }
+
   // reset
   void Reset();
 
@@ -32,11 +37,30 @@ private:
   void HandleRequests();
 
   // state saving
-  bool LoadState(ByteStream* pStream, BinaryReader& binaryReader, Error* pError);
+  bool LoadState(ByteStream* pStream, BinaryReader& binaryReader, uint32 version, Error* pError);
   void SaveState(ByteStream* pStream, BinaryWriter& binaryWriter);
 
+  // machine state for System::Snapshot, unlike save states a link cable transfer in progress is kept
+  struct SnapshotState
+  {
+    uint64 last_cycle;
+    uint8 serial_control;
+    uint8 serial_read_data;
+    uint8 serial_write_data;
+    uint32 sequence;
+    uint32 expected_sequence;
+    uint32 external_clocks;
+    uint32 serial_wait_clocks;
+    uint32 clocks_since_transfer_start;
+    uint32 nonready_clocks;
+    uint32 nonready_sequence;
+  };
+  void SaveSnapshot(SnapshotState* state) const;
+  void LoadSnapshot(const SnapshotState* state);
+
   System* m_system;
-  uint32 m_last_cycle;
+  LinkConnectionManager* m_link;
+  uint64 m_last_cycle;
   bool m_has_connection;
 
   // serial
@@ -3,3 +3,28 @@
 Y_Define_NameTable(NameTables::SystemMode) Y_NameTable_VEntry(SYSTEM_MODE_DMG, "SYSTEM_MODE_DMG")
   Y_NameTable_VEntry(SYSTEM_MODE_SGB, "SYSTEM_MODE_SGB") Y_NameTable_VEntry(SYSTEM_MODE_CGB, "SYSTEM_MODE_CGB")
     Y_NameTable_End()
+
+      Y_Define_NameTable(NameTables::CPUBackend) Y_NameTable_VEntry(CPU_BACKEND_INTERPRETER, "CPU_BACKEND_INTERPRETER")
+        Y_NameTable_VEntry(CPU_BACKEND_THREADED_INTERPRETER, "CPU_BACKEND_THREADED_INTERPRETER")
+          Y_NameTable_VEntry(CPU_BACKEND_CACHED_INTERPRETER, "CPU_BACKEND_CACHED_INTERPRETER")
+            Y_NameTable_VEntry(CPU_BACKEND_RECOMPILER, "CPU_BACKEND_RECOMPILER") Y_NameTable_End()
+
+              Y_Define_NameTable(NameTables::SystemEvent)
+                Y_NameTable_VEntry(SYSTEM_EVENT_DISPLAY, "SYSTEM_EVENT_DISPLAY")
+                  Y_NameTable_VEntry(SYSTEM_EVENT_AUDIO, "SYSTEM_EVENT_AUDIO")
+                    Y_NameTable_VEntry(SYSTEM_EVENT_SERIAL, "SYSTEM_EVENT_SERIAL")
+                      Y_NameTable_VEntry(SYSTEM_EVENT_TIMER, "SYSTEM_EVENT_TIMER")
+                        Y_NameTable_VEntry(SYSTEM_EVENT_OAM_DMA, "SYSTEM_EVENT_OAM_DMA")
+                          Y_NameTable_VEntry(SYSTEM_EVENT_HDMA, "SYSTEM_EVENT_HDMA") Y_NameTable_End()
+
+                            Y_Define_NameTable(NameTables::DisplayRenderer)
+                              Y_NameTable_VEntry(DISPLAY_RENDERER_SPAN, "DISPLAY_RENDERER_SPAN")
+                                Y_NameTable_VEntry(DISPLAY_RENDERER_REFERENCE, "DISPLAY_RENDERER_REFERENCE")
+                                  Y_NameTable_End()
+
+                                    Y_Define_NameTable(NameTables::DisplayColorCorrection)
+                                      Y_NameTable_VEntry(DISPLAY_COLOR_CORRECTION_RAW, "DISPLAY_COLOR_CORRECTION_RAW")
+                                        Y_NameTable_VEntry(DISPLAY_COLOR_CORRECTION_GAMMA,
+                                                           "DISPLAY_COLOR_CORRECTION_GAMMA")
+                                          Y_NameTable_VEntry(DISPLAY_COLOR_CORRECTION_GBC_LCD,
+                                                             "DISPLAY_COLOR_CORRECTION_GBC_LCD") Y_NameTable_End()
@@ -17,9 +17,60 @@ enum SYSTEM_MODE
   NUM_SYSTEM_MODES
 };
 
+enum CPU_BACKEND
+{
+  CPU_BACKEND_INTERPRETER,
+  CPU_BACKEND_THREADED_INTERPRETER,
+  CPU_BACKEND_CACHED_INTERPRETER,
+  CPU_BACKEND_RECOMPILER,
+  NUM_CPU_BACKENDS
+};
+
+// stop conditions for System::RunUntil
+enum RUN_CONDITION
+{
+  RUN_CONDITION_PC,           // the cpu is about to execute the instruction at address
+  RUN_CONDITION_MEMORY_WRITE, // the cpu has written to address
+  RUN_CONDITION_VBLANK,       // the display has pushed a frame
+  NUM_RUN_CONDITIONS
+};
+
+// scheduled events, listed in the order they fire when due on the same cycle
+enum SYSTEM_EVENT
+{
+  SYSTEM_EVENT_DISPLAY,
+  SYSTEM_EVENT_AUDIO,
+  SYSTEM_EVENT_SERIAL,
+  SYSTEM_EVENT_TIMER,
+  SYSTEM_EVENT_OAM_DMA,
+  SYSTEM_EVENT_HDMA,
+  NUM_SYSTEM_EVENTS
+};
+
+// scanline renderers of the display
+enum DISPLAY_RENDERER
+{
+  DISPLAY_RENDERER_SPAN,
+  DISPLAY_RENDERER_REFERENCE,
+  NUM_DISPLAY_RENDERERS
+};
+
+// conversion of cgb rgb555 colours to the host
+enum DISPLAY_COLOR_CORRECTION
+{
+  DISPLAY_COLOR_CORRECTION_RAW,     // channels scaled straight to 8 bits
+  DISPLAY_COLOR_CORRECTION_GAMMA,   // midtones darkened to the lcd's response
+  DISPLAY_COLOR_CORRECTION_GBC_LCD, // channels mixed and dimmed like the washed out gbc screen
+  NUM_DISPLAY_COLOR_CORRECTIONS
+};
+
 namespace NameTables
 {
 Y_Declare_NameTable(SystemMode);
+Y_Declare_NameTable(CPUBackend);
+Y_Declare_NameTable(SystemEvent);
+Y_Declare_NameTable(DisplayRenderer);
+Y_Declare_NameTable(DisplayColorCorrection);
 };
 
 #pragma pack(push, 1)
@@ -139,5 +190,8 @@ struct CART_HEADER
 
 #define CART_HEADER_OFFSET (0x0100)
 
-#define SAVESTATE_LOAD_VERSION (5)
-#define SAVESTATE_SAVE_VERSION (5)
+#define SAVESTATE_LOAD_VERSION (8)
+#define SAVESTATE_SAVE_VERSION (8)
+
+// oldest version that can still be loaded, version 5 stored the audio sync point as a 32-bit cycle number
+#define SAVESTATE_MIN_LOAD_VERSION (5)
@@ -16,6 +16,10 @@
 #include <cmath>
 Log_SetChannel(System);
 
+// oam dma moves one byte per machine cycle
+static const uint32 OAM_DMA_LENGTH = 160;
+static const uint32 OAM_DMA_CYCLES_PER_BYTE = 4;
+
 // TODO: Split to separate files
 const uint32 DMG_BIOS_LENGTH = 256;
 const uint32 CGB_BIOS_LENGTH = 2048;
@@ -33,10 +37,36 @@ System::System(CallbackInterface* callbacks)
   m_biosLatch = false;
   m_vramLocked = false;
   m_oamLocked = false;
+  m_memory_locked = false;
+  m_memory_permissive = false;
+  m_accurate_oam_dma = false;
+  m_cpu_backend = CPU_BACKEND_INTERPRETER;
+  m_idle_loop_skipping = true;
+  m_execute_target_clocks = 0;
+  m_execute_stop_at_vblank = false;
+  m_run_ahead_frames = 0;
+  m_audio_sync_latency = 0;
+  m_run_ahead_frame_count = 0;
+  m_run_ahead_snapshot = nullptr;
+  m_memory_watch_address = 0;
+  m_memory_watch_active = false;
+  m_memory_watch_hit = false;
+  m_memory_map_serial = 0;
+  m_cycle_number = 0;
+  m_next_event_cycle = 0;
+  m_event_queue_length = 0;
+  m_event = false;
+  Y_memzero(m_events, sizeof(m_events));
+  Y_memzero(m_event_counts, sizeof(m_event_counts));
+  Y_memzero(m_frame_event_counts, sizeof(m_frame_event_counts));
+  Y_memzero(m_memory_wram_code_pages, sizeof(m_memory_wram_code_pages));
+  Y_memzero(m_memory_read_pages, sizeof(m_memory_read_pages));
+  Y_memzero(m_memory_write_pages, sizeof(m_memory_write_pages));
 }
 
 System::~System()
 {
+  FreeSnapshot(m_run_ahead_snapshot);
   delete m_serial;
   delete m_audio;
   delete m_display;
@@ -65,14 +95,16 @@ bool System::Init(SYSTEM_MODE mode, const byte* bios, uint32 bios_length, Cartri
   m_audio = new Audio(this);
   m_serial = new Serial(this);
 
+  // components synchronize when their event fires, and schedule the next one
+  RegisterEvent(SYSTEM_EVENT_DISPLAY, [](void* param) { static_cast<Display*>(param)->Synchronize(); }, m_display);
+  RegisterEvent(SYSTEM_EVENT_AUDIO, [](void* param) { static_cast<Audio*>(param)->Synchronize(); }, m_audio);
+  RegisterEvent(SYSTEM_EVENT_SERIAL, [](void* param) { static_cast<Serial*>(param)->Synchronize(); }, m_serial);
+  RegisterEvent(SYSTEM_EVENT_TIMER, [](void* param) { static_cast<System*>(param)->SynchronizeTimers(); }, this);
+  RegisterEvent(SYSTEM_EVENT_OAM_DMA, [](void* param) { static_cast<System*>(param)->EndOAMDMATransfer(); }, this);
+  RegisterEvent(SYSTEM_EVENT_HDMA, [](void* param) { static_cast<Display*>(param)->EndHDMATransfer(); }, m_display);
+
   m_cycle_number = 0;
-  m_last_sync_cycle = 0;
-  m_next_display_sync_cycle = 0;
-  m_next_audio_sync_cycle = 0;
-  m_next_serial_sync_cycle = 0;
-  m_next_timer_sync_cycle = 0;
-  m_next_event_cycle = 0;
-  m_event = false;
+  ResetEvents();
 
   m_reset_timer.Reset();
   m_clocks_since_reset = 0;
@@ -90,11 +122,15 @@ bool System::Init(SYSTEM_MODE mode, const byte* bios, uint32 bios_length, Cartri
   m_accurate_timing = true;
   m_paused = false;
   m_serial_pause = false;
+  UpdateAudioSync();
 
-  m_memory_locked_cycles = 0;
+  m_memory_locked = false;
   m_memory_locked_start = 0;
   m_memory_locked_end = 0;
   m_memory_permissive = false;
+  m_oam_dma_source = 0;
+  m_oam_dma_bytes = OAM_DMA_LENGTH;
+  m_oam_dma_start_cycle = 0;
 
   m_high_wram_bank = 1;
   m_vram_bank = 0;
@@ -117,6 +153,7 @@ bool System::Init(SYSTEM_MODE mode, const byte* bios, uint32 bios_length, Cartri
   if (m_bios == nullptr)
     SetPostBootstrapState();
 
+  UpdateMemoryMap();
   Log_InfoPrintf("Initialized system in mode %s.", NameTable_GetNameString(NameTables::SystemMode, m_current_mode));
   return true;
 }
@@ -126,13 +163,7 @@ void System::Reset()
   m_current_mode = m_boot_mode;
 
   m_cycle_number = 0;
-  m_last_sync_cycle = 0;
-  m_next_display_sync_cycle = 0;
-  m_next_audio_sync_cycle = 0;
-  m_next_serial_sync_cycle = 0;
-  m_next_timer_sync_cycle = 0;
-  m_next_event_cycle = 0;
-  m_event = false;
+  ResetEvents();
 
   m_reset_timer.Reset();
   m_clocks_since_reset = 0;
@@ -145,7 +176,7 @@ void System::Reset()
 
   m_frame_counter = 0;
 
-  m_memory_locked_cycles = 0;
+  m_memory_locked = false;
 
   m_high_wram_bank = 1;
   m_vram_bank = 0;
@@ -165,6 +196,7 @@ void System::Reset()
   if (m_bios == nullptr)
     SetPostBootstrapState();
 
+  UpdateMemoryMap();
   Log_InfoPrintf("System reset.");
 }
 
@@ -197,24 +229,149 @@ void System::Step()
   m_cpu->ExecuteInstruction();
 }
 
-void System::UpdateNextEventCycle()
+void System::ExecuteCPU(uint64 target_clocks, bool stop_at_vblank)
 {
-  if (m_event)
+  m_execute_target_clocks = target_clocks;
+  m_execute_stop_at_vblank = stop_at_vblank;
+  if (m_serial_pause)
     return;
 
-  // these results can underflow, but the results will be correct
-  uint32 cycles_to_timer_sync = m_next_timer_sync_cycle - m_cycle_number;
-  uint32 cycles_to_serial_sync = m_next_serial_sync_cycle - m_cycle_number;
-  uint32 cycles_to_audio_sync = m_next_audio_sync_cycle - m_cycle_number;
-  uint32 cycles_to_display_sync = m_next_display_sync_cycle - m_cycle_number;
+  if (m_cpu_backend == CPU_BACKEND_THREADED_INTERPRETER)
+  {
+    m_cpu->ExecuteThreaded();
+  }
+  else if (m_cpu_backend == CPU_BACKEND_CACHED_INTERPRETER)
+  {
+    m_cpu->ExecuteCached();
+  }
+  else if (m_cpu_backend == CPU_BACKEND_RECOMPILER)
+  {
+    m_cpu->ExecuteRecompiled();
+  }
+  else
+  {
+    while (m_clocks_since_reset < m_execute_target_clocks)
+      m_cpu->ExecuteInstruction();
+  }
+
+  m_execute_stop_at_vblank = false;
+}
+
+void System::RegisterEvent(SYSTEM_EVENT event, EventCallback callback, void* param)
+{
+  m_events[event].callback = callback;
+  m_events[event].param = param;
+}
+
+void System::ScheduleEvent(SYSTEM_EVENT event, uint32 cycles)
+{
+  if (m_events[event].pending)
+    CancelEvent(event);
+
+  Event* ev = &m_events[event];
+  ev->cycle = m_cycle_number + cycles;
+  ev->pending = true;
 
-  // find the lowest sync cycle
-  uint32 cycles_to_first_sync =
-    Min(cycles_to_timer_sync, Min(cycles_to_serial_sync, Min(cycles_to_audio_sync, cycles_to_display_sync)));
-  if (m_memory_locked_cycles > 0)
-    cycles_to_first_sync = Min(cycles_to_first_sync, m_memory_locked_cycles);
+  // insert behind everything that fires earlier, or on the same cycle with a lower index
+  uint32 position = m_event_queue_length;
+  while (position > 0)
+  {
+    const uint8 other = m_event_queue[position - 1];
+    if (m_events[other].cycle < ev->cycle || (m_events[other].cycle == ev->cycle && other < event))
+      break;
 
-  m_next_event_cycle = (int32)cycles_to_first_sync;
+    m_event_queue[position] = other;
+    position--;
+  }
+  m_event_queue[position] = uint8(event);
+  m_event_queue_length++;
+  UpdateNextEventCycle();
+}
+
+void System::CancelEvent(SYSTEM_EVENT event)
+{
+  if (!m_events[event].pending)
+    return;
+
+  uint32 position = 0;
+  while (m_event_queue[position] != event)
+    position++;
+
+  m_event_queue_length--;
+  for (; position < m_event_queue_length; position++)
+    m_event_queue[position] = m_event_queue[position + 1];
+
+  m_events[event].pending = false;
+  UpdateNextEventCycle();
+}
+
+uint32 System::GetEventCyclesRemaining(SYSTEM_EVENT event) const
+{
+  if (!m_events[event].pending)
+    return 0;
+
+  return (m_events[event].cycle > m_cycle_number) ? uint32(m_events[event].cycle - m_cycle_number) : 0;
+}
+
+void System::ResetEvents()
+{
+  for (uint32 i = 0; i < NUM_SYSTEM_EVENTS; i++)
+    m_events[i].pending = false;
+
+  m_event_queue_length = 0;
+  m_event = false;
+  Y_memzero(m_event_counts, sizeof(m_event_counts));
+  Y_memzero(m_frame_event_counts, sizeof(m_frame_event_counts));
+
+  // the components synchronize on the first instruction, which schedules everything else
+  ScheduleEvent(SYSTEM_EVENT_DISPLAY, 0);
+  ScheduleEvent(SYSTEM_EVENT_AUDIO, 0);
+  ScheduleEvent(SYSTEM_EVENT_SERIAL, 0);
+  ScheduleEvent(SYSTEM_EVENT_TIMER, 0);
+}
+
+void System::RunEvents()
+{
+  // take the due events off the queue first, an event rescheduled by its own callback waits for the next run
+  uint8 due_events[NUM_SYSTEM_EVENTS];
+  uint32 num_due_events = 0;
+  while (num_due_events < m_event_queue_length &&
+         m_events[m_event_queue[num_due_events]].cycle <= m_cycle_number)
+  {
+    due_events[num_due_events] = m_event_queue[num_due_events];
+    m_events[due_events[num_due_events]].pending = false;
+    num_due_events++;
+  }
+  m_event_queue_length -= num_due_events;
+  for (uint32 i = 0; i < m_event_queue_length; i++)
+    m_event_queue[i] = m_event_queue[i + num_due_events];
+
+  // the downcount is recalculated once everything has been rescheduled
+  m_event = true;
+  for (uint32 i = 0; i < num_due_events; i++)
+  {
+    const Event* ev = &m_events[due_events[i]];
+    m_event_counts[due_events[i]]++;
+    ev->callback(ev->param);
+  }
+
+  m_event = false;
+  UpdateNextEventCycle();
+}
+
+void System::UpdateNextEventCycle()
+{
+  if (m_event)
+    return;
+
+  // overdue events fire after the next instruction
+  if (m_event_queue_length > 0)
+  {
+    const uint64 next_cycle = m_events[m_event_queue[0]].cycle;
+    m_next_event_cycle = (next_cycle > m_cycle_number) ? int32(next_cycle - m_cycle_number) : 0;
+  }
+  else
+    m_next_event_cycle = 4194304;
 }
 
 void System::AddCPUCycles(uint32 cpu_clocks)
@@ -228,42 +385,19 @@ void System::AddCPUCycles(uint32 cpu_clocks)
   if (m_next_event_cycle > 0)
     return;
 
-  // what we will synchronize
-  // when (m_cycle_number + next_sync) overflows, these expressions will keep returning true,
-  // until m_cycle_number overflows as well. certainly not ideal due to the slowdown.
-  // however, due to the downcount above, we should not be triggering often
-  bool sync_timers = (m_cycle_number >= m_next_timer_sync_cycle);
-  bool sync_serial = (m_cycle_number >= m_next_serial_sync_cycle);
-  bool sync_display = (m_cycle_number >= m_next_display_sync_cycle);
-  bool sync_audio = (m_cycle_number >= m_next_audio_sync_cycle);
-  uint32 cycles_since_sync = CalculateDoubleSpeedCycleCount(m_last_sync_cycle);
-  m_last_sync_cycle = m_cycle_number;
-  m_event = true;
-
-  // Handle memory locking for OAM transfers [affected by double speed]
-  if (m_memory_locked_cycles > 0)
-    m_memory_locked_cycles =
-      (cycles_since_sync > m_memory_locked_cycles) ? 0 : (m_memory_locked_cycles - cycles_since_sync);
-
-  // Simulate display [not affected by double speed]
-  if (sync_display)
-    m_display->Synchronize();
-
-  // Simulate audio [not affected by double speed]
-  if (sync_audio)
-    m_audio->Synchronize();
-
-  // Simulate serial [affected by double speed]
-  if (sync_serial)
-    m_serial->Synchronize();
-
-  // Simulate timers [affected by double speed]
-  if (sync_timers)
-    SynchronizeTimers();
+  RunEvents();
+}
 
-  // Update time to next event
-  m_event = false;
-  UpdateNextEventCycle();
+void System::AddIdleCPUCycles()
+{
+  // the same number of 4-clock steps the cpu would have taken one at a time, nothing can wake it between events
+  uint32 event_steps = (m_next_event_cycle > 0) ? ((uint32(m_next_event_cycle) + 3) / 4) : 1;
+  uint32 step_clocks = 4 >> GetDoubleSpeedDivider();
+  uint64 target_steps = 1;
+  if (m_clocks_since_reset < m_execute_target_clocks)
+    target_steps = (m_execute_target_clocks - m_clocks_since_reset + step_clocks - 1) / step_clocks;
+
+  AddCPUCycles(uint32(Min(uint64(event_steps), target_steps)) * 4);
 }
 
 void System::SetSerialPause(bool enabled)
@@ -272,7 +406,12 @@ void System::SetSerialPause(bool enabled)
     return;
 
   m_serial_pause = enabled;
-  if (!m_serial_pause)
+  if (m_serial_pause)
+  {
+    // pick up the pause after the current instruction
+    StopExecution();
+  }
+  else
   {
     m_clocks_since_reset = 0;
     m_last_vblank_clocks = 0;
@@ -296,6 +435,7 @@ void System::TriggerOAMBug()
       0xC2, 0x2D, 0x78, 0x28, 0x24, 0xB1, 0xF5, 0xAC, 0xAC, 0xA5, 0x34, 0x30, 0x41, 0x8B, 0x2E, 0xAF, 0x4B, 0xBB, 0x9F};
 
     Y_memcpy(m_memory_oam + 8, junk, sizeof(junk));
+    m_display->InvalidateSpriteBins();
     // Log_WarningPrintf("OAM bug invoked");
   }
 }
@@ -323,9 +463,21 @@ double System::ExecuteFrame()
     return 0.001;
   }
 
+  // with run-ahead the real frames are only heard, the frame shown is the speculative one
+  bool run_ahead = (m_run_ahead_frames > 0 && !m_serial->m_has_connection);
+  uint32 start_frame = m_frame_counter;
+  if (run_ahead)
+    m_display->SetRenderingEnabled(false);
+
   // framelimiter on?
   double sleep_time;
-  if (m_frame_limiter)
+  if (IsAudioSyncActive())
+  {
+    // the audio output is the clock, the frontend waits on it once the frame has been presented
+    RunFrames(1);
+    sleep_time = 0.0;
+  }
+  else if (m_frame_limiter)
   {
     // using "accurate" timing?
     Timer exec_timer;
@@ -338,12 +490,20 @@ double System::ExecuteFrame()
       uint64 current_clocks = m_clocks_since_reset;
 
       // check that we're not ahead (is perfectly possible since each instruction takes a minimum of 4 clocks)
-      if (target_clocks > current_clocks)
+      if (run_ahead)
+      {
+        // whole frames only, lines of the next frame run here would never be drawn
+        while (m_clocks_since_reset < target_clocks)
+        {
+          if (RunFrames(1) == 0)
+            break;
+        }
+        clocks_executed = m_clocks_since_reset - current_clocks;
+      }
+      else if (target_clocks > current_clocks)
       {
         // keep executing until we meet our target
-        clocks_executed = target_clocks - current_clocks;
-        while (m_clocks_since_reset < target_clocks && !m_serial_pause)
-          Step();
+        clocks_executed = RunCycles(target_clocks - current_clocks);
       }
       else
       {
@@ -364,15 +524,9 @@ double System::ExecuteFrame()
     }
     else
     {
-      uint64 cycles_executed = 0;
-      uint64 last_vblank_clocks = m_last_vblank_clocks;
-
-      // If the display is turned off, this loop will never exit.
-      // Run a maximum of two vblank intervals worth of cycles in this case.
-      while (cycles_executed < (70224 * 2) && last_vblank_clocks == m_last_vblank_clocks && !m_serial_pause)
-      {
-        Step();
-      }
+      // If the display is turned off, we will never hit vblank.
+      // RunFrames runs a maximum of two vblank intervals worth of cycles in this case.
+      RunFrames(1);
 
       sleep_time = Max((VBLANK_INTERVAL / m_speed_multiplier) - exec_timer.GetTimeSeconds(), 0.0);
     }
@@ -380,17 +534,133 @@ double System::ExecuteFrame()
   else
   {
     // framelimiter off, just execute as many as quickly as possible, say, 16ms worth at a time
-    uint64 target_clocks = m_clocks_since_reset + 70224;
-    while (m_clocks_since_reset < target_clocks && !m_serial_pause)
-      Step();
+    // with run-ahead the slice has to end on a vblank, the speculative frame only draws the lines after it
+    if (run_ahead)
+      RunFrames(1);
+    else
+      RunCycles(70224);
 
     // don't sleep
     sleep_time = 0.0;
   }
 
+  if (run_ahead)
+  {
+    // nothing new to show unless a frame was completed, the time spent comes out of the sleep
+    Timer run_ahead_timer;
+    if (m_frame_counter != start_frame)
+      RunAhead();
+    else
+      m_display->SetRenderingEnabled(true);
+
+    sleep_time = Max(sleep_time - run_ahead_timer.GetTimeSeconds(), 0.0);
+  }
+
   return sleep_time;
 }
 
+void System::RunAhead()
+{
+  // speculative frames count towards neither the pacing nor the speed/fps display
+  uint64 clocks_since_reset = m_clocks_since_reset;
+  uint64 last_vblank_clocks = m_last_vblank_clocks;
+  uint64 cycles_since_speed_update = m_cycles_since_speed_update;
+  uint32 frames_since_speed_update = m_frames_since_speed_update;
+  uint32 event_counts[NUM_SYSTEM_EVENTS];
+  uint32 frame_event_counts[NUM_SYSTEM_EVENTS];
+  Y_memcpy(event_counts, m_event_counts, sizeof(event_counts));
+  Y_memcpy(frame_event_counts, m_frame_event_counts, sizeof(frame_event_counts));
+
+  CaptureSnapshot(m_run_ahead_snapshot);
+
+  // keep the cable unplugged so link packets aren't consumed by frames that are thrown away
+  LinkConnectionManager* link = m_serial->GetLinkConnectionManager();
+  m_serial->SetLinkConnectionManager(nullptr);
+
+  // only the last frame is drawn, and none of them are heard
+  m_audio->SetSynthesisEnabled(false);
+  for (uint32 i = 0; i < m_run_ahead_frames; i++)
+  {
+    m_display->SetRenderingEnabled(i == (m_run_ahead_frames - 1));
+    RunFrames(1);
+  }
+  m_run_ahead_frame_count += m_run_ahead_frames;
+
+  RestoreSnapshot(m_run_ahead_snapshot);
+  m_audio->SetSynthesisEnabled(true);
+  m_display->SetRenderingEnabled(true);
+  m_serial->SetLinkConnectionManager(link);
+
+  m_clocks_since_reset = clocks_since_reset;
+  m_last_vblank_clocks = last_vblank_clocks;
+  m_cycles_since_speed_update = cycles_since_speed_update;
+  m_frames_since_speed_update = frames_since_speed_update;
+  Y_memcpy(m_event_counts, event_counts, sizeof(m_event_counts));
+  Y_memcpy(m_frame_event_counts, frame_event_counts, sizeof(m_frame_event_counts));
+}
+
+uint64 System::RunCycles(uint64 clocks)
+{
+  uint64 start_clocks = m_clocks_since_reset;
+  ExecuteCPU(start_clocks + clocks, false);
+  return m_clocks_since_reset - start_clocks;
+}
+
+uint32 System::RunFrames(uint32 frames)
+{
+  uint32 start_frame = m_frame_counter;
+  for (uint32 i = 0; i < frames && !m_serial_pause; i++)
+    ExecuteCPU(m_clocks_since_reset + (70224 * 2), true);
+
+  return m_frame_counter - start_frame;
+}
+
+bool System::RunUntil(RUN_CONDITION condition, uint16 address, uint64 max_clocks)
+{
+  uint64 target_clocks = m_clocks_since_reset + max_clocks;
+  switch (condition)
+  {
+  case RUN_CONDITION_PC:
+  {
+    // checked between every instruction, so this always steps the plain interpreter
+    // at least one instruction is executed, so repeated calls move on to the next hit
+    m_execute_target_clocks = target_clocks;
+    while (!m_serial_pause && m_clocks_since_reset < m_execute_target_clocks)
+    {
+      m_cpu->ExecuteInstruction();
+      if (m_cpu->m_registers.PC == address)
+        return true;
+    }
+
+    return false;
+  }
+
+  case RUN_CONDITION_MEMORY_WRITE:
+  {
+    // route the page through CPUWriteSlow for the duration
+    m_memory_watch_address = address;
+    m_memory_watch_active = true;
+    m_memory_watch_hit = false;
+    UpdateMemoryMap(address, address);
+
+    ExecuteCPU(target_clocks, false);
+
+    m_memory_watch_active = false;
+    UpdateMemoryMap(address, address);
+    return m_memory_watch_hit;
+  }
+
+  case RUN_CONDITION_VBLANK:
+  {
+    uint32 start_frame = m_frame_counter;
+    ExecuteCPU(target_clocks, true);
+    return (m_frame_counter != start_frame);
+  }
+  }
+
+  return false;
+}
+
 void System::CalculateCurrentSpeed()
 {
   float diff = float(m_speed_timer.GetTimeSeconds());
@@ -476,6 +746,7 @@ void System::SetTargetSpeed(float multiplier)
 
   m_speed_timer.Reset();
   m_cycles_since_speed_update = 0;
+  UpdateAudioSync();
 }
 
 void System::SetFrameLimiter(bool on)
@@ -487,6 +758,52 @@ void System::SetFrameLimiter(bool on)
 
   m_speed_timer.Reset();
   m_cycles_since_speed_update = 0;
+  UpdateAudioSync();
+}
+
+void System::SetAudioSyncLatency(uint32 latency_ms)
+{
+  m_audio_sync_latency = latency_ms;
+  UpdateAudioSync();
+}
+
+bool System::IsAudioSyncActive() const
+{
+  return (m_audio_sync_latency > 0 && m_frame_limiter && m_speed_multiplier == 1.0f && m_audio != nullptr &&
+          m_audio->GetOutputEnabled());
+}
+
+double System::GetAudioSyncWaitTime()
+{
+  if (!IsAudioSyncActive() || m_paused || m_serial_pause)
+    return 0.0;
+
+  return m_audio->GetOutputWaitTime();
+}
+
+void System::UpdateAudioSync()
+{
+  if (m_audio == nullptr)
+    return;
+
+  m_audio->SetRateControl(IsAudioSyncActive() ? m_audio_sync_latency : 0);
+}
+
+void System::SetCPUBackend(CPU_BACKEND backend)
+{
+  DebugAssert(backend < NUM_CPU_BACKENDS);
+  if (m_cpu_backend == backend)
+    return;
+
+  Log_InfoPrintf("Switching CPU backend to %s.", NameTable_GetNameString(NameTables::CPUBackend, backend));
+  m_cpu_backend = backend;
+
+  // only the cached interpreter and recompiler need working ram code pages to be write-tracked
+  if (m_cpu != nullptr)
+  {
+    m_cpu->FlushBlockCache();
+    UpdateMemoryMap();
+  }
 }
 
 void System::SetAccurateTiming(bool on)
@@ -500,6 +817,33 @@ void System::SetAccurateTiming(bool on)
   m_cycles_since_speed_update = 0;
 }
 
+void System::SetAccurateOAMDMA(bool on)
+{
+  // a transfer in progress finishes its copy straight away
+  if (!on && m_oam_dma_bytes < OAM_DMA_LENGTH)
+    CopyOAMDMABytes(OAM_DMA_LENGTH);
+
+  m_accurate_oam_dma = on;
+}
+
+void System::SetRunAheadFrames(uint32 frames)
+{
+  if (m_run_ahead_frames == frames)
+    return;
+
+  Log_InfoPrintf("Run-ahead set to %u frames.", frames);
+  m_run_ahead_frames = frames;
+  if (frames > 0 && m_run_ahead_snapshot == nullptr)
+  {
+    m_run_ahead_snapshot = AllocateSnapshot();
+  }
+  else if (frames == 0)
+  {
+    FreeSnapshot(m_run_ahead_snapshot);
+    m_run_ahead_snapshot = nullptr;
+  }
+}
+
 bool System::GetAudioEnabled() const
 {
   return m_audio->GetOutputEnabled();
@@ -508,6 +852,7 @@ bool System::GetAudioEnabled() const
 void System::SetAudioEnabled(bool enabled)
 {
   m_audio->SetOutputEnabled(enabled);
+  UpdateAudioSync();
 }
 
 bool System::LoadState(ByteStream* pStream, Error* pError)
@@ -517,10 +862,10 @@ bool System::LoadState(ByteStream* pStream, Error* pError)
   // Create stream, load header
   BinaryReader binaryReader(pStream);
   uint32 saveStateVersion = binaryReader.ReadUInt32();
-  if (saveStateVersion != SAVESTATE_LOAD_VERSION)
+  if (saveStateVersion < SAVESTATE_MIN_LOAD_VERSION || saveStateVersion > SAVESTATE_LOAD_VERSION)
   {
-    pError->SetErrorUserFormatted(1, "Save state version mismatch, expected %u, got %u", (uint32)SAVESTATE_LOAD_VERSION,
-                                  saveStateVersion);
+    pError->SetErrorUserFormatted(1, "Save state version mismatch, expected %u-%u, got %u",
+                                  (uint32)SAVESTATE_MIN_LOAD_VERSION, (uint32)SAVESTATE_LOAD_VERSION, saveStateVersion);
     return false;
   }
 
@@ -536,8 +881,10 @@ bool System::LoadState(ByteStream* pStream, Error* pError)
 
   // Read memory
   binaryReader.ReadBytes(m_memory_vram, sizeof(m_memory_vram));
+  m_display->InvalidateTileCache();
   binaryReader.ReadBytes(m_memory_wram, sizeof(m_memory_wram));
   binaryReader.ReadBytes(m_memory_oam, sizeof(m_memory_oam));
+  m_display->InvalidateSpriteBins();
   binaryReader.ReadBytes(m_memory_zram, sizeof(m_memory_zram));
 
   // Read registers
@@ -545,10 +892,10 @@ bool System::LoadState(ByteStream* pStream, Error* pError)
   m_high_wram_bank = binaryReader.ReadUInt8();
   m_reg_FF4C = binaryReader.ReadUInt8();
   m_reg_FF6C = binaryReader.ReadUInt8();
-  m_memory_locked_cycles = binaryReader.ReadUInt32();
-  m_timer_clocks = binaryReader.ReadUInt32();
-  m_timer_divider_clocks = binaryReader.ReadUInt32();
-  m_timer_divider = binaryReader.ReadUInt8();
+  uint32 memory_locked_cycles = binaryReader.ReadUInt32();
+  binaryReader.ReadUInt32(); // timer clocks, the timer phase comes from the system counter
+  uint32 timer_divider_clocks = binaryReader.ReadUInt32();
+  m_timer_system_counter = uint16((uint32(binaryReader.ReadUInt8()) << 8) | (timer_divider_clocks & 0xFF));
   m_timer_counter = binaryReader.ReadUInt8();
   m_timer_overflow_value = binaryReader.ReadUInt8();
   m_timer_control = binaryReader.ReadUInt8();
@@ -559,14 +906,37 @@ bool System::LoadState(ByteStream* pStream, Error* pError)
   m_biosLatch = binaryReader.ReadBool();
   m_vramLocked = binaryReader.ReadBool();
   m_oamLocked = binaryReader.ReadBool();
-  if (pStream->InErrorState())
+
+  // older states always copied the whole transfer when it started
+  m_oam_dma_source = 0;
+  m_oam_dma_bytes = OAM_DMA_LENGTH;
+  if (saveStateVersion >= 8)
+  {
+    m_oam_dma_source = binaryReader.ReadUInt16();
+    m_oam_dma_bytes = binaryReader.ReadUInt8();
+  }
+  if (pStream->InErrorState() || m_oam_dma_bytes > OAM_DMA_LENGTH ||
+      memory_locked_cycles > (OAM_DMA_LENGTH * OAM_DMA_CYCLES_PER_BYTE))
   {
     pError->SetErrorUserFormatted(1, "Stream read error after restoring system.");
     return false;
   }
 
+  // resume an oam dma transfer in progress
+  m_memory_locked = (memory_locked_cycles > 0);
+  if (m_memory_locked)
+  {
+    m_oam_dma_start_cycle = m_cycle_number + memory_locked_cycles - (OAM_DMA_LENGTH * OAM_DMA_CYCLES_PER_BYTE);
+    ScheduleEvent(SYSTEM_EVENT_OAM_DMA, memory_locked_cycles);
+  }
+  else
+  {
+    m_oam_dma_bytes = OAM_DMA_LENGTH;
+    CancelEvent(SYSTEM_EVENT_OAM_DMA);
+  }
+
   // Read Cartridge state
-  if (!m_cartridge->LoadState(pStream, binaryReader, pError))
+  if (!m_cartridge->LoadState(pStream, binaryReader, saveStateVersion, pError))
     return false;
   if (pStream->InErrorState())
   {
@@ -601,8 +971,12 @@ bool System::LoadState(ByteStream* pStream, Error* pError)
     return false;
   }
 
+  // older states stored a cycle number from the saving session rather than the cycles since the last sync
+  if (saveStateVersion < 6)
+    m_audio->m_last_cycle = m_cycle_number;
+
   // Read serial state
-  if (!m_serial->LoadState(pStream, binaryReader, pError))
+  if (!m_serial->LoadState(pStream, binaryReader, saveStateVersion, pError))
     return false;
   if (pStream->InErrorState())
   {
@@ -610,15 +984,20 @@ bool System::LoadState(ByteStream* pStream, Error* pError)
     return false;
   }
 
+  // states are saved with the timers synchronized
+  m_timer_last_cycle = m_cycle_number;
+  ScheduleTimerSynchronization();
+
   // Done
-  saveStateVersion = binaryReader.ReadUInt32();
-  if (saveStateVersion != ~(uint32)SAVESTATE_LOAD_VERSION || pStream->InErrorState())
+  uint32 trailingSignature = binaryReader.ReadUInt32();
+  if (trailingSignature != ~saveStateVersion || pStream->InErrorState())
   {
     pError->SetErrorUserFormatted(1, "Error reading trailing signature.");
     return false;
   }
 
   // All good
+  UpdateMemoryMap();
   Log_DevPrintf("State loaded.");
   Log_ProfilePrintf("State load took %.4fms", loadTimer.GetTimeMilliseconds());
   return true;
@@ -628,6 +1007,14 @@ bool System::SaveState(ByteStream* pStream)
 {
   Timer saveTimer;
 
+  // bring everything up to the current cycle first, so no time is lost between saving and loading the state
+  m_display->Synchronize();
+  m_serial->Synchronize();
+  SynchronizeTimers();
+  SynchronizeOAMDMA();
+  if (m_cartridge != nullptr)
+    m_cartridge->SynchronizeRTC();
+
   // Create stream, write header
   BinaryWriter binaryWriter(pStream);
   binaryWriter.WriteUInt32(SAVESTATE_SAVE_VERSION);
@@ -648,10 +1035,10 @@ bool System::SaveState(ByteStream* pStream)
   binaryWriter.WriteUInt8(m_high_wram_bank);
   binaryWriter.WriteUInt8(m_reg_FF4C);
   binaryWriter.WriteUInt8(m_reg_FF6C);
-  binaryWriter.WriteUInt32(m_memory_locked_cycles);
-  binaryWriter.WriteUInt32(m_timer_clocks);
-  binaryWriter.WriteUInt32(m_timer_divider_clocks);
-  binaryWriter.WriteUInt8(m_timer_divider);
+  binaryWriter.WriteUInt32(m_memory_locked ? Max(GetEventCyclesRemaining(SYSTEM_EVENT_OAM_DMA), 1u) : 0u);
+  binaryWriter.WriteUInt32(m_timer_system_counter & (GetTimerPeriod(m_timer_control) - 1));
+  binaryWriter.WriteUInt32(m_timer_system_counter & 0xFF);
+  binaryWriter.WriteUInt8(uint8(m_timer_system_counter >> 8));
   binaryWriter.WriteUInt8(m_timer_counter);
   binaryWriter.WriteUInt8(m_timer_overflow_value);
   binaryWriter.WriteUInt8(m_timer_control);
@@ -662,6 +1049,8 @@ bool System::SaveState(ByteStream* pStream)
   binaryWriter.WriteBool(m_biosLatch);
   binaryWriter.WriteBool(m_vramLocked);
   binaryWriter.WriteBool(m_oamLocked);
+  binaryWriter.WriteUInt16(m_oam_dma_source);
+  binaryWriter.WriteUInt8(uint8(m_oam_dma_bytes));
   if (pStream->InErrorState())
     return false;
 
@@ -701,6 +1090,222 @@ bool System::SaveState(ByteStream* pStream)
   return true;
 }
 
+struct System::Snapshot
+{
+  const System* system;
+  uint32 external_ram_size;
+
+  // scheduler, cycle numbers are absolute so the pending events carry over unchanged
+  uint64 cycle_number;
+  uint64 event_cycles[NUM_SYSTEM_EVENTS];
+  bool event_pending[NUM_SYSTEM_EVENTS];
+  uint8 event_queue[NUM_SYSTEM_EVENTS];
+  uint32 event_queue_length;
+
+  SYSTEM_MODE current_mode;
+  uint32 frame_counter;
+
+  // memory
+  byte memory_vram[2][0x2000];
+  byte memory_wram[8][0x1000];
+  byte memory_oam[0xFF];
+  byte memory_zram[127];
+
+  // registers
+  uint8 vram_bank;
+  uint8 high_wram_bank;
+  uint8 reg_FF4C;
+  uint8 reg_FF6C;
+  bool memory_locked;
+  uint16 memory_locked_start;
+  uint16 memory_locked_end;
+  uint16 oam_dma_source;
+  uint32 oam_dma_bytes;
+  uint64 oam_dma_start_cycle;
+  uint64 timer_last_cycle;
+  uint16 timer_system_counter;
+  uint8 timer_counter;
+  uint8 timer_overflow_value;
+  uint8 timer_control;
+  uint8 pad_row_select;
+  uint8 pad_direction_state;
+  uint8 pad_button_state;
+  uint8 cgb_speed_switch;
+  bool bios_latch;
+  bool vram_locked;
+  bool oam_locked;
+
+  // components
+  CPU::SnapshotState cpu;
+  Display::SnapshotState display;
+  Audio::SnapshotState audio;
+  Serial::SnapshotState serial;
+  Cartridge::SnapshotState cartridge;
+
+  // followed by external_ram_size bytes of cartridge ram
+  byte* GetExternalRAM() { return reinterpret_cast<byte*>(this + 1); }
+  const byte* GetExternalRAM() const { return reinterpret_cast<const byte*>(this + 1); }
+};
+
+uint32 System::GetSnapshotSize() const
+{
+  return uint32(sizeof(Snapshot)) + ((m_cartridge != nullptr) ? m_cartridge->GetExternalRAMSize() : 0);
+}
+
+System::Snapshot* System::AllocateSnapshot() const
+{
+  uint32 size = GetSnapshotSize();
+  Snapshot* snapshot = reinterpret_cast<Snapshot*>(Y_malloc(size));
+  Y_memzero(snapshot, size);
+  snapshot->system = this;
+  snapshot->external_ram_size = size - uint32(sizeof(Snapshot));
+
+  // cartridge ram versions start at one, so the first capture always copies it
+  return snapshot;
+}
+
+void System::FreeSnapshot(Snapshot* snapshot)
+{
+  Y_free(snapshot);
+}
+
+void System::CaptureSnapshot(Snapshot* snapshot)
+{
+  DebugAssert(snapshot->system == this);
+
+  // components first, the audio capture reschedules its event
+  m_cpu->SaveSnapshot(&snapshot->cpu);
+  m_display->SaveSnapshot(&snapshot->display);
+  m_audio->SaveSnapshot(&snapshot->audio);
+  m_serial->SaveSnapshot(&snapshot->serial);
+  if (m_cartridge != nullptr)
+    m_cartridge->SaveSnapshot(&snapshot->cartridge, snapshot->GetExternalRAM());
+
+  snapshot->cycle_number = m_cycle_number;
+  for (uint32 i = 0; i < NUM_SYSTEM_EVENTS; i++)
+  {
+    snapshot->event_cycles[i] = m_events[i].cycle;
+    snapshot->event_pending[i] = m_events[i].pending;
+  }
+  Y_memcpy(snapshot->event_queue, m_event_queue, sizeof(m_event_queue));
+  snapshot->event_queue_length = m_event_queue_length;
+
+  snapshot->current_mode = m_current_mode;
+  snapshot->frame_counter = m_frame_counter;
+
+  Y_memcpy(snapshot->memory_vram, m_memory_vram, sizeof(m_memory_vram));
+  Y_memcpy(snapshot->memory_wram, m_memory_wram, sizeof(m_memory_wram));
+  Y_memcpy(snapshot->memory_oam, m_memory_oam, sizeof(m_memory_oam));
+  Y_memcpy(snapshot->memory_zram, m_memory_zram, sizeof(m_memory_zram));
+
+  snapshot->vram_bank = m_vram_bank;
+  snapshot->high_wram_bank = m_high_wram_bank;
+  snapshot->reg_FF4C = m_reg_FF4C;
+  snapshot->reg_FF6C = m_reg_FF6C;
+  snapshot->memory_locked = m_memory_locked;
+  snapshot->memory_locked_start = m_memory_locked_start;
+  snapshot->memory_locked_end = m_memory_locked_end;
+  snapshot->oam_dma_source = m_oam_dma_source;
+  snapshot->oam_dma_bytes = m_oam_dma_bytes;
+  snapshot->oam_dma_start_cycle = m_oam_dma_start_cycle;
+  snapshot->timer_last_cycle = m_timer_last_cycle;
+  snapshot->timer_system_counter = m_timer_system_counter;
+  snapshot->timer_counter = m_timer_counter;
+  snapshot->timer_overflow_value = m_timer_overflow_value;
+  snapshot->timer_control = m_timer_control;
+  snapshot->pad_row_select = m_pad_row_select;
+  snapshot->pad_direction_state = m_pad_direction_state;
+  snapshot->pad_button_state = m_pad_button_state;
+  snapshot->cgb_speed_switch = m_cgb_speed_switch;
+  snapshot->bios_latch = m_biosLatch;
+  snapshot->vram_locked = m_vramLocked;
+  snapshot->oam_locked = m_oamLocked;
+}
+
+void System::RestoreSnapshot(const Snapshot* snapshot)
+{
+  DebugAssert(snapshot->system == this);
+
+  // the audio restore ends the current frame, so it has to run before the cycle number goes back
+  m_current_mode = snapshot->current_mode;
+  m_audio->LoadSnapshot(&snapshot->audio);
+  m_cpu->LoadSnapshot(&snapshot->cpu);
+  m_display->LoadSnapshot(&snapshot->display);
+  m_serial->LoadSnapshot(&snapshot->serial);
+  if (m_cartridge != nullptr)
+    m_cartridge->LoadSnapshot(&snapshot->cartridge, snapshot->GetExternalRAM());
+
+  m_cycle_number = snapshot->cycle_number;
+  for (uint32 i = 0; i < NUM_SYSTEM_EVENTS; i++)
+  {
+    m_events[i].cycle = snapshot->event_cycles[i];
+    m_events[i].pending = snapshot->event_pending[i];
+  }
+  Y_memcpy(m_event_queue, snapshot->event_queue, sizeof(m_event_queue));
+  m_event_queue_length = snapshot->event_queue_length;
+  UpdateNextEventCycle();
+
+  m_frame_counter = snapshot->frame_counter;
+
+  // cached code is only dropped from working ram pages whose contents actually change
+  for (uint32 i = 0; i < countof(m_memory_wram_code_pages); i++)
+  {
+    if (m_memory_wram_code_pages[i] &&
+        Y_memcmp(&m_memory_wram[0][i * 256], &snapshot->memory_wram[0][i * 256], 256) != 0)
+    {
+      m_cpu->FlushCachedPage(&m_cpu->m_wram_cache_pages[i]);
+      m_memory_wram_code_pages[i] = false;
+    }
+  }
+
+  Y_memcpy(m_memory_vram, snapshot->memory_vram, sizeof(m_memory_vram));
+  m_display->InvalidateTileCache();
+  Y_memcpy(m_memory_wram, snapshot->memory_wram, sizeof(m_memory_wram));
+  Y_memcpy(m_memory_oam, snapshot->memory_oam, sizeof(m_memory_oam));
+  m_display->InvalidateSpriteBins();
+  Y_memcpy(m_memory_zram, snapshot->memory_zram, sizeof(m_memory_zram));
+
+  m_vram_bank = snapshot->vram_bank;
+  m_high_wram_bank = snapshot->high_wram_bank;
+  m_reg_FF4C = snapshot->reg_FF4C;
+  m_reg_FF6C = snapshot->reg_FF6C;
+  m_memory_locked = snapshot->memory_locked;
+  m_memory_locked_start = snapshot->memory_locked_start;
+  m_memory_locked_end = snapshot->memory_locked_end;
+  m_oam_dma_source = snapshot->oam_dma_source;
+  m_oam_dma_bytes = snapshot->oam_dma_bytes;
+  m_oam_dma_start_cycle = snapshot->oam_dma_start_cycle;
+  m_timer_last_cycle = snapshot->timer_last_cycle;
+  m_timer_system_counter = snapshot->timer_system_counter;
+  m_timer_counter = snapshot->timer_counter;
+  m_timer_overflow_value = snapshot->timer_overflow_value;
+  m_timer_control = snapshot->timer_control;
+  m_pad_row_select = snapshot->pad_row_select;
+  m_pad_direction_state = snapshot->pad_direction_state;
+  m_pad_button_state = snapshot->pad_button_state;
+  m_cgb_speed_switch = snapshot->cgb_speed_switch;
+  m_biosLatch = snapshot->bios_latch;
+  m_vramLocked = snapshot->vram_locked;
+  m_oamLocked = snapshot->oam_locked;
+
+  // banks and locks may have changed
+  UpdateMemoryMap();
+}
+
+uint64 System::GetMemoryHash() const
+{
+  // fnv-1a
+  uint64 hash = 14695981039346656037ull;
+  auto HashBytes = [&hash](const byte* data, size_t length) {
+    for (size_t i = 0; i < length; i++)
+      hash = (hash ^ data[i]) * 1099511628211ull;
+  };
+  HashBytes(&m_memory_wram[0][0], sizeof(m_memory_wram));
+  HashBytes(&m_memory_vram[0][0], sizeof(m_memory_vram));
+  HashBytes(m_memory_oam, sizeof(m_memory_oam));
+  return hash;
+}
+
 void System::DisableCPU(bool disabled)
 {
   m_cpu->Disable(disabled);
@@ -708,7 +1313,13 @@ void System::DisableCPU(bool disabled)
 
 void System::OAMDMATransfer(uint16 source_address)
 {
-  m_memory_locked_cycles = 0;
+  // release any previous lock, the source range may differ
+  if (m_memory_locked)
+  {
+    SynchronizeOAMDMA();
+    m_memory_locked = false;
+    UpdateMemoryMap(m_memory_locked_start, m_memory_locked_end);
+  }
 
   // select locked memory range
   switch (source_address & 0xF000)
@@ -766,6 +1377,9 @@ void System::OAMDMATransfer(uint16 source_address)
   // Is this correct?
   bool vramLocked = m_vramLocked;
 
+  m_oam_dma_source = source_address;
+  m_oam_dma_start_cycle = m_cycle_number;
+  m_oam_dma_bytes = OAM_DMA_LENGTH;
   if (source_address == 0xFE00)
   {
     // OAM-OAM - ignore?
@@ -774,21 +1388,71 @@ void System::OAMDMATransfer(uint16 source_address)
   else if (source_address == 0xFF00)
   {
     // MMIO/ZRAM->OAM - copy zeros?
-    for (uint32 i = 0; i < 160; i++)
-      m_memory_oam[i] = 0;
+    Y_memzero(m_memory_oam, OAM_DMA_LENGTH);
+  }
+  else if (m_accurate_oam_dma)
+  {
+    // copied as the cpu runs, cpu reads and the display both catch the transfer up to the current cycle first
+    m_oam_dma_bytes = 0;
   }
   else
   {
-    // slow but due to the ranges has to be done this way
-    // TODO: break this up for reads/writes when in progress
-    for (uint32 i = 0; i < 160; i++)
-      m_memory_oam[i] = CPURead(source_address + (uint16)i);
+    // sources without side effects are mapped (the transfer never crosses a page), anything else has to be read
+    const byte* source_pointer = m_memory_read_pages[source_address >> 8];
+    if (source_pointer != nullptr)
+    {
+      Y_memcpy(m_memory_oam, source_pointer, OAM_DMA_LENGTH);
+    }
+    else
+    {
+      for (uint32 i = 0; i < OAM_DMA_LENGTH; i++)
+        m_memory_oam[i] = CPURead(source_address + (uint16)i);
+    }
   }
 
+  m_display->InvalidateSpriteBins();
+
   // Stall memory access for ~160 microseconds
   m_vramLocked = vramLocked;
-  m_memory_locked_cycles = 640;
-  UpdateNextEventCycle();
+  m_memory_locked = true;
+  UpdateMemoryMap(m_memory_locked_start, m_memory_locked_end);
+  ScheduleEvent(SYSTEM_EVENT_OAM_DMA, OAM_DMA_LENGTH * OAM_DMA_CYCLES_PER_BYTE);
+}
+
+void System::EndOAMDMATransfer()
+{
+  // lines drawn during an accurate transfer have to see it in progress, not the finished copy
+  if (m_oam_dma_bytes < OAM_DMA_LENGTH)
+    m_display->Synchronize();
+
+  SynchronizeOAMDMA();
+  m_memory_locked = false;
+  UpdateMemoryMap(m_memory_locked_start, m_memory_locked_end);
+}
+
+uint32 System::SynchronizeOAMDMA()
+{
+  if (!m_memory_locked)
+    return OAM_DMA_LENGTH;
+
+  uint64 elapsed_cycles = m_cycle_number - m_oam_dma_start_cycle;
+  uint32 bytes = uint32(Min(elapsed_cycles / OAM_DMA_CYCLES_PER_BYTE, uint64(OAM_DMA_LENGTH)));
+  if (bytes > m_oam_dma_bytes)
+    CopyOAMDMABytes(bytes);
+
+  return bytes;
+}
+
+void System::CopyOAMDMABytes(uint32 end)
+{
+  // the transfer owns the bus, so it reads through its own lock
+  bool memory_locked = m_memory_locked;
+  m_memory_locked = false;
+  for (; m_oam_dma_bytes < end; m_oam_dma_bytes++)
+    m_memory_oam[m_oam_dma_bytes] = CPUReadSlow(m_oam_dma_source + uint16(m_oam_dma_bytes));
+
+  m_memory_locked = memory_locked;
+  m_display->InvalidateSpriteBins();
 }
 
 bool System::SwitchCGBSpeed()
@@ -801,6 +1465,8 @@ bool System::SwitchCGBSpeed()
   m_audio->Synchronize();
   m_serial->Synchronize();
   SynchronizeTimers();
+  if (m_cartridge != nullptr)
+    m_cartridge->SynchronizeRTC();
 
   // Flips the switch bit off at the same time.
   m_cgb_speed_switch ^= 0x81;
@@ -829,8 +1495,10 @@ void System::ResetMemory()
 
   // zero all memory
   Y_memzero(m_memory_vram, sizeof(m_memory_vram));
+  m_display->InvalidateTileCache();
   Y_memzero(m_memory_wram, sizeof(m_memory_wram));
   Y_memzero(m_memory_oam, sizeof(m_memory_oam));
+  m_display->InvalidateSpriteBins();
   Y_memzero(m_memory_zram, sizeof(m_memory_zram));
   Y_memzero(m_memory_ioreg, sizeof(m_memory_ioreg));
 
@@ -841,9 +1509,7 @@ void System::ResetMemory()
 void System::ResetTimer()
 {
   m_timer_last_cycle = 0;
-  m_timer_clocks = 0;
-  m_timer_divider_clocks = 0;
-  m_timer_divider = 1;
+  m_timer_system_counter = 0x0100;
   m_timer_counter = 0;
   m_timer_overflow_value = 0;
   m_timer_control = 0;
@@ -859,13 +1525,14 @@ void System::ResetPad()
 void System::SetPostBootstrapState()
 {
   // http://bgb.bircd.org/pandocs.txt -> Power Up Sequence
-  CPU::Registers* registers = m_cpu->GetRegisters();
-  registers->AF = (InCGBMode()) ? 0x11B0 : 0x01B0;
-  registers->BC = 0x0013;
-  registers->DE = 0x00D8;
-  registers->HL = 0x014D;
-  registers->SP = 0xFFFE;
-  registers->PC = 0x0100;
+  CPU::Registers registers = m_cpu->GetRegisters();
+  registers.AF = (InCGBMode()) ? 0x11B0 : 0x01B0;
+  registers.BC = 0x0013;
+  registers.DE = 0x00D8;
+  registers.HL = 0x014D;
+  registers.SP = 0xFFFE;
+  registers.PC = 0x0100;
+  m_cpu->SetRegisters(registers);
 
   CPUWriteIORegister(0x05, 0x00);                        // TIMA
   CPUWriteIORegister(0x06, 0x00);                        // TMA
@@ -900,53 +1567,40 @@ void System::SetPostBootstrapState()
   CPUWriteIORegister(0xFF, 0x00);                        // IE
 
   m_biosLatch = false;
+  UpdateMemoryMap(0x0000, 0x08FF);
 }
 
 void System::SynchronizeTimers()
 {
-  uint32 cycles_to_execute = CalculateDoubleSpeedCycleCount(m_timer_last_cycle);
-  m_timer_last_cycle = GetCycleNumber();
+  // the system counter runs at the cpu clock, so it is 4,194,304hz (8,388,608hz in double speed mode)
+  uint64 cycles_to_execute = m_cycle_number - m_timer_last_cycle;
+  uint16 old_system_counter = m_timer_system_counter;
+  m_timer_system_counter = uint16(old_system_counter + cycles_to_execute);
+  m_timer_last_cycle = m_cycle_number;
 
-  // cpu runs at 4,194,304hz
-  // timer runs at 16,384hz
-  // therefore, every 256 cpu "clocks" equals one timer tick
-  m_timer_divider_clocks += cycles_to_execute;
-  while (m_timer_divider_clocks >= 256)
-  {
-    m_timer_divider++;
-    m_timer_divider_clocks -= 256;
-  }
-
-  // timer start/stop
+  // TIMA ticks once for every multiple of the selected bit's period the counter passed
   if (m_timer_control & 0x4)
   {
-    // add cycles
-    m_timer_clocks += cycles_to_execute;
-
-    // find timer rate
-    // static const uint32 clock_rates[] = { 4096, 262144, 65536, 16384 };
-    static const uint32 clocks_per_timer_ticks[] = {1024, 16, 64, 256};
-    uint32 clocks_per_timer_tick = clocks_per_timer_ticks[m_timer_control & 0x3];
-
-    // cap at one iteration when the rate changes
-    // if (m_timer_control_changed && m_timer_cycles > clock_rate)
-    // m_timer_cycles %= clock_rate;
+    uint32 period = GetTimerPeriod(m_timer_control);
+    AddTimerTicks(((old_system_counter & (period - 1)) + cycles_to_execute) / period);
+  }
 
-    // increment timer
-    while (m_timer_clocks >= clocks_per_timer_tick)
-    {
-      if ((++m_timer_counter) == 0x00)
-      {
-        // timer overflow
-        CPUInterruptRequest(CPU_INT_TIMER);
-        m_timer_counter = m_timer_overflow_value;
-      }
+  ScheduleTimerSynchronization();
+}
 
-      m_timer_clocks -= clocks_per_timer_tick;
-    }
+void System::AddTimerTicks(uint64 ticks)
+{
+  uint32 ticks_to_overflow = 256 - m_timer_counter;
+  if (ticks < ticks_to_overflow)
+  {
+    m_timer_counter += uint8(ticks);
+    return;
   }
 
-  ScheduleTimerSynchronization();
+  // every overflow after the first starts from TMA, so only what is left of the last one matters
+  uint32 ticks_per_reload = 256 - m_timer_overflow_value;
+  m_timer_counter = uint8(m_timer_overflow_value + ((ticks - ticks_to_overflow) % ticks_per_reload));
+  CPUInterruptRequest(CPU_INT_TIMER);
 }
 
 void System::ScheduleTimerSynchronization()
@@ -954,15 +1608,14 @@ void System::ScheduleTimerSynchronization()
   if (m_timer_control & 0x4)
   {
     // schedule update for the next interrupt time
-    static const uint32 clocks_per_timer_ticks[] = {1024, 16, 64, 256};
-    uint32 clocks_per_timer_tick = clocks_per_timer_ticks[m_timer_control & 0x3];
-    uint32 next_interrupt_time = (256 - m_timer_counter) * clocks_per_timer_tick - m_timer_clocks;
+    uint32 period = GetTimerPeriod(m_timer_control);
+    uint32 next_interrupt_time = (256 - m_timer_counter) * period - (m_timer_system_counter & (period - 1));
     SetNextTimerSyncCycle(next_interrupt_time);
   }
   else
   {
-    // divider timer is updated on-demand when it is read, so just set to +1 sec
-    SetNextTimerSyncCycle(4194304);
+    // nothing to do until the timer is enabled, DIV is derived from the cycle number when it is read
+    CancelEvent(SYSTEM_EVENT_TIMER);
   }
 }
 
@@ -977,18 +1630,102 @@ void System::DisassembleCart(const char* outfile)
   pStream->Release();
 }
 
-uint8 System::CPURead(uint16 address)
+void System::UpdateMemoryMap(uint16 start_address, uint16 end_address)
+{
+  // cached cpu blocks re-validate their page when this changes
+  m_memory_map_serial++;
+
+  for (uint32 page = (uint32)(start_address >> 8); page <= (uint32)(end_address >> 8); page++)
+  {
+    uint16 address = (uint16)(page << 8);
+    const byte* read_pointer = nullptr;
+    byte* write_pointer = nullptr;
+
+    // pages overlapping a DMA-locked range always go through the slow path
+    if (m_memory_locked && !m_memory_permissive && (address | 0xFF) >= m_memory_locked_start &&
+        address <= m_memory_locked_end)
+    {
+      m_memory_read_pages[page] = nullptr;
+      m_memory_write_pages[page] = nullptr;
+      continue;
+    }
+
+    switch (address & 0xF000)
+    {
+      // cart memory, writes are mbc control or tracked for battery saves
+    case 0x0000:
+    case 0x1000:
+    case 0x2000:
+    case 0x3000:
+    case 0x4000:
+    case 0x5000:
+    case 0x6000:
+    case 0x7000:
+    case 0xA000:
+    case 0xB000:
+    {
+      // DMG rom is 256 bytes from 0000->00FF
+      // CGB rom is 256 bytes from 0000->00FF, 0200->08FF
+      bool cgb_bios = (m_biosLatch && m_current_mode == SYSTEM_MODE_CGB);
+      if (((m_biosLatch && m_current_mode == SYSTEM_MODE_DMG) || cgb_bios) && address <= 0x00FF)
+        read_pointer = m_bios + address;
+      else if (cgb_bios && address >= 0x0200 && address <= 0x08FF)
+        read_pointer = m_bios + 0x0100 + (address - 0x0200);
+      else if (m_cartridge != nullptr)
+        read_pointer = m_cartridge->GetReadPagePointer(address);
+    }
+    break;
+
+      // vram, needs the display to be synchronized to determine the lock state
+    case 0x8000:
+    case 0x9000:
+      break;
+
+      // working ram
+    case 0xC000:
+    case 0xE000:
+      read_pointer = write_pointer = &m_memory_wram[0][address & 0xFFF];
+      break;
+
+    case 0xD000:
+      read_pointer = write_pointer = &m_memory_wram[m_high_wram_bank][address & 0xFFF];
+      break;
+
+      // working ram shadow, oam, io and zero page are handled by the slow path
+    case 0xF000:
+    {
+      if (address < 0xFE00)
+        read_pointer = write_pointer = &m_memory_wram[m_high_wram_bank][address & 0xFFF];
+    }
+    break;
+    }
+
+    // writes to working ram holding cached cpu code have to invalidate it
+    if (write_pointer != nullptr && m_memory_wram_code_pages[(write_pointer - m_memory_wram[0]) >> 8])
+      write_pointer = nullptr;
+
+    // as do writes to an address being watched by RunUntil
+    if (m_memory_watch_active && (m_memory_watch_address >> 8) == page)
+      write_pointer = nullptr;
+
+    m_memory_read_pages[page] = read_pointer;
+    m_memory_write_pages[page] = write_pointer;
+  }
+}
+
+uint8 System::CPUReadSlow(uint16 address)
 {
   //     if (address == 0xc009)
   //         __debugbreak();
 
   // when DMA transfer is in progress, all memory except FF80-FFFE is inaccessible
-  if (m_memory_locked_cycles > 0 && !m_memory_permissive && address >= m_memory_locked_start &&
+  if (m_memory_locked && !m_memory_permissive && address >= m_memory_locked_start &&
       address <= m_memory_locked_end)
   {
-    // TODO: Should change the currently-buffered byte in the DMA transfer
+    // the bus holds the byte the transfer last moved
     Log_DevPrintf("WARN: CPU read of address 0x%04X denied during DMA transfer", address);
-    return 0x00;
+    uint32 bytes = SynchronizeOAMDMA();
+    return (bytes > 0) ? m_memory_oam[bytes - 1] : 0xFF;
   }
 
   // select address range
@@ -1118,19 +1855,41 @@ uint8 System::CPURead(uint16 address)
   return 0x00;
 }
 
-void System::CPUWrite(uint16 address, uint8 value)
+void System::CPUWriteWRAM(uint32 bank, uint16 address, uint8 value)
+{
+  uint32 offset = address & 0xFFF;
+  m_memory_wram[bank][offset] = value;
+
+  // cached cpu blocks decoded from this page are now stale
+  uint32 page_index = bank * 16 + (offset >> 8);
+  if (m_memory_wram_code_pages[page_index])
+    m_cpu->InvalidateCachedWRAMPage(page_index);
+}
+
+void System::CPUWriteSlow(uint16 address, uint8 value)
 {
   //     if (address == 0xd000)
   //         __debugbreak();
 
   // when DMA transfer is in progress, all memory except FF80-FFFE is inaccessible
-  if (m_memory_locked_cycles > 0 && !m_memory_permissive && address >= m_memory_locked_start &&
+  if (m_memory_locked && !m_memory_permissive && address >= m_memory_locked_start &&
       address <= m_memory_locked_end)
   {
     Log_DevPrintf("WARN: CPU write of address 0x%04X (value 0x%02X) denied during DMA transfer", address, value);
     return;
   }
 
+  // bank switches and vram writes can change what an accurate transfer reads next
+  if (m_oam_dma_bytes < OAM_DMA_LENGTH)
+    SynchronizeOAMDMA();
+
+  // stop once the current instruction completes
+  if (m_memory_watch_active && address == m_memory_watch_address)
+  {
+    m_memory_watch_hit = true;
+    StopExecution();
+  }
+
   // select memory range
   switch (address & 0xF000)
   {
@@ -1171,21 +1930,22 @@ void System::CPUWrite(uint16 address, uint8 value)
     //             }
 
     m_memory_vram[m_vram_bank][address & 0x1FFF] = value;
+    m_display->InvalidateCachedTile(m_vram_bank, address & 0x1FFF);
     return;
   }
 
     // working ram
   case 0xC000:
-    m_memory_wram[0][address & 0xFFF] = value;
+    CPUWriteWRAM(0, address, value);
     return;
 
   case 0xD000:
-    m_memory_wram[m_high_wram_bank][address & 0xFFF] = value;
+    CPUWriteWRAM(m_high_wram_bank, address, value);
     return;
 
     // working ram shadow
   case 0xE000:
-    m_memory_wram[0][address & 0xFFF] = value;
+    CPUWriteWRAM(0, address, value);
     return;
 
     // working ram shadow, i/o, zero-page
@@ -1208,7 +1968,7 @@ void System::CPUWrite(uint16 address, uint8 value)
     case 0xB00:
     case 0xC00:
     case 0xD00:
-      m_memory_wram[m_high_wram_bank][address & 0xFFF] = value;
+      CPUWriteWRAM(m_high_wram_bank, address, value);
       return;
 
       // oam
@@ -1228,6 +1988,7 @@ void System::CPUWrite(uint16 address, uint8 value)
       }
 
       m_memory_oam[address & 0xFF] = value;
+      m_display->InvalidateSpriteBins();
       return;
     }
 
@@ -1286,8 +2047,7 @@ uint8 System::CPUReadIORegister(uint8 index)
 
       // FF04 - DIV - Divider Register (R/W)
     case 0x04:
-      SynchronizeTimers();
-      return m_timer_divider;
+      return uint8(GetTimerSystemCounter() >> 8);
 
       // FF05 - TIMA - Timer counter (R/W)
     case 0x05:
@@ -1306,7 +2066,7 @@ uint8 System::CPUReadIORegister(uint8 index)
 
       // FF0F - IF - Interrupt Flag (R/W)
     case 0x0F:
-      return m_cpu->GetRegisters()->IF;
+      return m_cpu->m_registers.IF;
     }
 
     break;
@@ -1414,7 +2174,7 @@ uint8 System::CPUReadIORegister(uint8 index)
     {
       // FFFF = IE
     case 0x0F:
-      return m_cpu->GetRegisters()->IE;
+      return m_cpu->m_registers.IE;
     }
     break;
   }
@@ -1529,9 +2289,16 @@ void System::CPUWriteIORegister(uint8 index, uint8 value)
 
       // FF04 - DIV - Divider Register (R/W)
     case 0x04:
+    {
+      // clearing the counter is a falling edge when the selected bit was set
       SynchronizeTimers();
-      m_timer_divider = 0;
+      if (GetTimerSignal(m_timer_system_counter, m_timer_control))
+        AddTimerTicks(1);
+
+      m_timer_system_counter = 0;
+      ScheduleTimerSynchronization();
       return;
+    }
 
       // FF05 - TIMA - Timer counter (R/W)
     case 0x05:
@@ -1549,17 +2316,24 @@ void System::CPUWriteIORegister(uint8 index, uint8 value)
 
       // FF07 - TAC - Timer Control (R/W)
     case 0x07:
+    {
+      // as is disabling the timer or selecting a clear bit while the old one was set (dmg behaviour)
       SynchronizeTimers();
+      bool old_signal = GetTimerSignal(m_timer_system_counter, m_timer_control);
       m_timer_control = value;
+      if (old_signal && !GetTimerSignal(m_timer_system_counter, m_timer_control))
+        AddTimerTicks(1);
+
       ScheduleTimerSynchronization();
       return;
+    }
 
       // interrupt flag
     case 0x0F:
       m_serial->Synchronize();
       m_display->Synchronize();
       SynchronizeTimers();
-      m_cpu->GetRegisters()->IF = value;
+      m_cpu->SetIF(value);
       return;
     }
 
@@ -1684,6 +2458,8 @@ void System::CPUWriteIORegister(uint8 index, uint8 value)
       // 0x4C is set to 0x04 for CGB-in-DMG mode, 0xC0 otherwise.
       if (m_boot_mode == SYSTEM_MODE_CGB)
         m_current_mode = (m_reg_FF4C == 0x04) ? SYSTEM_MODE_DMG : SYSTEM_MODE_CGB;
+
+      UpdateMemoryMap(0x0000, 0x08FF);
       return;
     }
 
@@ -1696,7 +2472,7 @@ void System::CPUWriteIORegister(uint8 index, uint8 value)
     {
     case 0x0F:
       // F0-FE is high ram below, FF = interrupt flag
-      m_cpu->GetRegisters()->IE = value;
+      m_cpu->SetIE(value);
       return;
     }
 
@@ -1773,6 +2549,7 @@ void System::CPUWriteIORegister(uint8 index, uint8 value)
         if (m_high_wram_bank == 0)
           m_high_wram_bank = 1;
 
+        UpdateMemoryMap(0xD000, 0xFDFF);
         return;
       }
 
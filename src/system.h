@@ -63,6 +63,17 @@ public:
   // Returns the number of seconds to sleep for.
   double ExecuteFrame();
 
+  // timing-free execution, these never read the host clock so the results only depend on the emulated state
+  // runs until the given number of clocks have elapsed, the last instruction can overshoot, returns the clocks executed
+  uint64 RunCycles(uint64 clocks);
+
+  // runs until the display has pushed the given number of frames. with the display off a frame ends after two frame
+  // intervals instead. returns the number of frames actually pushed.
+  uint32 RunFrames(uint32 frames);
+
+  // runs until the condition is met or max_clocks have elapsed, returns true if the condition was met
+  bool RunUntil(RUN_CONDITION condition, uint16 address, uint64 max_clocks);
+
   // Pad direction
   void SetPadDirection(PAD_DIRECTION direction);
   void SetPadDirection(PAD_DIRECTION direction, bool state);
@@ -70,9 +81,16 @@ public:
   void SetPadButton(PAD_BUTTON button, bool state);
   void SetPadButtonState(uint8 state);
 
+  // current pad state in the form the Set*State methods take, i.e. set bits are held down
+  uint8 GetPadDirectionState() const { return (m_pad_direction_state ^ PAD_DIRECTION_MASK); }
+  uint8 GetPadButtonState() const { return (m_pad_button_state ^ PAD_BUTTON_MASK); }
+
   // frame number
   uint32 GetFrameCounter() const { return m_frame_counter; }
 
+  // emulated time in 4.19MHz clocks, restarted whenever the timing options change
+  uint64 GetClocksSinceReset() const { return m_clocks_since_reset; }
+
   // current speed
   void CalculateCurrentSpeed();
   float GetCurrentSpeed() const { return m_current_speed; }
@@ -86,13 +104,51 @@ public:
   bool GetFrameLimiter() const { return m_frame_limiter; }
   void SetFrameLimiter(bool on);
 
+  // audio sync, paces frames by the audio output rather than the host timer, with the audio rate control keeping
+  // latency_ms of audio queued. only in effect with the frame limiter on at normal speed and audio enabled, as
+  // otherwise the output can't keep up with or starves the emulation. 0 turns it off.
+  uint32 GetAudioSyncLatency() const { return m_audio_sync_latency; }
+  void SetAudioSyncLatency(uint32 latency_ms);
+  bool IsAudioSyncActive() const;
+
+  // under audio sync ExecuteFrame doesn't sleep, the frontend waits this many seconds after presenting instead
+  double GetAudioSyncWaitTime();
+
   // accurate timing
   bool GetAccurateTiming() const { return m_accurate_timing; }
   void SetAccurateTiming(bool on);
 
+  // cpu execution backend
+  CPU_BACKEND GetCPUBackend() const { return m_cpu_backend; }
+  void SetCPUBackend(CPU_BACKEND backend);
+
+  // skipping of polling loops, fast-forwards time while the cpu waits for an io register to change
+  bool GetIdleLoopSkipping() const { return m_idle_loop_skipping; }
+  void SetIdleLoopSkipping(bool on) { m_idle_loop_skipping = on; }
+
+  // oam dma copies all 160 bytes when started, or in accurate mode one byte per machine cycle as the transfer runs
+  bool GetAccurateOAMDMA() const { return m_accurate_oam_dma; }
+  void SetAccurateOAMDMA(bool on);
+
   // permissive memory access
   bool GetPermissiveMemoryAccess() const { return m_memory_permissive; }
-  void SetPermissiveMemoryAccess(bool on) { m_memory_permissive = on; }
+  void SetPermissiveMemoryAccess(bool on)
+  {
+    m_memory_permissive = on;
+    UpdateMemoryMap();
+  }
+
+  // number of times each event fired during the last complete frame
+  uint32 GetFrameEventCount(SYSTEM_EVENT event) const { return m_frame_event_counts[event]; }
+
+  // run-ahead, hides input latency by showing the frame the given number of frames past the real one. after each
+  // frame ExecuteFrame saves the state, runs that many frames with the current input and no audio, presents the last
+  // and restores. not used while a link cable is connected, as the other side would see the speculative transfers.
+  uint32 GetRunAheadFrames() const { return m_run_ahead_frames; }
+  void SetRunAheadFrames(uint32 frames);
+
+  // speculative frames executed so far, i.e. the extra work run-ahead costs
+  uint64 GetRunAheadFrameCount() const { return m_run_ahead_frame_count; }
 
   // audio enable/disable
   bool GetAudioEnabled() const;
@@ -102,10 +158,40 @@ public:
   bool LoadState(ByteStream* pStream, Error* pError);
   bool SaveState(ByteStream* pStream);
 
+  // in-memory snapshots, a fixed-size block captured and restored with plain copies and no allocation. the rom is
+  // shared rather than copied, so a snapshot can only be restored to the system that allocated it, and only between
+  // calls to ExecuteFrame/RunCycles/RunFrames/RunUntil.
+  struct Snapshot;
+  uint32 GetSnapshotSize() const;
+  Snapshot* AllocateSnapshot() const;
+  static void FreeSnapshot(Snapshot* snapshot);
+  void CaptureSnapshot(Snapshot* snapshot);
+  void RestoreSnapshot(const Snapshot* snapshot);
+
+  // hash of work ram, video ram and oam, for checking that two runs ended up in the same state
+  uint64 GetMemoryHash() const;
+
 private:
-  // cpu view of memory
-  uint8 CPURead(uint16 address);
-  void CPUWrite(uint16 address, uint8 value);
+  // cpu view of memory, pages without side effects are accessed directly through the memory map
+  inline uint8 CPURead(uint16 address)
+  {
+    const byte* page = m_memory_read_pages[address >> 8];
+    return (page != nullptr) ? page[address & 0xFF] : CPUReadSlow(address);
+  }
+  inline void CPUWrite(uint16 address, uint8 value)
+  {
+    byte* page = m_memory_write_pages[address >> 8];
+    if (page != nullptr)
+      page[address & 0xFF] = value;
+    else
+      CPUWriteSlow(address, value);
+  }
+  uint8 CPUReadSlow(uint16 address);
+  void CPUWriteSlow(uint16 address, uint8 value);
+  void CPUWriteWRAM(uint32 bank, uint16 address, uint8 value);
+
+  // rebuilds the memory map for the pages covering the specified range
+  void UpdateMemoryMap(uint16 start_address = 0x0000, uint16 end_address = 0xFFFF);
 
   // cpu io registers
   uint8 CPUReadIORegister(uint8 index);
@@ -130,6 +216,10 @@ private:
 
   // OAM DMA Transfer
   void OAMDMATransfer(uint16 source_address);
+  void EndOAMDMATransfer();
+
+  // copies the bytes an accurate transfer should have reached by now, returns the number transferred so far
+  uint32 SynchronizeOAMDMA();
 
   // CGB Speed Switch
   bool SwitchCGBSpeed();
@@ -137,51 +227,56 @@ private:
   // serial pause
   void SetSerialPause(bool enabled);
 
+  // runs the cpu until target_clocks is reached, or execution is stopped by a vblank (if requested) or serial pause
+  void ExecuteCPU(uint64 target_clocks, bool stop_at_vblank);
+  void StopExecution() { m_execute_target_clocks = 0; }
+
   // trigger OAM bug if all conditions are met
   void TriggerOAMBug();
 
   // synchronization
-  // yeah this'll overflow, but it just means we'll synchronize too early, then correct it afterwards
-  uint32 GetCycleNumber() const { return m_cycle_number; }
+  // 64-bit, so event cycles are never compared across a wrap
+  uint64 GetCycleNumber() const { return m_cycle_number; }
   uint32 GetDoubleSpeedDivider() const { return (m_cgb_speed_switch >> 7); }
   void SetNextDisplaySyncCycle(uint32 cycles)
   {
-    m_next_display_sync_cycle = m_cycle_number + (cycles >> GetDoubleSpeedDivider());
-    UpdateNextEventCycle();
+    ScheduleEvent(SYSTEM_EVENT_DISPLAY, cycles >> GetDoubleSpeedDivider());
   }
   void SetNextAudioSyncCycle(uint32 cycles)
   {
-    m_next_audio_sync_cycle = m_cycle_number + (cycles >> GetDoubleSpeedDivider());
-    UpdateNextEventCycle();
-  }
-  void SetNextSerialSyncCycle(uint32 cycles)
-  {
-    m_next_serial_sync_cycle = m_cycle_number + cycles;
-    UpdateNextEventCycle();
-  }
-  void SetNextTimerSyncCycle(uint32 cycles)
-  {
-    m_next_timer_sync_cycle = m_cycle_number + cycles;
-    UpdateNextEventCycle();
+    ScheduleEvent(SYSTEM_EVENT_AUDIO, cycles >> GetDoubleSpeedDivider());
   }
+  void SetNextSerialSyncCycle(uint32 cycles) { ScheduleEvent(SYSTEM_EVENT_SERIAL, cycles); }
+  void SetNextTimerSyncCycle(uint32 cycles) { ScheduleEvent(SYSTEM_EVENT_TIMER, cycles); }
+
+  // event scheduler, a queue of pending events sorted by the cycle they fire on
+  // cycles are cpu clocks, i.e. they are not scaled in double speed mode
+  typedef void (*EventCallback)(void* param);
+  void RegisterEvent(SYSTEM_EVENT event, EventCallback callback, void* param);
+  void ScheduleEvent(SYSTEM_EVENT event, uint32 cycles);
+  void CancelEvent(SYSTEM_EVENT event);
+  bool IsEventPending(SYSTEM_EVENT event) const { return m_events[event].pending; }
+  uint32 GetEventCyclesRemaining(SYSTEM_EVENT event) const;
+  void ResetEvents();
+  void RunEvents();
   void UpdateNextEventCycle();
 
-  // helper to calculate difference
-  inline uint32 CalculateCycleCount(uint32 oldCycleNumber)
+  // helper to calculate difference, components synchronize often enough for it to fit in 32 bits
+  inline uint32 CalculateCycleCount(uint64 oldCycleNumber)
   {
-    return ((oldCycleNumber > m_cycle_number) ? (0xFFFFFFFF - oldCycleNumber + m_cycle_number) :
-                                                (m_cycle_number - oldCycleNumber)) >>
-           GetDoubleSpeedDivider();
+    return uint32((m_cycle_number - oldCycleNumber) >> GetDoubleSpeedDivider());
   }
-  inline uint32 CalculateDoubleSpeedCycleCount(uint32 oldCycleNumber)
+  inline uint32 CalculateDoubleSpeedCycleCount(uint64 oldCycleNumber)
   {
-    return (oldCycleNumber > m_cycle_number) ? (0xFFFFFFFF - oldCycleNumber + m_cycle_number) :
-                                               (m_cycle_number - oldCycleNumber);
+    return uint32(m_cycle_number - oldCycleNumber);
   }
 
   // execute other processors while the cpu is reading memory
   void AddCPUCycles(uint32 cpu_clocks);
 
+  // halted or disabled cpu, advances straight to the next event or the execution target, whichever is first
+  void AddIdleCPUCycles();
+
 private:
   void ResetMemory();
   void ResetTimer();
@@ -189,9 +284,39 @@ private:
   void SetPostBootstrapState();
   void SynchronizeTimers();
   void ScheduleTimerSynchronization();
+
+  // the system counter is never stepped, it is derived from the cycles passed since the last synchronization
+  uint16 GetTimerSystemCounter() const
+  {
+    return uint16(m_timer_system_counter + (m_cycle_number - m_timer_last_cycle));
+  }
+
+  // system counter clocks per TIMA tick for each TAC clock select (4096hz, 262144hz, 65536hz, 16384hz)
+  static uint32 GetTimerPeriod(uint8 control)
+  {
+    static const uint32 periods[] = {1024, 16, 64, 256};
+    return periods[control & 0x3];
+  }
+
+  // TIMA increments on the falling edge of this signal, the enable bit and the system counter bit selected by TAC
+  static bool GetTimerSignal(uint16 system_counter, uint8 control)
+  {
+    return ((control & 0x4) != 0 && (system_counter & (GetTimerPeriod(control) >> 1)) != 0);
+  }
+
+  // advances TIMA by any number of ticks, reloading from TMA and raising the interrupt on overflow
+  void AddTimerTicks(uint64 ticks);
+
+  // copies oam dma bytes up to (not including) end
+  void CopyOAMDMABytes(uint32 end);
+
   void DisassembleCart(const char* outfile);
   uint64 TimeToClocks(double time);
   double ClocksToTime(uint64 clocks);
+  void RunAhead();
+
+  // turns the audio rate control on or off to match IsAudioSyncActive
+  void UpdateAudioSync();
 
   SYSTEM_MODE m_boot_mode;
   SYSTEM_MODE m_current_mode;
@@ -206,13 +331,20 @@ private:
   uint32 m_bios_length;
 
   // synchronization
-  uint32 m_cycle_number;
-  uint32 m_last_sync_cycle;
-  uint32 m_next_display_sync_cycle;
-  uint32 m_next_audio_sync_cycle;
-  uint32 m_next_serial_sync_cycle;
-  uint32 m_next_timer_sync_cycle;
+  struct Event
+  {
+    uint64 cycle;
+    EventCallback callback;
+    void* param;
+    bool pending;
+  };
+  uint64 m_cycle_number;
   int32 m_next_event_cycle;
+  Event m_events[NUM_SYSTEM_EVENTS];
+  uint8 m_event_queue[NUM_SYSTEM_EVENTS];
+  uint32 m_event_queue_length;
+  uint32 m_event_counts[NUM_SYSTEM_EVENTS];
+  uint32 m_frame_event_counts[NUM_SYSTEM_EVENTS];
   bool m_event;
 
   Timer m_speed_timer;
@@ -227,10 +359,27 @@ private:
   float m_speed_multiplier;
   uint32 m_frame_counter;
   bool m_frame_limiter;
+  uint32 m_audio_sync_latency;
   bool m_accurate_timing;
   bool m_paused;
   bool m_serial_pause;
 
+  // cpu execution target, checked after every instruction
+  CPU_BACKEND m_cpu_backend;
+  bool m_idle_loop_skipping;
+  uint64 m_execute_target_clocks;
+  bool m_execute_stop_at_vblank;
+
+  // run-ahead, the snapshot is only allocated while enabled
+  uint32 m_run_ahead_frames;
+  uint64 m_run_ahead_frame_count;
+  Snapshot* m_run_ahead_snapshot;
+
+  // RunUntil memory write condition, the page is kept out of the memory map while active
+  uint16 m_memory_watch_address;
+  bool m_memory_watch_active;
+  bool m_memory_watch_hit;
+
   // bios, rom banks 0-1
   byte m_memory_vram[2][0x2000];
   byte m_memory_wram[8][0x1000]; // 8 banks of 4KB each in CGB mode
@@ -242,17 +391,29 @@ private:
   uint8 m_reg_FF4C;
   uint8 m_reg_FF6C;
 
-  // when doing DMA transfer, locked memory # cycles
-  uint32 m_memory_locked_cycles;
+  // memory map, one pointer per 256-byte page, nullptr if the page has to go through CPUReadSlow/CPUWriteSlow
+  const byte* m_memory_read_pages[256];
+  byte* m_memory_write_pages[256];
+  uint32 m_memory_map_serial;
+
+  // working ram pages (bank * 16 + page) the cpu has cached code from, writes to these go through the slow path
+  bool m_memory_wram_code_pages[8 * 16];
+
+  // when doing DMA transfer, locked until SYSTEM_EVENT_OAM_DMA fires
+  bool m_memory_locked;
   uint16 m_memory_locked_start;
   uint16 m_memory_locked_end;
   bool m_memory_permissive;
 
-  // timer
-  uint32 m_timer_last_cycle;
-  uint32 m_timer_clocks;
-  uint32 m_timer_divider_clocks;
-  uint8 m_timer_divider;
+  // oam dma transfer, m_oam_dma_bytes have been copied so far
+  bool m_accurate_oam_dma;
+  uint16 m_oam_dma_source;
+  uint32 m_oam_dma_bytes;
+  uint64 m_oam_dma_start_cycle;
+
+  // timer, the system counter (DIV is the upper byte) as of m_timer_last_cycle
+  uint64 m_timer_last_cycle;
+  uint16 m_timer_system_counter;
   uint8 m_timer_counter;
   uint8 m_timer_overflow_value;
   uint8 m_timer_control;